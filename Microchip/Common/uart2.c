@@ -80,6 +80,17 @@ BUT NOT LIMITED TO ANY DEFENSE THEREOF), OR OTHER SIMILAR COSTS.
     #error Cannot calculate actual baud rate
 #endif 
 
+//Transmit ring buffer.  Define UART2_TX_BUFFER_SIZE in HardwareProfile.h to
+//send from the UART2 transmit interrupt instead of waiting for each character.
+
+#if defined (UART2_TX_BUFFER_SIZE) && defined (__PIC32MX__)
+    #define UART2_TX_INTERRUPT
+    #if (UART2_TX_BUFFER_SIZE < 2)
+        #error UART2_TX_BUFFER_SIZE must be at least 2
+    #endif
+    #define UART2_TX_INTERRUPT_PRIORITY 2   // Below the USB interrupt (4), matches ipl2 below
+#endif
+
 	#define BAUD_ERROR              ((BAUD_ACTUAL > BAUDRATE2) ? BAUD_ACTUAL-BAUDRATE2 : BAUDRATE2-BAUD_ACTUAL)
 	#define BAUD_ERROR_PERCENT      ((BAUD_ERROR*100+BAUDRATE2/2)/BAUDRATE2)
 	
@@ -93,6 +104,18 @@ BUT NOT LIMITED TO ANY DEFENSE THEREOF), OR OTHER SIMILAR COSTS.
 
 #endif // #if defined (__C30__)
 
+//******************************************************************************
+// Variables
+//******************************************************************************
+
+#if defined (UART2_TX_INTERRUPT)
+static unsigned char            uart2TxBuffer[UART2_TX_BUFFER_SIZE];
+static volatile unsigned int    uart2TxHead;        // Next slot written by UART2PutChar()
+static volatile unsigned int    uart2TxTail;        // Next character sent by the interrupt
+static unsigned long            uart2TxDropped;     // Characters dropped because the ring was full
+static unsigned int             uart2TxPeak;        // Most characters waiting at one time
+#endif
+
 /*******************************************************************************
 Function: UART2GetBaudError()
 
@@ -171,6 +194,20 @@ void UART2Init()
     #if defined (__PIC32MX__)
         U2STAbits.URXEN = 1;
     #endif
+
+    #if defined (UART2_TX_INTERRUPT)
+        uart2TxHead     = 0;
+        uart2TxTail     = 0;
+        uart2TxDropped  = 0;
+        uart2TxPeak     = 0;
+
+        // Interrupt while there is space in the transmit FIFO.  The interrupt
+        // is enabled only while the ring holds data.
+        U2STAbits.UTXISEL = 0;
+        IEC1bits.U2TXIE = 0;
+        IFS1bits.U2TXIF = 0;
+        IPC8bits.U2IP = UART2_TX_INTERRUPT_PRIORITY;
+    #endif
 }
 
 /*******************************************************************************
@@ -228,6 +265,11 @@ Overview:
     This routine writes a character to the transmit FIFO, and then waits for the
     transmit FIFO to be empty.
 
+    If UART2_TX_BUFFER_SIZE is defined, the character is put in the transmit
+    ring buffer instead, and the routine returns at once.  If the ring is
+    full, the character is dropped and counted.  Use UART2TxFree() to avoid
+    drops.
+
 Input: Byte to be sent.
 
 Output: None.
@@ -235,14 +277,160 @@ Output: None.
 *******************************************************************************/
 void UART2PutChar( char ch )
 {
+#if defined (UART2_TX_INTERRUPT)
+    unsigned int next;
+    unsigned int used;
+
+    next = uart2TxHead + 1;
+    if (next >= UART2_TX_BUFFER_SIZE)
+        next = 0;
+    if (next == uart2TxTail)
+    {
+        uart2TxDropped++;
+        return;
+    }
+
+    uart2TxBuffer[uart2TxHead] = ch;
+    uart2TxHead = next;
+    IEC1SET = _IEC1_U2TXIE_MASK;
+
+    used = UART2_TX_BUFFER_SIZE - 1 - UART2TxFree();
+    if (used > uart2TxPeak)
+        uart2TxPeak = used;
+#else
     U2TXREG = ch;
     #if !defined(__PIC32MX__)
         Nop();
         Nop();
     #endif
     while(U2STAbits.TRMT == 0);
+#endif
+}
+
+#if defined (UART2_TX_INTERRUPT)
+/*******************************************************************************
+Function: UART2TxFree()
+
+Precondition:
+    UART2Init must be called prior to calling this routine.
+
+Overview:
+    This routine returns the number of characters that can be written without
+    being dropped.  A caller that must not lose data, such as a frame upload,
+    waits until there is space for its whole packet.
+
+Input: None.
+
+Output: Free space in the transmit ring buffer.
+
+*******************************************************************************/
+unsigned int UART2TxFree( void )
+{
+    unsigned int head = uart2TxHead;
+    unsigned int tail = uart2TxTail;
+
+    if (tail > head)
+        return tail - head - 1;
+    return UART2_TX_BUFFER_SIZE - 1 - (head - tail);
+}
+
+/*******************************************************************************
+Function: UART2TxFlush()
+
+Precondition:
+    UART2Init must be called prior to calling this routine.
+
+Overview:
+    This routine waits until every character in the transmit ring buffer has
+    been sent.
+
+Input: None.
+
+Output: None.
+
+*******************************************************************************/
+void UART2TxFlush( void )
+{
+    while (uart2TxHead != uart2TxTail);
+    while (U2STAbits.TRMT == 0);
 }
 
+/*******************************************************************************
+Function: UART2TxDropped()
+
+Precondition:
+    UART2Init must be called prior to calling this routine.
+
+Overview:
+    This routine returns the number of characters dropped because the
+    transmit ring buffer was full.
+
+Input: None.
+
+Output: Number of dropped characters.
+
+*******************************************************************************/
+unsigned long UART2TxDropped( void )
+{
+    return uart2TxDropped;
+}
+
+/*******************************************************************************
+Function: UART2TxPeak()
+
+Precondition:
+    UART2Init must be called prior to calling this routine.
+
+Overview:
+    This routine returns the most characters that have been waiting in the
+    transmit ring buffer at one time.  It shows how close the logging has
+    come to dropping data.
+
+Input: None.
+
+Output: Peak use of the transmit ring buffer.
+
+*******************************************************************************/
+unsigned int UART2TxPeak( void )
+{
+    return uart2TxPeak;
+}
+
+/*******************************************************************************
+Function: _UART2Interrupt()
+
+Precondition:
+    UART2Init must be called prior to calling this routine.
+
+Overview:
+    This is the UART2 interrupt handler.  It moves characters from the
+    transmit ring buffer to the transmit FIFO, and disables the transmit
+    interrupt when the ring is empty.
+
+Input: None.
+
+Output: None.
+
+*******************************************************************************/
+void __ISR(_UART_2_VECTOR, ipl2) _UART2Interrupt(void)
+{
+    unsigned int tail = uart2TxTail;
+
+    while ((tail != uart2TxHead) && (U2STAbits.UTXBF == 0))
+    {
+        U2TXREG = uart2TxBuffer[tail];
+        tail++;
+        if (tail >= UART2_TX_BUFFER_SIZE)
+            tail = 0;
+    }
+    uart2TxTail = tail;
+
+    if (tail == uart2TxHead)
+        IEC1CLR = _IEC1_U2TXIE_MASK;
+    IFS1CLR = _IFS1_U2TXIF_MASK;
+}
+#endif
+
 /*******************************************************************************
 Function: UART2PutDec(unsigned char dec)
 
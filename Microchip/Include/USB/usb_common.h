@@ -121,6 +121,7 @@ CONSEQUENTIAL DAMAGES, FOR ANY REASON WHATSOEVER.
 #define USB_ENDPOINT_ERROR_PID_CHECK            0x26    // USB Module - Illegal PID received.
 #define USB_ENDPOINT_ERROR_BMX                  0x27    // USB Module - Bus Matrix error.
 #define USB_ERROR_INSUFFICIENT_POWER            0x28    // Too much power was requested
+#define USB_ERROR_INSUFFICIENT_BANDWIDTH        0x29    // Not enough bus time for the periodic endpoints
 
 // Section: Return values for USBHostDeviceStatus()
 
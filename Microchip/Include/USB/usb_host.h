@@ -214,6 +214,25 @@ of type ISOCHRONOUS_DATA for each concurrent transfer.  When the device
 attaches, the client driver must inform the application layer of the maximum
 transfer size.  At this point, the application must allocate space for the 
 data buffers, and set the data buffer points in this structure to point to them.
+
+Each packet is given to the user in only one way, selected by deliveryMode:
+
+    USB_ISOC_DELIVERY_NONE      - No event.  The user walks the buffers from
+                                    currentBufferUser and releases them.
+    USB_ISOC_DELIVERY_ISR       - EVENT_DATA_ISOC_READ/WRITE is sent to the
+                                    data event handler from the interrupt
+                                    handler.
+    USB_ISOC_DELIVERY_QUEUED    - The packet is queued, and USBHostTasks()
+                                    sends EVENT_DATA_ISOC_READ/WRITE to the
+                                    data event handler.  The event points to
+                                    the data buffer, so the data is not copied.
+
+For a read, the buffer is released if the data event handler returns TRUE.
+Otherwise the user must release it by clearing bfDataLengthValid.  The
+counters show that every packet was handled once: packetCount counts the
+packets the USB peripheral transferred, deliveredCount the ones passed to the
+data event handler, and lostEventCount the ones dropped because the event
+queue was full.
 */
 
 #if !defined( USB_MAX_ISOCHRONOUS_DATA_BUFFERS )
@@ -223,12 +242,21 @@ data buffers, and set the data buffer points in this structure to point to them.
     #error At least two buffers must be defined for isochronous data.
 #endif
 
+#define USB_ISOC_DELIVERY_NONE      0   // The user polls the buffers.
+#define USB_ISOC_DELIVERY_ISR       1   // Data event from the interrupt handler.
+#define USB_ISOC_DELIVERY_QUEUED    2   // Data event from USBHostTasks().
+
 typedef struct _ISOCHRONOUS_DATA
 {
     BYTE    totalBuffers;       // Total number of buffers available.
     BYTE    currentBufferUSB;   // The current buffer the USB peripheral is accessing.
     BYTE    currentBufferUser;  // The current buffer the user is reading/writing.
     BYTE    *pDataUser;         // User pointer for accessing data.
+    DWORD   overrunCount;       // Intervals skipped because the next buffer was not released (read) or not filled (write).
+    BYTE    deliveryMode;       // How packets are given to the user.  See USB_ISOC_DELIVERY_*.
+    DWORD   packetCount;        // Packets transferred.
+    DWORD   deliveredCount;     // Packets passed to the data event handler.
+    DWORD   lostEventCount;     // Packets dropped because the event queue was full (USB_ISOC_DELIVERY_QUEUED).
     
     ISOCHRONOUS_DATA_BUFFER buffers[USB_MAX_ISOCHRONOUS_DATA_BUFFERS];  // Data buffer information.
 } ISOCHRONOUS_DATA;
@@ -682,6 +710,259 @@ BYTE    USBHostDeviceStatus( BYTE deviceAddress );
 #define USBHostGetDeviceDescriptor( deviceAddress )     ( pDeviceDescriptor )
 
 
+/****************************************************************************
+  Function:
+    void USBHostGetEventQueueStatus( BYTE *pHighWater, DWORD *pOverflows )
+
+  Summary:
+    This function returns how full the USB event queue has been.
+
+  Description:
+    This function returns the most events that have been waiting in the
+    event queue at once, and the number of events that were lost because
+    the queue was full.  Increase USB_EVENT_QUEUE_DEPTH if events are lost.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *pHighWater    - Most events queued at once
+    DWORD *pOverflows   - Events lost because the queue was full
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_ENABLE_TRANSFER_EVENT is defined
+    in usb_config.h.
+  ***************************************************************************/
+
+#if defined( USB_ENABLE_TRANSFER_EVENT )
+    void USBHostGetEventQueueStatus( BYTE *pHighWater, DWORD *pOverflows );
+#endif
+
+
+/****************************************************************************
+  Function:
+    void USBHostGetArenaStatus( WORD *pUsed, WORD *pPeak )
+
+  Summary:
+    This function returns how much of the device memory arena is in use.
+
+  Description:
+    The descriptors of the attached device and the interface and endpoint
+    lists built from them are taken from a static arena of
+    USB_HOST_ARENA_SIZE bytes.  This function returns the number of bytes
+    in use now, and the most bytes that have been in use since the stack
+    was started.
+
+  Precondition:
+    None
+
+  Parameters:
+    WORD *pUsed - Bytes in use now
+    WORD *pPeak - Most bytes that have been in use
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_ARENA_SIZE is defined in
+    usb_config.h.  If the peak is above USB_HOST_ARENA_SIZE, a device could
+    not be enumerated because the arena is too small.
+  ***************************************************************************/
+
+#if defined( USB_HOST_ARENA_SIZE )
+    void USBHostGetArenaStatus( WORD *pUsed, WORD *pPeak );
+#endif
+
+
+/****************************************************************************
+  Function:
+    BOOL USBHostDescriptorCacheUsed( void )
+
+  Summary:
+    This function tells if the attached device was configured from the
+    descriptor cache.
+
+  Description:
+    The descriptors and the interface list of the last configured device
+    are kept after it is detached.  When a device with the same VID, PID,
+    and release number is attached, only the first bytes of each
+    Configuration Descriptor are read and compared with the cache, and the
+    cached interface list is used without parsing the descriptor again.
+    This function returns TRUE if that happened for the attached device.
+
+  Precondition:
+    None
+
+  Parameters:
+    None
+
+  Return Values:
+    TRUE    - The device was configured from the cache
+    FALSE   - The descriptors were read from the device
+
+  Remarks:
+    This function is available only if USB_HOST_DESCRIPTOR_CACHE is defined
+    in usb_config.h.  USB_HOST_ARENA_SIZE must also be defined.
+  ***************************************************************************/
+
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+    BOOL USBHostDescriptorCacheUsed( void );
+#endif
+
+
+/****************************************************************************
+  Function:
+    DWORD USBHostGetMaxISRTime( BOOL reset )
+
+  Summary:
+    This function returns the longest time spent in the USB interrupt.
+
+  Description:
+    This function returns the longest time that _USB1Interrupt() has run
+    since the measurement was last reset.  This includes the data event
+    handlers that are called from the interrupt, so it shows how long
+    application processing holds off the USB interrupt.
+
+  Precondition:
+    None
+
+  Parameters:
+    BOOL reset  - Start a new measurement after reading the value
+
+  Returns:
+    Longest interrupt time, in core timer counts (half the system clock)
+
+  Remarks:
+    This function is available only if USB_HOST_MEASURE_ISR_TIME is defined
+    in usb_config.h.  PIC32 only.
+  ***************************************************************************/
+
+#if defined( USB_HOST_MEASURE_ISR_TIME ) && defined( __PIC32MX__ )
+    DWORD USBHostGetMaxISRTime( BOOL reset );
+#endif
+
+
+/****************************************************************************
+  Function:
+    DWORD USBHostGetEnumerationTime( DWORD *pAttachTime )
+
+  Summary:
+    This function returns how long the attached device took to enumerate.
+
+  Description:
+    This function returns the time from the attach of the device until it
+    was configured and its client drivers were initialized, and the core
+    timer value when the device was attached.  The application can use the
+    attach time to measure the time to its first result, such as the first
+    video frame.
+
+  Precondition:
+    None
+
+  Parameters:
+    DWORD *pAttachTime  - Core timer value when the device was attached
+
+  Returns:
+    Enumeration time, in core timer counts (half the system clock).  0 if
+    the device has not finished enumerating.
+
+  Remarks:
+    This function is available only if USB_HOST_MEASURE_ENUMERATION_TIME is
+    defined in usb_config.h.  PIC32 only.
+  ***************************************************************************/
+
+#if defined( USB_HOST_MEASURE_ENUMERATION_TIME ) && defined( __PIC32MX__ )
+    DWORD USBHostGetEnumerationTime( DWORD *pAttachTime );
+#endif
+
+
+/****************************************************************************
+  Function:
+    WORD USBHostGetMaxSchedulingDecisions( BOOL reset )
+
+  Summary:
+    This function returns the most token scheduling decisions made in one
+    frame.
+
+  Description:
+    This function returns the largest number of times the scheduler searched
+    for an endpoint to service during one frame, since the count was last
+    reset.  It shows how much work the interrupt handler does to find the
+    next token.
+
+  Precondition:
+    None
+
+  Parameters:
+    BOOL reset  - Start a new count after reading the value
+
+  Returns:
+    Most endpoint searches made during one frame
+
+  Remarks:
+    This function is available only if USB_HOST_COUNT_SCHEDULING is defined
+    in usb_config.h.
+  ***************************************************************************/
+
+#if defined( USB_HOST_COUNT_SCHEDULING )
+    WORD USBHostGetMaxSchedulingDecisions( BOOL reset );
+#endif
+
+
+// *****************************************************************************
+/* Frame Statistics
+
+This structure holds the bus time used by the frames, in full-speed byte
+times.  A frame has 1500 byte times, and up to 90% of them may be reserved
+for isochronous and interrupt endpoints.
+*/
+
+typedef struct _USB_FRAME_STATISTICS
+{
+    WORD        wReservedPeak;      // Most periodic bus time reserved in one frame of the schedule.
+    WORD        wUsedPeak;          // Most bus time used in one frame.
+    DWORD       dwUsedTotal;        // Bus time used by all the frames counted.
+    DWORD       dwFrames;           // Number of frames counted.
+} USB_FRAME_STATISTICS;
+
+
+/****************************************************************************
+  Function:
+    void USBHostGetFrameStatistics( USB_FRAME_STATISTICS *pStatistics,
+                BOOL reset )
+
+  Summary:
+    This function returns how much bus time the frames have used.
+
+  Description:
+    This function copies the bus time statistics of the frame scheduler.
+    The time of a frame includes the periodic bus time reserved for it, and
+    the control and bulk transactions sent in the rest of the frame.
+
+  Precondition:
+    None
+
+  Parameters:
+    USB_FRAME_STATISTICS *pStatistics   - Where to copy the statistics
+    BOOL reset                          - Start new counts after reading them
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_COUNT_SCHEDULING is defined
+    in usb_config.h.  wReservedPeak is not reset; it changes only when the
+    interface settings change.
+  ***************************************************************************/
+
+#if defined( USB_HOST_COUNT_SCHEDULING )
+    void USBHostGetFrameStatistics( USB_FRAME_STATISTICS *pStatistics, BOOL reset );
+#endif
+
+
 /****************************************************************************
   Function:
     BYTE USBHostGetStringDescriptor ( BYTE deviceAddress,  BYTE stringNumber,
@@ -931,6 +1212,8 @@ void USBHostIsochronousBuffersReset( ISOCHRONOUS_DATA * isocData, BYTE numberOfB
     USB_ENDPOINT_BUSY           - A read or write is already in progress
     USB_ILLEGAL_REQUEST         - SET CONFIGURATION cannot be performed with
                                     this function.
+    USB_ERROR_INSUFFICIENT_BANDWIDTH - SET INTERFACE selects a setting whose
+                                    periodic endpoints do not fit in a frame
 
   Remarks:
     DTS reset is done before the command is issued.
@@ -941,6 +1224,86 @@ BYTE    USBHostIssueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType, BYTE
              BYTE clientDriverID );
 
 
+// *****************************************************************************
+/* Control Request Callback
+
+This function is called by USBHostTasks() when a request queued with
+USBHostQueueDeviceRequest() has completed.  errorCode is USB_SUCCESS or the
+reason the request failed, data points to the data of the request, and
+byteCount is the number of data bytes transferred.  The callback may queue
+more requests.
+*/
+
+typedef void (*USB_CONTROL_CALLBACK)( BYTE deviceAddress, BYTE errorCode, BYTE *data, DWORD byteCount, void *context );
+
+
+/****************************************************************************
+  Function:
+    BYTE USBHostQueueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType,
+                    BYTE bRequest, WORD wValue, WORD wIndex, WORD wLength,
+                    BYTE *data, BYTE dataDirection,
+                    USB_CONTROL_CALLBACK callback, void *context )
+
+  Summary:
+    This function adds a device request to the queue of EP0 requests.
+
+  Description:
+    This function adds a device request to the queue of EP0 requests.
+    USBHostTasks() sends the queued requests one after another, as soon as
+    EP0 is free, and calls the callback of each one when it completes.  The
+    application does not have to poll USBHostTransferIsComplete(), and can
+    queue several requests at once.
+
+    If wLength is no more than USB_HOST_CONTROL_DATA_SIZE, the data is kept
+    in the queue.  The data of a SET request is copied when it is queued, and
+    the data of a GET request is copied to data (if it is not NULL) before
+    the callback is called.  Longer requests use the buffer at data, which
+    must be kept until the callback is called.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE deviceAddress          - Device address
+    BYTE bmRequestType          - The request type as defined by the USB
+                                    specification.
+    BYTE bRequest               - The request as defined by the USB
+                                    specification.
+    WORD wValue                 - The value for the request as defined by
+                                    the USB specification.
+    WORD wIndex                 - The index for the request as defined by
+                                    the USB specification.
+    WORD wLength                - The data length for the request as
+                                    defined by the USB specification.
+    BYTE *data                  - Pointer to the data for the request.
+    BYTE dataDirection          - USB_DEVICE_REQUEST_SET or
+                                    USB_DEVICE_REQUEST_GET
+    USB_CONTROL_CALLBACK callback - Function to call when the request
+                                    completes, or NULL.
+    void *context               - Passed to the callback.
+
+  Return Values:
+    USB_SUCCESS                 - The request has been queued
+    USB_UNKNOWN_DEVICE          - Device not found
+    USB_ILLEGAL_REQUEST         - A long request has no data buffer
+    USB_BUSY                    - The queue is full
+
+  Remarks:
+    This function is available only if USB_HOST_CONTROL_QUEUE_DEPTH is
+    defined in usb_config.h.  Requests are sent with
+    USBHostIssueDeviceRequest(), so the same rules apply to them.  If a
+    request cannot be sent, or the device is detached, its callback is
+    called with the error.  The completion of a queued request is not sent
+    to the client drivers as an event.
+  ***************************************************************************/
+
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+    BYTE USBHostQueueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType, BYTE bRequest,
+             WORD wValue, WORD wIndex, WORD wLength, BYTE *data, BYTE dataDirection,
+             USB_CONTROL_CALLBACK callback, void *context );
+#endif
+
+
 /****************************************************************************
   Function:
     BYTE USBHostRead( BYTE deviceAddress, BYTE endpoint, BYTE *pData,
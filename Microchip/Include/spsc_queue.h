@@ -0,0 +1,231 @@
+/* spsc_queue.h
+ *************************************************************************
+ * Filename:        spsc_queue.h
+ * Dependancies:    None
+ * Processor:       Any
+ * Hardware:        Any
+ * Assembler:       NA
+ * Linker:          Any
+ *************************************************************************
+ * File Description:
+ *
+ * This file defines primative operations and data structures that provide
+ * a single-producer/single-consumer ring for same-sized structs of data.
+ * One side of the program (for example, an ISR) only adds items, and the
+ * other side (for example, the main loop) only removes them.  The producer
+ * only writes the head index and the consumer only writes the tail index,
+ * so neither side has to disable interrupts.
+ *
+ * !!!! IMPORTANT:  The caller is responsible for copying the data. !!!!
+ *
+ * SPSCQueue Operations:
+ *
+ *      SPSCQueueInit       - Initializes a queue and makes it empty.
+ *      SPSCQueueHead       - Gets the free item the producer fills next.
+ *      SPSCQueueAdd        - Publishes the filled item to the consumer.
+ *      SPSCQueueOverflow   - Counts an item that did not fit.
+ *      SPSCQueuePeek       - Gets one of the items in the queue.
+ *      SPSCQueueRemove     - Removes one or more items from the queue.
+ *      SPSCQueueCount      - Provides the count of items in a queue.
+ *      SPSCQueueIsFull     - Checks to see if a queue is full.
+ *      SPSCQueueIsNotFull  - Checks to see if a queue is not full.
+ *      SPSCQueueIsEmpty    - Checks to see if a queue is empty.
+ *      SPSCQueueIsNotEmpty - Checks to see if a queue is not empty.
+ *
+ * Usage:
+ *
+ *      A queue structure must have the following members.  The number of
+ *      items must be a power of 2, and no more than 128.
+ *
+ *      head        - Count of items added (written by the producer only)
+ *      tail        - Count of items removed (written by the consumer only)
+ *      highWater   - Most items that have been in the queue at once
+ *      overflows   - Number of items that did not fit in the queue
+ *      buffer[]    - Array of queue items
+ *
+ *      Example:
+ *
+ *          #define SIZE_OF_MY_QUEUE    8
+ *
+ *          typedef struct _my_queue
+ *          {
+ *              volatile unsigned char  head;
+ *              volatile unsigned char  tail;
+ *              unsigned char           highWater;
+ *              unsigned long           overflows;
+ *              QUEUE_ITEM              buffer[SIZE_OF_MY_QUEUE];
+ *          } MY_QUEUE;
+ *
+ *      Example Producer Sequence:
+ *
+ *          QUEUE_ITEM *p_item;
+ *
+ *          if (SPSCQueueIsNotFull(&my_queue, SIZE_OF_MY_QUEUE))
+ *          {
+ *              p_item = SPSCQueueHead(&my_queue, SIZE_OF_MY_QUEUE);
+ *              p_item-><member1> = <value1>;
+ *              //...
+ *              SPSCQueueAdd(&my_queue);
+ *          }
+ *          else
+ *          {
+ *              SPSCQueueOverflow(&my_queue);
+ *          }
+ *
+ *      Example Consumer Sequence (removes all the queued items at once):
+ *
+ *          unsigned char count, i;
+ *
+ *          count = SPSCQueueCount(&my_queue);
+ *          for (i = 0; i < count; i++)
+ *          {
+ *              p_item = SPSCQueuePeek(&my_queue, SIZE_OF_MY_QUEUE, i);
+ *              //... Use the item
+ *          }
+ *          SPSCQueueRemove(&my_queue, count);
+ *
+ * Notes:
+ *
+ *      An item is not visible to the consumer until SPSCQueueAdd, and its
+ *      slot is not given back to the producer until SPSCQueueRemove, so
+ *      neither side can see a half-written item.
+ *
+ *      There must be only one producer and one consumer.  If more than one
+ *      part of the program adds items, those parts must be guarded against
+ *      each other.
+ *************************************************************************/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+
+// Keep the compiler from moving the item accesses across an index update.
+#if defined( __GNUC__ )
+    #define SPSC_QUEUE_BARRIER()    __asm__ __volatile__ ("" : : : "memory")
+#else
+    #define SPSC_QUEUE_BARRIER()
+#endif
+
+
+/* SPSCQueueInit
+ *************************************************************************
+ * Input:           q   Pointer to the queue data structure
+ *
+ * Overview:        This operation initializes a queue and makes it empty.
+ *                  It must not be used while the other side is running.
+ *************************************************************************/
+
+#define SPSCQueueInit(q)        ( (q)->head      = 0, \
+                                  (q)->tail      = 0, \
+                                  (q)->highWater = 0, \
+                                  (q)->overflows = 0  )
+
+
+/* SPSCQueueCount
+ *************************************************************************
+ * Input:           q   Pointer to the queue data structure
+ *
+ * Returns:         The number of items in the queue.
+ *************************************************************************/
+
+#define SPSCQueueCount(q)       ( (unsigned char)((q)->head - (q)->tail) )
+
+
+/* SPSCQueueIsFull, SPSCQueueIsNotFull, SPSCQueueIsEmpty, SPSCQueueIsNotEmpty
+ *************************************************************************
+ * Input:           q   Pointer to the queue data structure
+ *
+ *                  N   Number of elements in the queue data buffer array
+ *
+ * Overview:        These operations check the state of the queue.
+ *************************************************************************/
+
+#define SPSCQueueIsFull(q,N)    ( SPSCQueueCount(q) >= (N) )
+#define SPSCQueueIsNotFull(q,N) ( SPSCQueueCount(q) <  (N) )
+#define SPSCQueueIsEmpty(q)     ( (q)->head == (q)->tail )
+#define SPSCQueueIsNotEmpty(q)  ( (q)->head != (q)->tail )
+
+
+/* SPSCQueueHead
+ *************************************************************************
+ * Precondition:    The queue must not be full.  Producer only.
+ *
+ * Input:           q   Pointer to the queue data structure
+ *
+ *                  N   Number of elements in the queue data buffer array
+ *
+ * Returns:         The address of the item to fill.
+ *
+ * Overview:        The item is not in the queue until SPSCQueueAdd.
+ *************************************************************************/
+
+#define SPSCQueueHead(q,N)      ( &(q)->buffer[(q)->head & ((N)-1)] )
+
+
+/* SPSCQueueAdd
+ *************************************************************************
+ * Precondition:    The item from SPSCQueueHead has been filled.  Producer
+ *                  only.
+ *
+ * Input:           q   Pointer to the queue data structure
+ *
+ * Overview:        This operation publishes the item to the consumer, and
+ *                  updates the high-water mark.
+ *************************************************************************/
+
+#define SPSCQueueAdd(q)         {                                           \
+                                    SPSC_QUEUE_BARRIER();                   \
+                                    (q)->head++;                            \
+                                    if (SPSCQueueCount(q) > (q)->highWater) \
+                                    {                                       \
+                                        (q)->highWater = SPSCQueueCount(q); \
+                                    }                                       \
+                                }
+
+
+/* SPSCQueueOverflow
+ *************************************************************************
+ * Input:           q   Pointer to the queue data structure
+ *
+ * Overview:        This operation counts an item that was dropped because
+ *                  the queue was full.  Producer only.
+ *************************************************************************/
+
+#define SPSCQueueOverflow(q)    ( (q)->overflows++ )
+
+
+/* SPSCQueuePeek
+ *************************************************************************
+ * Precondition:    i must be less than SPSCQueueCount.  Consumer only.
+ *
+ * Input:           q   Pointer to the queue data structure
+ *
+ *                  N   Number of elements in the queue data buffer array
+ *
+ *                  i   Item to get, 0 for the oldest
+ *
+ * Returns:         The address of the item.
+ *************************************************************************/
+
+#define SPSCQueuePeek(q,N,i)    ( &(q)->buffer[(unsigned char)((q)->tail + (i)) & ((N)-1)] )
+
+
+/* SPSCQueueRemove
+ *************************************************************************
+ * Precondition:    The queue holds at least n items.  Consumer only.
+ *
+ * Input:           q   Pointer to the queue data structure
+ *
+ *                  n   Number of items to remove
+ *
+ * Overview:        This operation gives the oldest n items back to the
+ *                  producer.  The caller must be done with them.
+ *************************************************************************/
+
+#define SPSCQueueRemove(q,n)    {                                           \
+                                    SPSC_QUEUE_BARRIER();                   \
+                                    (q)->tail += (n);                       \
+                                }
+
+
+#endif // SPSC_QUEUE_H
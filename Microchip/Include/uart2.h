@@ -99,6 +99,30 @@ Note: none
 ********************************************************************/
 void UART2PutChar( char ch );
 
+/*********************************************************************
+Function: UART2TxFree(), UART2TxFlush(), UART2TxDropped(), UART2TxPeak()
+
+PreCondition: UART2Init must be called prior to calling these routines.
+
+Input: none
+
+Output: free space in the transmit ring buffer, number of characters
+        dropped because it was full, and its peak use
+
+Side Effects: UART2TxFlush() waits until all characters have been sent
+
+Overview: transmit ring buffer control and statistics
+
+Note: available only if UART2_TX_BUFFER_SIZE is defined in
+      HardwareProfile.h (PIC32 only)
+********************************************************************/
+#if defined (UART2_TX_BUFFER_SIZE) && defined (__PIC32MX__)
+unsigned int UART2TxFree( void );
+void UART2TxFlush( void );
+unsigned long UART2TxDropped( void );
+unsigned int UART2TxPeak( void );
+#endif
+
 /*********************************************************************
 Function: void UART2Init(void)
 
@@ -288,8 +288,8 @@ BOOL USBHostGenericEventHandler ( BYTE address, USB_EVENT event, void *data, DWO
     switch (event)
     {
 	case EVENT_DATA_ISOC_READ:
-        USB_HOST_APP_EVENT_HANDLER(gc_DevData.ID.deviceAddress, EVENT_DATA_ISOC_READ, data, size );
-		break;
+        // Pass the application's result through, so it can keep the buffer.
+        return USB_HOST_APP_EVENT_HANDLER(gc_DevData.ID.deviceAddress, EVENT_DATA_ISOC_READ, data, size );
     case EVENT_DETACH:
         // Notify that application that the device has been detached.
         USB_HOST_APP_EVENT_HANDLER(gc_DevData.ID.deviceAddress, EVENT_GENERIC_DETACH, &gc_DevData.ID.deviceAddress, sizeof(BYTE) );
@@ -218,19 +218,17 @@ typedef union _BDT_SETUP
 
     struct  // Setup Entry
     {
-        #if defined(__18CXX)
-        unsigned short BC_MSB:  2;
-        #else
-        unsigned short spare:   2;
-        #endif
+        // The bits that are also in the Status Entry are not named again,
+        // as a compiler may reject duplicate member names.
+        unsigned short       :  2;  // BC_MSB or spare
         unsigned short BSTALL:  1;  // Stalls EP if this descriptor needed
         unsigned short DTS:     1;  // Require data-toggle sync
         unsigned short NINC:    1;  // No Increment of DMA address
         unsigned short KEEP:    1;  // HW Keeps this buffer & descriptor
-        unsigned short DAT01:   1;  // Data-toggle number (0 or 1)
-        unsigned short UOWN:    1;  // Descriptor owner: 0=SW, 1=HW
+        unsigned short       :  1;  // DAT01, data-toggle number (0 or 1)
+        unsigned short       :  1;  // UOWN, descriptor owner: 0=SW, 1=HW
         #if !defined(__18CXX)
-        unsigned short resvd:   8;
+        unsigned short       :  8;  // resvd
         #endif
      };
 
@@ -275,7 +273,7 @@ typedef union _BYTECOUNT
     struct  // Byte-count field
     {
         unsigned short BC:      10; // Number of bytes in data buffer
-        unsigned short resvd:   6;
+        unsigned short       :  6;  // resvd
     };
     #endif
 
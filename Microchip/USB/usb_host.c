@@ -90,8 +90,31 @@ Change History:
 
 #define USB_FREE_AND_CLEAR(ptr) {USB_FREE(ptr); ptr = NULL;}
 
-#if defined( USB_ENABLE_TRANSFER_EVENT )
-    #include "struct_queue.h"
+// The descriptors of the attached device and the lists built from them all
+// live until the device is detached or reconfigured.  If USB_HOST_ARENA_SIZE
+// is defined, they are taken from a static arena that is released as a whole,
+// instead of from the heap.
+#if defined( USB_HOST_ARENA_SIZE )
+    #if (USB_HOST_ARENA_SIZE > 0xFFFC)
+        #error "USB_HOST_ARENA_SIZE must be less than 64K."
+    #endif
+
+    #define USB_DEVICE_MALLOC(size)         _USB_ArenaAlloc(size)
+    #define USB_DEVICE_FREE_AND_CLEAR(ptr)  {ptr = NULL;}
+    #define USB_ARENA_NO_MARK               0xFFFF
+#else
+    #define USB_DEVICE_MALLOC(size)         USB_MALLOC(size)
+    #define USB_DEVICE_FREE_AND_CLEAR(ptr)  USB_FREE_AND_CLEAR(ptr)
+#endif
+
+// The descriptor cache keeps the arena contents of the last device across
+// detach, so it needs the arena.
+#if defined( USB_HOST_DESCRIPTOR_CACHE ) && !defined( USB_HOST_ARENA_SIZE )
+    #error "USB_HOST_DESCRIPTOR_CACHE requires USB_HOST_ARENA_SIZE."
+#endif
+
+#if defined( USB_ENABLE_TRANSFER_EVENT ) || defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+    #include "spsc_queue.h"
 #endif
 
 // *****************************************************************************
@@ -124,6 +147,13 @@ Change History:
 // maximum value is 31.
 #define USB_TRANSACTION_RETRY_ATTEMPTS  20
 
+// The scheduler keeps the endpoints of the current interface settings in one
+// table, sorted by transfer type.  A configuration can have at most 30
+// endpoints besides EP 0.
+#ifndef USB_MAX_ACTIVE_ENDPOINTS
+    #define USB_MAX_ACTIVE_ENDPOINTS    30
+#endif
+
 //******************************************************************************
 //******************************************************************************
 // Section: Host Global Variables
@@ -185,10 +215,49 @@ static USB_DEVICE_INFO               usbDeviceInfo;
 #if defined( USB_ENABLE_TRANSFER_EVENT )
     static USB_EVENT_QUEUE           usbEventQueue;                              // Queue of USB events used to synchronize ISR to main tasks loop.
 #endif
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+    static USB_CONTROL_QUEUE         usbControlQueue;                            // Queue of EP0 requests sent by USBHostTasks().
+#endif
 static USB_ROOT_HUB_INFO             usbRootHubInfo;                             // Information about a specific port.
 
 static volatile WORD msec_count = 0;                                             // The current millisecond count.
 
+static USB_ENDPOINT_INFO            *activeEndpoints[USB_MAX_ACTIVE_ENDPOINTS];  // Endpoints of the current interface settings, sorted by transfer type.
+static BYTE                         activeEndpointsStart[5];                     // First entry of each transfer type in activeEndpoints.  [4] is the total count.
+static WORD                         usbFrameReserved[USB_SCHEDULE_FRAMES];       // Periodic bus time reserved in each frame of the schedule.
+
+#if defined( USB_HOST_COUNT_SCHEDULING )
+    static volatile WORD            usbSchedulingDecisions;                      // Endpoint searches made since the last SOF.
+    static volatile WORD            usbSchedulingDecisionsMax;                   // Most endpoint searches made during one frame.
+    static USB_FRAME_STATISTICS     usbFrameStatistics;                          // Bus time used by the frames.
+#endif
+
+#if defined( USB_SUPPORT_ISOCHRONOUS_TRANSFERS ) && (USB_PING_PONG_MODE == USB_PING_PONG__FULL_PING_PONG)
+    #define USB_ISOCHRONOUS_PREARM
+    static USB_ENDPOINT_INFO        *pIsochronousPrearmed;                       // Isochronous IN endpoint whose next BDT is already armed.
+    static BYTE                     *pIsochronousPrearmedBuffer;                 // Data buffer the armed BDT points to.
+#endif
+
+#if defined( USB_HOST_MEASURE_ISR_TIME ) && defined( __PIC32MX__ )
+    static volatile DWORD           usbISRMaxTime;                               // Longest _USB1Interrupt() run, in core timer counts.
+#endif
+
+#if defined( USB_HOST_ARENA_SIZE )
+    static DWORD                    usbArena[(USB_HOST_ARENA_SIZE + 3) / 4];     // Memory for the descriptors and lists of the attached device.
+    static WORD                     usbArenaUsed;                                // Bytes of the arena in use.
+    static WORD                     usbArenaPeak;                                // Most bytes of the arena that have been in use.
+    static WORD                     usbArenaConfigStart = USB_ARENA_NO_MARK;     // Bytes in use before the configuration was parsed, or USB_ARENA_NO_MARK.
+#endif
+
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+    static USB_DESCRIPTOR_CACHE     usbDescriptorCache;                          // Descriptors and interface list of the last device.
+#endif
+
+#if defined( USB_HOST_MEASURE_ENUMERATION_TIME ) && defined( __PIC32MX__ )
+    static DWORD                    usbAttachTime;                               // Core timer when the device was attached.
+    static DWORD                    usbEnumerationTime;                          // Core timer counts from attach until the device was configured.
+#endif
+
 // *****************************************************************************
 // *****************************************************************************
 // Section: Application Callable Functions
@@ -364,6 +433,290 @@ BYTE USBHostDeviceStatus( BYTE deviceAddress )
     return USB_DEVICE_ENUMERATING;
 }
 
+/****************************************************************************
+  Function:
+    DWORD USBHostGetMaxISRTime( BOOL reset )
+
+  Summary:
+    This function returns the longest time spent in the USB interrupt.
+
+  Description:
+    This function returns the longest time that _USB1Interrupt() has run
+    since the measurement was last reset.  This includes the data event
+    handlers that are called from the interrupt, so it shows how long
+    application processing holds off the USB interrupt.
+
+  Precondition:
+    None
+
+  Parameters:
+    BOOL reset  - Start a new measurement after reading the value
+
+  Returns:
+    Longest interrupt time, in core timer counts (half the system clock)
+
+  Remarks:
+    This function is available only if USB_HOST_MEASURE_ISR_TIME is defined
+    in usb_config.h.  PIC32 only.
+  ***************************************************************************/
+#if defined( USB_HOST_MEASURE_ISR_TIME ) && defined( __PIC32MX__ )
+
+DWORD USBHostGetMaxISRTime( BOOL reset )
+{
+    DWORD   maxTime;
+
+    maxTime = usbISRMaxTime;
+    if (reset)
+    {
+        usbISRMaxTime = 0;
+    }
+    return maxTime;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    DWORD USBHostGetEnumerationTime( DWORD *pAttachTime )
+
+  Summary:
+    This function returns how long the attached device took to enumerate.
+
+  Description:
+    This function returns the time from the attach of the device until it
+    was configured and its client drivers were initialized, and the core
+    timer value when the device was attached.  The application can use the
+    attach time to measure the time to its first result, such as the first
+    video frame.
+
+  Precondition:
+    None
+
+  Parameters:
+    DWORD *pAttachTime  - Core timer value when the device was attached
+
+  Returns:
+    Enumeration time, in core timer counts (half the system clock).  0 if
+    the device has not finished enumerating.
+
+  Remarks:
+    This function is available only if USB_HOST_MEASURE_ENUMERATION_TIME is
+    defined in usb_config.h.  PIC32 only.
+  ***************************************************************************/
+#if defined( USB_HOST_MEASURE_ENUMERATION_TIME ) && defined( __PIC32MX__ )
+
+DWORD USBHostGetEnumerationTime( DWORD *pAttachTime )
+{
+    *pAttachTime = usbAttachTime;
+    return usbEnumerationTime;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    WORD USBHostGetMaxSchedulingDecisions( BOOL reset )
+
+  Summary:
+    This function returns the most token scheduling decisions made in one
+    frame.
+
+  Description:
+    This function returns the largest number of times the scheduler searched
+    for an endpoint to service during one frame, since the count was last
+    reset.  It shows how much work the interrupt handler does to find the
+    next token.
+
+  Precondition:
+    None
+
+  Parameters:
+    BOOL reset  - Start a new count after reading the value
+
+  Returns:
+    Most endpoint searches made during one frame
+
+  Remarks:
+    This function is available only if USB_HOST_COUNT_SCHEDULING is defined
+    in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_COUNT_SCHEDULING )
+
+WORD USBHostGetMaxSchedulingDecisions( BOOL reset )
+{
+    WORD    maxDecisions;
+
+    maxDecisions = usbSchedulingDecisionsMax;
+    if (reset)
+    {
+        usbSchedulingDecisionsMax = 0;
+    }
+    return maxDecisions;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    void USBHostGetFrameStatistics( USB_FRAME_STATISTICS *pStatistics,
+                BOOL reset )
+
+  Summary:
+    This function returns how much bus time the frames have used.
+
+  Description:
+    This function copies the bus time statistics of the frame scheduler.
+    The time of a frame includes the periodic bus time reserved for it, and
+    the control and bulk transactions sent in the rest of the frame.
+
+  Precondition:
+    None
+
+  Parameters:
+    USB_FRAME_STATISTICS *pStatistics   - Where to copy the statistics
+    BOOL reset                          - Start new counts after reading them
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_COUNT_SCHEDULING is defined
+    in usb_config.h.  wReservedPeak is not reset; it changes only when the
+    interface settings change.
+  ***************************************************************************/
+#if defined( USB_HOST_COUNT_SCHEDULING )
+
+void USBHostGetFrameStatistics( USB_FRAME_STATISTICS *pStatistics, BOOL reset )
+{
+    #if defined( __C30__ ) || defined __XC16__
+        WORD        interrupt_mask;
+    #elif defined( __PIC32MX__ )
+        UINT32      interrupt_mask;
+    #else
+        #error Cannot save interrupt status
+    #endif
+
+    // Guard against USB interrupts
+    interrupt_mask = U1IE;
+    U1IE = 0;
+
+    *pStatistics = usbFrameStatistics;
+    if (reset)
+    {
+        usbFrameStatistics.wUsedPeak   = 0;
+        usbFrameStatistics.dwUsedTotal = 0;
+        usbFrameStatistics.dwFrames    = 0;
+    }
+
+    // Re-enable USB interrupts
+    U1IE = interrupt_mask;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    void USBHostGetEventQueueStatus( BYTE *pHighWater, DWORD *pOverflows )
+
+  Summary:
+    This function returns how full the USB event queue has been.
+
+  Description:
+    This function returns the most events that have been waiting in the
+    event queue at once, and the number of events that were lost because
+    the queue was full.  Increase USB_EVENT_QUEUE_DEPTH if events are lost.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *pHighWater    - Most events queued at once
+    DWORD *pOverflows   - Events lost because the queue was full
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_ENABLE_TRANSFER_EVENT is defined
+    in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_ENABLE_TRANSFER_EVENT )
+
+void USBHostGetEventQueueStatus( BYTE *pHighWater, DWORD *pOverflows )
+{
+    *pHighWater = usbEventQueue.highWater;
+    *pOverflows = usbEventQueue.overflows;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    void USBHostGetArenaStatus( WORD *pUsed, WORD *pPeak )
+
+  Summary:
+    This function returns how much of the device memory arena is in use.
+
+  Description:
+    This function returns the number of bytes of the arena that hold the
+    descriptors and lists of the attached device, and the most bytes that
+    have been in use since the stack was started.  Set USB_HOST_ARENA_SIZE
+    a little above the peak of the devices that will be attached.
+
+  Precondition:
+    None
+
+  Parameters:
+    WORD *pUsed - Bytes in use now
+    WORD *pPeak - Most bytes that have been in use
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_ARENA_SIZE is defined in
+    usb_config.h.  The peak includes a request that did not fit, so a peak
+    above USB_HOST_ARENA_SIZE shows that the arena is too small.
+  ***************************************************************************/
+#if defined( USB_HOST_ARENA_SIZE )
+
+void USBHostGetArenaStatus( WORD *pUsed, WORD *pPeak )
+{
+    *pUsed = usbArenaUsed;
+    *pPeak = usbArenaPeak;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    BOOL USBHostDescriptorCacheUsed( void )
+
+  Summary:
+    This function tells if the attached device was configured from the
+    descriptor cache.
+
+  Description:
+    This function returns TRUE if the attached device is the one that was
+    configured last, and its configuration descriptors were checked against
+    the cache instead of being read and parsed again.
+
+  Precondition:
+    None
+
+  Parameters:
+    None
+
+  Return Values:
+    TRUE    - The device was configured from the cache
+    FALSE   - The descriptors were read from the device
+
+  Remarks:
+    This function is available only if USB_HOST_DESCRIPTOR_CACHE is defined
+    in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+
+BOOL USBHostDescriptorCacheUsed( void )
+{
+    return usbDescriptorCache.flags.bfUsed;
+}
+#endif
+
 /****************************************************************************
   Function:
     BOOL USBHostInit(  unsigned long flags  )
@@ -423,7 +776,14 @@ BOOL USBHostInit(  unsigned long flags  )
 
     // Initialize event queue
     #if defined( USB_ENABLE_TRANSFER_EVENT )
-        StructQueueInit(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+        SPSCQueueInit(&usbEventQueue);
+    #endif
+
+    // Initialize control request queue
+    #if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+        SPSCQueueInit(&usbControlQueue);
+        usbControlQueue.bfIssued    = 0;
+        usbControlQueue.bfServicing = 0;
     #endif
 
     return TRUE;
@@ -449,11 +809,17 @@ BOOL USBHostInit(  unsigned long flags  )
   Return Values:
     TRUE    - All buffers are allocated successfully.
     FALSE   - Not enough heap space to allocate all buffers - adjust the 
-                project to provide more heap space.
+                project to provide more heap space.  Also returned if
+                numberOfBuffers is more than USB_MAX_ISOCHRONOUS_DATA_BUFFERS.
 
   Remarks:
     This function is available only if USB_SUPPORT_ISOCHRONOUS_TRANSFERS
     is defined in usb_config.h.
+
+    The number of buffers is the depth of the ring between the USB
+    peripheral and the user.  It must cover the longest time the user may
+    take to release a buffer, at one buffer per interval.  Packets that
+    arrive while the ring is full are counted in overrunCount.
 ***************************************************************************/
 #ifdef USB_SUPPORT_ISOCHRONOUS_TRANSFERS
 
@@ -462,6 +828,11 @@ BOOL USBHostIsochronousBuffersCreate( ISOCHRONOUS_DATA * isocData, BYTE numberOf
     BYTE i;
     BYTE j;
 
+    if (numberOfBuffers > USB_MAX_ISOCHRONOUS_DATA_BUFFERS)
+    {
+        return FALSE;
+    }
+
     USBHostIsochronousBuffersReset( isocData, numberOfBuffers );
     for (i=0; i<numberOfBuffers; i++)
     {
@@ -531,8 +902,11 @@ void USBHostIsochronousBuffersDestroy( ISOCHRONOUS_DATA * isocData, BYTE numberO
     void USBHostIsochronousBuffersReset( ISOCHRONOUS_DATA * isocData, BYTE numberOfBuffers )
     
   Description:
-    This function resets all the isochronous data buffers.  It does not do 
-    anything with the space allocated for the buffers.
+    This function resets all the isochronous data buffers and their
+    counters.  It does not do anything with the space allocated for the
+    buffers.  The delivery mode is set to USB_ISOC_DELIVERY_ISR if
+    USB_HOST_APP_DATA_EVENT_HANDLER is defined, or USB_ISOC_DELIVERY_QUEUED
+    otherwise.  The application may change it before starting the transfer.
 
   Precondition:
     None
@@ -563,6 +937,15 @@ void USBHostIsochronousBuffersReset( ISOCHRONOUS_DATA * isocData, BYTE numberOfB
     isocData->currentBufferUser    = 0;
     isocData->currentBufferUSB     = 0;
     isocData->pDataUser            = NULL;
+    isocData->overrunCount         = 0;
+    isocData->packetCount          = 0;
+    isocData->deliveredCount       = 0;
+    isocData->lostEventCount       = 0;
+    #ifdef USB_HOST_APP_DATA_EVENT_HANDLER
+        isocData->deliveryMode     = USB_ISOC_DELIVERY_ISR;
+    #else
+        isocData->deliveryMode     = USB_ISOC_DELIVERY_QUEUED;
+    #endif
 }
 #endif
 
@@ -617,6 +1000,8 @@ void USBHostIsochronousBuffersReset( ISOCHRONOUS_DATA * isocData, BYTE numberOfB
     USB_ENDPOINT_BUSY           - A read or write is already in progress
     USB_ILLEGAL_REQUEST         - SET CONFIGURATION cannot be performed with
                                     this function.
+    USB_ERROR_INSUFFICIENT_BANDWIDTH - SET INTERFACE selects a setting whose
+                                    periodic endpoints do not fit in a frame
 
   Remarks:
     DTS reset is done before the command is issued.
@@ -718,8 +1103,15 @@ BYTE USBHostIssueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType, BYTE bRe
             return USB_ILLEGAL_REQUEST;
         }
 
+        // Reserve bus time for the periodic endpoints of the new setting.
+        if (!_USB_ScheduleBandwidth( pInterface, pSetting ))
+        {
+            return USB_ERROR_INSUFFICIENT_BANDWIDTH;
+        }
+
         // Set the pointer to the new setting.
         pInterface->pCurrentSetting = pSetting;
+        _USB_BuildActiveEndpointLists();
     }
             UART2PrintString( "USB_ILLEGAL_REQUEST4\r\n" );
 
@@ -765,6 +1157,121 @@ BYTE USBHostIssueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType, BYTE bRe
     return USB_SUCCESS;
 }
 
+/****************************************************************************
+  Function:
+    BYTE USBHostQueueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType,
+                    BYTE bRequest, WORD wValue, WORD wIndex, WORD wLength,
+                    BYTE *data, BYTE dataDirection,
+                    USB_CONTROL_CALLBACK callback, void *context )
+
+  Summary:
+    This function adds a device request to the queue of EP0 requests.
+
+  Description:
+    This function adds a device request to the queue of EP0 requests.
+    USBHostTasks() sends the queued requests one after another, as soon as
+    EP0 is free, and calls the callback of each one when it completes.  If
+    EP0 is free now, the request is sent before this function returns.
+
+    If wLength is no more than USB_HOST_CONTROL_DATA_SIZE, the data is kept
+    in the queue.  The data of a SET request is copied when it is queued, and
+    the data of a GET request is copied to data (if it is not NULL) before
+    the callback is called.  Longer requests use the buffer at data, which
+    must be kept until the callback is called.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE deviceAddress          - Device address
+    BYTE bmRequestType          - The request type as defined by the USB
+                                    specification.
+    BYTE bRequest               - The request as defined by the USB
+                                    specification.
+    WORD wValue                 - The value for the request as defined by
+                                    the USB specification.
+    WORD wIndex                 - The index for the request as defined by
+                                    the USB specification.
+    WORD wLength                - The data length for the request as
+                                    defined by the USB specification.
+    BYTE *data                  - Pointer to the data for the request.
+    BYTE dataDirection          - USB_DEVICE_REQUEST_SET or
+                                    USB_DEVICE_REQUEST_GET
+    USB_CONTROL_CALLBACK callback - Function to call when the request
+                                    completes, or NULL.
+    void *context               - Passed to the callback.
+
+  Return Values:
+    USB_SUCCESS                 - The request has been queued
+    USB_UNKNOWN_DEVICE          - Device not found
+    USB_INVALID_STATE           - No device is attached
+    USB_ILLEGAL_REQUEST         - A long request has no data buffer
+    USB_BUSY                    - The queue is full
+
+  Remarks:
+    This function is available only if USB_HOST_CONTROL_QUEUE_DEPTH is
+    defined in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+
+BYTE USBHostQueueDeviceRequest( BYTE deviceAddress, BYTE bmRequestType, BYTE bRequest,
+            WORD wValue, WORD wIndex, WORD wLength, BYTE *data, BYTE dataDirection,
+            USB_CONTROL_CALLBACK callback, void *context )
+{
+    USB_CONTROL_REQUEST *request;
+
+    // Find the required device
+    if (deviceAddress != usbDeviceInfo.deviceAddress)
+    {
+        return USB_UNKNOWN_DEVICE;
+    }
+
+    // The address of a detached device is not cleared until the next one is
+    // enumerated, so a request queued now would go to the next device.
+    if ((usbHostState & STATE_MASK) == STATE_DETACHED)
+    {
+        return USB_INVALID_STATE;
+    }
+
+    if ((wLength > USB_HOST_CONTROL_DATA_SIZE) && (data == NULL))
+    {
+        return USB_ILLEGAL_REQUEST;
+    }
+
+    if (SPSCQueueIsFull(&usbControlQueue, USB_HOST_CONTROL_QUEUE_DEPTH))
+    {
+        SPSCQueueOverflow(&usbControlQueue);
+        return USB_BUSY;
+    }
+
+    request = SPSCQueueHead(&usbControlQueue, USB_HOST_CONTROL_QUEUE_DEPTH);
+    request->deviceAddress  = deviceAddress;
+    request->bmRequestType  = bmRequestType;
+    request->bRequest       = bRequest;
+    request->dataDirection  = dataDirection;
+    request->wValue         = wValue;
+    request->wIndex         = wIndex;
+    request->wLength        = wLength;
+    request->pUserData      = data;
+    request->callback       = callback;
+    request->context        = context;
+    if ((wLength <= USB_HOST_CONTROL_DATA_SIZE) && (dataDirection == USB_DEVICE_REQUEST_SET) && (data != NULL))
+    {
+        memcpy( request->data, data, wLength );
+    }
+    SPSCQueueAdd(&usbControlQueue);
+
+    // Send it now if EP0 is free.  If this is called from a callback, the
+    // queue is already being serviced.
+    if (!usbControlQueue.bfServicing)
+    {
+        _USB_ServiceControlQueue();
+    }
+
+    return USB_SUCCESS;
+}
+#endif
+
 /****************************************************************************
   Function:
     BYTE USBHostRead( BYTE deviceAddress, BYTE endpoint, BYTE *pData,
@@ -1306,40 +1813,46 @@ void USBHostTasks( void )
     #if defined ( USB_ENABLE_TRANSFER_EVENT )
     {
         USB_EVENT_DATA *item;
-        #if defined( __C30__ ) || defined __XC16__
-            WORD        interrupt_mask;
-        #elif defined( __PIC32MX__ )
-            UINT32      interrupt_mask;
-        #else
-            #error Cannot save interrupt status
-        #endif
-
-        while (StructQueueIsNotEmpty(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+        BYTE            count;
+        BYTE            i;
+
+        // Take every event queued so far, and give their slots back to the
+        // ISR together.  The ISR only writes the head of the queue, so USB
+        // interrupts do not have to be disabled.
+        count = SPSCQueueCount(&usbEventQueue);
+        for (i = 0; i < count; i++)
         {
-            item = StructQueuePeekTail(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+            item = SPSCQueuePeek(&usbEventQueue, USB_EVENT_QUEUE_DEPTH, i);
 
             switch(item->event)
             {
                 case EVENT_TRANSFER:
+                    #if defined( USB_ENABLE_ISOC_TRANSFER_EVENT ) && defined( USB_HOST_APP_DATA_EVENT_HANDLER )
+                        // Queued isochronous packets go only to the data
+                        // event handler.
+                        if (item->TransferData.bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS)
+                        {
+                            _USB_DeliverIsochronousData( &item->TransferData );
+                            break;
+                        }
+                    #endif
+                    // Fall through
                 case EVENT_BUS_ERROR:
                     _USB_NotifyClients( usbDeviceInfo.deviceAddress, item->event, &item->TransferData, sizeof(HOST_TRANSFER_DATA) );
                     break;
                 default:
                     break;
             }
-
-            // Guard against USB interrupts
-            interrupt_mask = U1IE;
-            U1IE = 0;
-
-            item = StructQueueRemove(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
-
-            // Re-enable USB interrupts
-            U1IE = interrupt_mask;
         }
+        SPSCQueueRemove(&usbEventQueue, count);
     }
     #endif
 
+    // Complete the queued EP0 request, and send the next one.
+    #if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+        _USB_ServiceControlQueue();
+    #endif
+
     // See if we got an interrupt to change our state.
     if (usbOverrideHostState != NO_STATE)
     {
@@ -1379,6 +1892,7 @@ void USBHostTasks( void )
                     usbDeviceInfo.pEndpoint0->transferState                = TSTATE_IDLE;
                     usbDeviceInfo.pEndpoint0->bmAttributes.bfTransferType  = USB_TRANSFER_TYPE_CONTROL;
                     usbDeviceInfo.pEndpoint0->clientDriver                 = CLIENT_DRIVER_HOST;
+                    usbDeviceInfo.pEndpoint0->bSchedulePeriod              = 0;
 
                     // Initialize any device specific information.
                     numEnumerationTries                 = USB_NUM_ENUMERATION_TRIES;
@@ -1388,6 +1902,10 @@ void USBHostTasks( void )
                     usbDeviceInfo.flags.val             = 0;
                     usbDeviceInfo.pInterfaceList        = NULL;
                     usbBusInfo.flags.val                = 0;
+                    _USB_BuildActiveEndpointLists();
+                    #if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+                        _USB_FlushControlQueue();
+                    #endif
                     
                     // Set up the hardware.
                     U1IE                = 0;        // Clear and turn off interrupts.
@@ -1518,6 +2036,11 @@ void USBHostTasks( void )
                             U1IR                    = USB_INTERRUPT_DETACH;   // The interrupt is cleared by writing a '1' to the flag.
                             U1IEbits.DETACHIE       = 1;
 
+                            #if defined( USB_HOST_MEASURE_ENUMERATION_TIME ) && defined( __PIC32MX__ )
+                                usbAttachTime       = ReadCoreTimer();
+                                usbEnumerationTime  = 0;
+                            #endif
+
                             // Configure and turn on the settling timer - 100ms.
                             numTimerInterrupts      = USB_INSERT_TIME;
                             U1OTGIR                 = USB_INTERRUPT_T1MSECIF; // The interrupt is cleared by writing a '1' to the flag.
@@ -1546,14 +2069,20 @@ void USBHostTasks( void )
                         case SUBSUBSTATE_SET_RESET:
                             DEBUG_PutString( "HOST: Resetting the device.\r\n" );
 
+                            #if defined( USB_HOST_ARENA_SIZE )
+                                // Everything in the arena belongs to the previous
+                                // enumeration, so start the arena over.
+                                _USB_FreeMemory();
+                            #endif
+
                             // Prepare a data buffer for us to use.  We'll make it 8 bytes for now,
                             // which is the minimum wMaxPacketSize for EP0.
                             if (pEP0Data != NULL)
                             {
-                                USB_FREE_AND_CLEAR( pEP0Data );
+                                USB_DEVICE_FREE_AND_CLEAR( pEP0Data );
                             }
 
-                            if ((pEP0Data = (BYTE *)USB_MALLOC( 8 )) == NULL)
+                            if ((pEP0Data = (BYTE *)USB_DEVICE_MALLOC( 8 )) == NULL)
                             {
                                 DEBUG_PutString( "HOST: Error alloc-ing pEP0Data\r\n" );
 
@@ -1603,6 +2132,9 @@ void USBHostTasks( void )
                             U1CONbits.PPBRST                    = 0;
                             usbDeviceInfo.flags.bfPingPongIn    = 0;
                             usbDeviceInfo.flags.bfPingPongOut   = 0;
+                            #ifdef USB_ISOCHRONOUS_PREARM
+                                pIsochronousPrearmed            = NULL;
+                            #endif
 
                             #ifdef  USB_SUPPORT_OTG
                                 //Disable HNP
@@ -1674,7 +2206,7 @@ void USBHostTasks( void )
                             // Set up and send GET DEVICE DESCRIPTOR
                             if (pDeviceDescriptor != NULL)
                             {
-                                USB_FREE_AND_CLEAR( pDeviceDescriptor );
+                                USB_DEVICE_FREE_AND_CLEAR( pDeviceDescriptor );
                             }
 
                             pEP0Data[0] = USB_SETUP_DEVICE_TO_HOST | USB_SETUP_TYPE_STANDARD | USB_SETUP_RECIPIENT_DEVICE;
@@ -1722,7 +2254,7 @@ void USBHostTasks( void )
 
                         case SUBSUBSTATE_GET_DEVICE_DESCRIPTOR_SIZE_COMPLETE:
                             // Allocate a buffer for the entire Device Descriptor
-                            if ((pDeviceDescriptor = (BYTE *)USB_MALLOC( *pEP0Data )) == NULL)
+                            if ((pDeviceDescriptor = (BYTE *)USB_DEVICE_MALLOC( *pEP0Data )) == NULL)
                             {
                                 // We cannot continue.  Freeze until the device is removed.
                                 _USB_SetErrorCode( USB_HOLDING_OUT_OF_MEMORY );
@@ -1736,8 +2268,8 @@ void USBHostTasks( void )
                             usbDeviceInfo.pEndpoint0->wMaxPacketSize = ((USB_DEVICE_DESCRIPTOR *)pEP0Data)->bMaxPacketSize0;
 
                             // Make our pEP0Data buffer the size of the max packet.
-                            USB_FREE_AND_CLEAR( pEP0Data );
-                            if ((pEP0Data = (BYTE *)USB_MALLOC( usbDeviceInfo.pEndpoint0->wMaxPacketSize )) == NULL)
+                            USB_DEVICE_FREE_AND_CLEAR( pEP0Data );
+                            if ((pEP0Data = (BYTE *)USB_DEVICE_MALLOC( usbDeviceInfo.pEndpoint0->wMaxPacketSize )) == NULL)
                             {
                                 // We cannot continue.  Freeze until the device is removed.
                                 DEBUG_PutString( "HOST: Error re-alloc-ing pEP0Data\r\n" );
@@ -1901,10 +2433,34 @@ void USBHostTasks( void )
                     while (usbDeviceInfo.pConfigurationDescriptorList != NULL)
                     {
                         pTemp = (BYTE *)usbDeviceInfo.pConfigurationDescriptorList->next;
-                        USB_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList->descriptor );
-                        USB_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList );
+                        USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList->descriptor );
+                        USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList );
                         usbDeviceInfo.pConfigurationDescriptorList = (USB_CONFIGURATION *)pTemp;
                     }
+
+                    #if defined( USB_HOST_DESCRIPTOR_CACHE )
+                        // If this is the device in the cache, its configuration
+                        // descriptors only need to be checked.
+                        if (usbDescriptorCache.flags.bfValid)
+                        {
+                            if ((((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->idVendor           == usbDescriptorCache.idVendor)  &&
+                                (((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->idProduct          == usbDescriptorCache.idProduct) &&
+                                (((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->bcdDevice          == usbDescriptorCache.bcdDevice) &&
+                                (((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->bNumConfigurations == usbDescriptorCache.bNumConfigurations))
+                            {
+                                DEBUG_PutString( "HOST: Device is in the descriptor cache.\r\n" );
+                                usbDescriptorCache.flags.bfChecking = 1;
+                            }
+                            else
+                            {
+                                // This is a different device.  Drop the cache and
+                                // enumerate again, so it can use the whole arena.
+                                usbDescriptorCache.flags.bfValid = 0;
+                                usbHostState = STATE_ATTACHED | SUBSTATE_RESET_DEVICE;
+                                break;
+                            }
+                        }
+                    #endif
                     _USB_SetNextSubState();
                     break;
 
@@ -1946,8 +2502,43 @@ void USBHostTasks( void )
                             break;
 
                         case SUBSUBSTATE_GET_CONFIG_DESCRIPTOR_SIZECOMPLETE:
+                            #if defined( USB_HOST_DESCRIPTOR_CACHE )
+                                if (usbDescriptorCache.flags.bfChecking)
+                                {
+                                    // Find the cached copy of this descriptor.
+                                    pTemp = (BYTE *)usbDescriptorCache.pConfigurationDescriptorList;
+                                    while ((pTemp != NULL) && (((USB_CONFIGURATION *)pTemp)->configNumber != countConfigurations))
+                                    {
+                                        pTemp = (BYTE *)((USB_CONFIGURATION *)pTemp)->next;
+                                    }
+
+                                    // If the bytes just read match it, and it is intact, use
+                                    // it instead of reading the whole descriptor.
+                                    if ((pTemp != NULL) &&
+                                        (memcmp( ((USB_CONFIGURATION *)pTemp)->descriptor, pEP0Data, 8 ) == 0) &&
+                                        (_USB_DescriptorHash( ((USB_CONFIGURATION *)pTemp)->descriptor,
+                                            ((USB_CONFIGURATION_DESCRIPTOR *)((USB_CONFIGURATION *)pTemp)->descriptor)->wTotalLength ) == ((USB_CONFIGURATION *)pTemp)->dwHash))
+                                    {
+                                        ((USB_CONFIGURATION *)pTemp)->next          = usbDeviceInfo.pConfigurationDescriptorList;
+                                        usbDeviceInfo.pConfigurationDescriptorList  = (USB_CONFIGURATION *)pTemp;
+                                        pCurrentConfigurationDescriptor             = ((USB_CONFIGURATION *)pTemp)->descriptor;
+
+                                        _USB_InitErrorCounters();
+                                        usbHostState = STATE_CONFIGURING | SUBSTATE_GET_CONFIG_DESCRIPTOR | SUBSUBSTATE_GET_CONFIG_DESCRIPTOR_COMPLETE;
+                                        break;
+                                    }
+
+                                    // The device has changed.  Drop the cache and enumerate again.
+                                    DEBUG_PutString( "HOST: Descriptor cache does not match.\r\n" );
+                                    usbDescriptorCache.flags.bfValid    = 0;
+                                    usbDescriptorCache.flags.bfChecking = 0;
+                                    usbHostState = STATE_ATTACHED | SUBSTATE_RESET_DEVICE;
+                                    break;
+                                }
+                            #endif
+
                             // Allocate a buffer for an entry in the configuration descriptor list.
-                            if ((pTemp = (BYTE *)USB_MALLOC( sizeof (USB_CONFIGURATION) )) == NULL)
+                            if ((pTemp = (BYTE *)USB_DEVICE_MALLOC( sizeof (USB_CONFIGURATION) )) == NULL)
                             {
                                 // We cannot continue.  Freeze until the device is removed.
                                 _USB_SetErrorCode( USB_HOLDING_OUT_OF_MEMORY );
@@ -1956,10 +2547,10 @@ void USBHostTasks( void )
                             }
 
                             // Allocate a buffer for the entire Configuration Descriptor
-                            if ((((USB_CONFIGURATION *)pTemp)->descriptor = (BYTE *)USB_MALLOC( ((WORD)pEP0Data[3] << 8) + (WORD)pEP0Data[2] )) == NULL)
+                            if ((((USB_CONFIGURATION *)pTemp)->descriptor = (BYTE *)USB_DEVICE_MALLOC( ((WORD)pEP0Data[3] << 8) + (WORD)pEP0Data[2] )) == NULL)
                             {
                                 // Not enough memory for the descriptor!
-                                USB_FREE_AND_CLEAR( pTemp );
+                                USB_DEVICE_FREE_AND_CLEAR( pTemp );
 
                                 // We cannot continue.  Freeze until the device is removed.
                                 _USB_SetErrorCode( USB_HOLDING_OUT_OF_MEMORY );
@@ -2028,6 +2619,16 @@ void USBHostTasks( void )
                             break;
 
                         case SUBSUBSTATE_GET_CONFIG_DESCRIPTOR_COMPLETE:
+                            #if defined( USB_HOST_DESCRIPTOR_CACHE )
+                                // Remember the hash of a descriptor read from the device, so a
+                                // cached copy of it can be checked later.
+                                if (!usbDescriptorCache.flags.bfChecking)
+                                {
+                                    usbDeviceInfo.pConfigurationDescriptorList->dwHash = _USB_DescriptorHash( usbDeviceInfo.pConfigurationDescriptorList->descriptor,
+                                            ((USB_CONFIGURATION_DESCRIPTOR *)usbDeviceInfo.pConfigurationDescriptorList->descriptor)->wTotalLength );
+                                }
+                            #endif
+
                             // Clean up and advance to the next state.  Keep the data for later use.
                             _USB_InitErrorCounters();
                             countConfigurations --;
@@ -2056,6 +2657,26 @@ void USBHostTasks( void )
                             // Free the old configuration (if any)
                             _USB_FreeConfigMemory();
 
+                            #if defined( USB_HOST_DESCRIPTOR_CACHE )
+                            if (!usbDescriptorCache.flags.bfValid)
+                            {
+                                usbDescriptorCache.requestedConfiguration = usbDeviceInfo.currentConfiguration;
+                            }
+
+                            if (usbDescriptorCache.flags.bfChecking &&
+                                (usbDeviceInfo.currentConfiguration == usbDescriptorCache.requestedConfiguration))
+                            {
+                                // Every descriptor matched the cache, so the interface list
+                                // that was parsed last time can be used again.
+                                pCurrentConfigurationNode       = usbDescriptorCache.pConfigurationNode;
+                                pCurrentConfigurationDescriptor = pCurrentConfigurationNode->descriptor;
+                                if (!_USB_UseCachedConfiguration())
+                                {
+                                    pCurrentConfigurationNode = NULL;
+                                }
+                            }
+                            else
+                            #endif
                             // If the configuration wasn't selected based on the VID & PID
                             if (usbDeviceInfo.currentConfiguration == 0)
                             {
@@ -2094,6 +2715,29 @@ void USBHostTasks( void )
                                 }
                             }
 
+                            #if defined( USB_HOST_DESCRIPTOR_CACHE )
+                                // Keep the descriptors and the interface list of a newly
+                                // configured device for the next time it is attached.
+                                // Devices that support OTG are not cached.
+                                if (!usbDescriptorCache.flags.bfValid && (pCurrentConfigurationNode != NULL) &&
+                                    !usbDeviceInfo.flags.bfSupportsOTG)
+                                {
+                                    usbDescriptorCache.idVendor                     = ((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->idVendor;
+                                    usbDescriptorCache.idProduct                    = ((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->idProduct;
+                                    usbDescriptorCache.bcdDevice                    = ((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->bcdDevice;
+                                    usbDescriptorCache.bNumConfigurations           = ((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->bNumConfigurations;
+                                    usbDescriptorCache.pConfigurationDescriptorList = usbDeviceInfo.pConfigurationDescriptorList;
+                                    usbDescriptorCache.pConfigurationNode           = pCurrentConfigurationNode;
+                                    usbDescriptorCache.pInterfaceList               = usbDeviceInfo.pInterfaceList;
+                                    usbDescriptorCache.arenaEnd                     = usbArenaUsed;
+                                    usbDescriptorCache.flags.bfValid                = 1;
+
+                                    // The cached lists must stay in the arena if the
+                                    // device is configured again.
+                                    usbArenaConfigStart = USB_ARENA_NO_MARK;
+                                }
+                            #endif
+
                             //If No OTG Then
                             if (usbDeviceInfo.flags.bfConfiguredOTG)
                             {
@@ -2256,6 +2900,10 @@ void USBHostTasks( void )
                         case SUBSUBSTATE_INIT_CLIENT_DRIVERS:
                             DEBUG_PutString( "HOST: Initializing client drivers...\r\n" );
 
+                            #if defined( USB_HOST_MEASURE_ENUMERATION_TIME ) && defined( __PIC32MX__ )
+                                usbEnumerationTime = ReadCoreTimer() - usbAttachTime;
+                            #endif
+
                             _USB_SetNextState();
                             // Initialize client driver(s) for this configuration.
                             if (usbDeviceInfo.flags.bfUseDeviceClientDriver)
@@ -2761,6 +3409,146 @@ BYTE USBHostWrite( BYTE deviceAddress, BYTE endpoint, BYTE *data, DWORD size )
 // *****************************************************************************
 // *****************************************************************************
 
+/****************************************************************************
+  Function:
+    void * _USB_ArenaAlloc( WORD size )
+
+  Description:
+    This function takes a block of memory for the attached device from the
+    arena.  Blocks are taken in order and are never freed one at a time.
+    _USB_FreeMemory() releases the whole arena, and _USB_FreeConfigMemory()
+    releases the blocks taken while parsing the configuration.
+
+  Precondition:
+    None
+
+  Parameters:
+    WORD size   - Number of bytes needed
+
+  Return Values:
+    Pointer to the block, aligned to 4 bytes.
+    NULL    - There is not enough room left in the arena.
+
+  Remarks:
+    This function is available only if USB_HOST_ARENA_SIZE is defined in
+    usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_ARENA_SIZE )
+
+void * _USB_ArenaAlloc( WORD size )
+{
+    BYTE    *pBlock;
+    DWORD   end;
+
+    end = ((DWORD)usbArenaUsed + size + 3) & ~3ul;
+    if (end > usbArenaPeak)
+    {
+        usbArenaPeak = (end > 0xFFFF) ? 0xFFFF : (WORD)end;
+    }
+    if (end > sizeof(usbArena))
+    {
+        DEBUG_PutString( "HOST: Arena is full.\r\n" );
+        return NULL;
+    }
+
+    pBlock       = (BYTE *)usbArena + usbArenaUsed;
+    usbArenaUsed = (WORD)end;
+    return pBlock;
+}
+#endif
+
+/****************************************************************************
+  Function:
+    void _USB_BuildActiveEndpointLists( void )
+
+  Description:
+    This function rebuilds the table of active endpoints that the scheduler
+    uses.  It holds the endpoints of the current setting of every interface,
+    sorted by transfer type, so _USB_FindServiceEndpoint() and the SOF
+    handler only look at endpoints of the type they need, without walking
+    the interface and endpoint lists.
+
+  Precondition:
+    None
+
+  Parameters:
+    None
+
+  Returns:
+    None
+
+  Remarks:
+    This function must be called whenever usbDeviceInfo.pInterfaceList or
+    the current setting of an interface changes.  The table is replaced with
+    USB interrupts disabled.  If there are more than USB_MAX_ACTIVE_ENDPOINTS
+    endpoints, the extra endpoints are not serviced.
+  ***************************************************************************/
+
+void _USB_BuildActiveEndpointLists( void )
+{
+    USB_ENDPOINT_INFO       *pEndpoint;
+    USB_INTERFACE_INFO      *pInterface;
+    BYTE                    count[4];
+    BYTE                    start[5];
+    BYTE                    i;
+    #if defined( __C30__ ) || defined __XC16__
+        WORD                interrupt_mask;
+    #elif defined( __PIC32MX__ )
+        UINT32              interrupt_mask;
+    #else
+        #error Cannot save interrupt status
+    #endif
+
+    // Count the endpoints of each transfer type.
+    memset( count, 0, sizeof(count) );
+    for (pInterface = usbDeviceInfo.pInterfaceList; pInterface != NULL; pInterface = pInterface->next)
+    {
+        if (pInterface->pCurrentSetting)
+        {
+            for (pEndpoint = pInterface->pCurrentSetting->pEndpointList; pEndpoint != NULL; pEndpoint = pEndpoint->next)
+            {
+                count[pEndpoint->bmAttributes.bfTransferType]++;
+            }
+        }
+    }
+
+    // Find where each transfer type starts, and reuse count[] as the fill index.
+    start[0] = 0;
+    for (i = 0; i < 4; i++)
+    {
+        if (count[i] > USB_MAX_ACTIVE_ENDPOINTS - start[i])
+        {
+            count[i] = USB_MAX_ACTIVE_ENDPOINTS - start[i];
+        }
+        start[i+1] = start[i] + count[i];
+        count[i]   = start[i];
+    }
+
+    // Guard against USB interrupts
+    interrupt_mask = U1IE;
+    U1IE = 0;
+
+    for (pInterface = usbDeviceInfo.pInterfaceList; pInterface != NULL; pInterface = pInterface->next)
+    {
+        if (pInterface->pCurrentSetting)
+        {
+            for (pEndpoint = pInterface->pCurrentSetting->pEndpointList; pEndpoint != NULL; pEndpoint = pEndpoint->next)
+            {
+                i = pEndpoint->bmAttributes.bfTransferType;
+                if (count[i] < start[i+1])
+                {
+                    activeEndpoints[count[i]++] = pEndpoint;
+                }
+            }
+        }
+    }
+    memcpy( activeEndpointsStart, start, sizeof(activeEndpointsStart) );
+
+    // Re-enable USB interrupts
+    U1IE = interrupt_mask;
+}
+
+
 /****************************************************************************
   Function:
     void _USB_CheckCommandAndEnumerationAttempts( void )
@@ -2825,6 +3613,110 @@ void _USB_CheckCommandAndEnumerationAttempts( void )
 }
 
 
+/****************************************************************************
+  Function:
+    void _USB_DeliverIsochronousData( HOST_TRANSFER_DATA *pTransfer )
+
+  Description:
+    This function passes an isochronous packet that the interrupt handler
+    queued to the data event handler of the client driver.  It is called
+    from USBHostTasks().  The event points to the data buffer of the packet,
+    so the data is not copied.  If the handler returns TRUE for a read, the
+    buffer is released.
+
+  Precondition:
+    None
+
+  Parameters:
+    HOST_TRANSFER_DATA *pTransfer   - Queued transfer event
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_ENABLE_ISOC_TRANSFER_EVENT and
+    USB_HOST_APP_DATA_EVENT_HANDLER are defined in usb_config.h.  Packets
+    of an endpoint that is no longer active are discarded.
+  ***************************************************************************/
+#if defined( USB_ENABLE_ISOC_TRANSFER_EVENT ) && defined( USB_HOST_APP_DATA_EVENT_HANDLER )
+
+void _USB_DeliverIsochronousData( HOST_TRANSFER_DATA *pTransfer )
+{
+    USB_ENDPOINT_INFO   *pEndpoint;
+    ISOCHRONOUS_DATA    *isocData;
+    BYTE                i;
+
+    pEndpoint = _USB_FindEndpoint( pTransfer->bEndpointAddress );
+    if ((pEndpoint == NULL) || (pEndpoint->pUserData == NULL))
+    {
+        return;
+    }
+    isocData = (ISOCHRONOUS_DATA *)pEndpoint->pUserData;
+
+    // Find the buffer of the packet.
+    for (i = 0; i < isocData->totalBuffers; i++)
+    {
+        if (isocData->buffers[i].pBuffer == pTransfer->pUserData)
+        {
+            isocData->deliveredCount++;
+            if (pTransfer->bEndpointAddress & 0x80)
+            {
+                if (usbClientDrvTable[pTransfer->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress,
+                        EVENT_DATA_ISOC_READ, pTransfer->pUserData, pTransfer->dataCount ))
+                {
+                    isocData->buffers[i].bfDataLengthValid = 0;
+                }
+            }
+            else
+            {
+                usbClientDrvTable[pTransfer->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress,
+                        EVENT_DATA_ISOC_WRITE, pTransfer->pUserData, pTransfer->dataCount );
+            }
+            return;
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+  Function:
+    DWORD _USB_DescriptorHash( BYTE *pDescriptor, WORD length )
+
+  Description:
+    This function calculates a 32-bit FNV-1a hash of a descriptor.  It is
+    used to check that a cached descriptor is still intact.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *pDescriptor   - Descriptor
+    WORD length         - Length of the descriptor
+
+  Returns:
+    Hash of the descriptor
+
+  Remarks:
+    This function is available only if USB_HOST_DESCRIPTOR_CACHE is defined
+    in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+
+DWORD _USB_DescriptorHash( BYTE *pDescriptor, WORD length )
+{
+    DWORD   hash;
+
+    hash = 2166136261ul;
+    while (length--)
+    {
+        hash ^= *pDescriptor++;
+        hash *= 16777619ul;
+    }
+    return hash;
+}
+#endif
+
+
 /****************************************************************************
   Function:
     BOOL _USB_FindClassDriver( BYTE bClass, BYTE bSubClass, BYTE bProtocol, BYTE *pbClientDrv )
@@ -3180,11 +4072,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_TRANSFER;
                                     data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                     data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3192,10 +4084,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                     break;
@@ -3204,11 +4097,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_BUS_ERROR;
                                     data->TransferData.dataCount        = 0;
                                     data->TransferData.pUserData        = NULL;
@@ -3216,10 +4109,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                             break;
@@ -3267,11 +4161,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_TRANSFER;
                                     data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                     data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3279,10 +4173,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                             break;
@@ -3291,11 +4186,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_BUS_ERROR;
                                     data->TransferData.dataCount        = 0;
                                     data->TransferData.pUserData        = NULL;
@@ -3303,10 +4198,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                             break;
@@ -3354,11 +4250,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_TRANSFER;
                                     data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                     data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3366,10 +4262,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                             break;
@@ -3378,11 +4275,11 @@ void _USB_FindNextToken( void )
                             pCurrentEndpoint->transferState               = TSTATE_IDLE;
                             pCurrentEndpoint->status.bfTransferComplete   = 1;
                             #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                 {
                                     USB_EVENT_DATA *data;
 
-                                    data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                    data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                     data->event = EVENT_BUS_ERROR;
                                     data->TransferData.dataCount        = 0;
                                     data->TransferData.pUserData        = NULL;
@@ -3390,10 +4287,11 @@ void _USB_FindNextToken( void )
                                     data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                     data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                     data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                    SPSCQueueAdd(&usbEventQueue);
                                 }
                                 else
                                 {
-                                    pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                    SPSCQueueOverflow(&usbEventQueue);
                                 }
                             #endif
                             break;
@@ -3455,7 +4353,10 @@ void _USB_FindNextToken( void )
                                 // Don't overwrite data the user has not yet processed.  We will skip this interval.    
                                 if (((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid)
                                 {
-                                    // We have buffer overflow.
+                                    // We have buffer overflow.  Count the lost packet, and wait for the
+                                    // next interval so we do not find this endpoint again in this frame.
+                                    ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->overrunCount++;
+                                    pCurrentEndpoint->wIntervalCount = pCurrentEndpoint->wInterval;
                                 }
                                 else
                                 {
@@ -3463,8 +4364,21 @@ void _USB_FindNextToken( void )
                                     ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 0;
                                     pCurrentEndpoint->dataCount = 0;
 
-                                    _USB_SetDATA01( DTS_DATA0 );    // Always DATA0 for isochronous
-                                    _USB_SetBDT( USB_TOKEN_IN );
+                                    #ifdef USB_ISOCHRONOUS_PREARM
+                                        // If the BDT was armed with this buffer at the end of the last
+                                        // transaction, only the token has to be written now.
+                                        if ((pIsochronousPrearmed == pCurrentEndpoint) &&
+                                            (pIsochronousPrearmedBuffer == ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer))
+                                        {
+                                            pIsochronousPrearmed = NULL;
+                                            usbDeviceInfo.flags.bfPingPongIn = ~usbDeviceInfo.flags.bfPingPongIn;
+                                        }
+                                        else
+                                    #endif
+                                    {
+                                        _USB_SetDATA01( DTS_DATA0 );    // Always DATA0 for isochronous
+                                        _USB_SetBDT( USB_TOKEN_IN );
+                                    }
                                     _USB_SendToken( pCurrentEndpoint->bEndpointAddress, USB_TOKEN_IN );
                                     return;
                                 }    
@@ -3480,32 +4394,54 @@ void _USB_FindNextToken( void )
                                 // Update the valid data length for this buffer.
                                 ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].dataLength = pCurrentEndpoint->dataCount;
                                 ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 1;
-                                #if defined( USB_ENABLE_ISOC_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
-                                    {
-                                        USB_EVENT_DATA *data;
+                                ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->packetCount++;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
-                                        data->event = EVENT_TRANSFER;
-                                        data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
-                                        data->TransferData.pUserData        = ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer;
-                                        data->TransferData.bErrorCode       = USB_SUCCESS;
-                                        data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
-                                        data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
-                                        data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
-                                    }
-                                    else
-                                    {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
-                                    }
-                                #endif
-                                
-                                // If the user wants an event from the interrupt handler to handle the data as quickly as
-                                // possible, send up the event.  Then mark the packet as used.
-                                #ifdef USB_HOST_APP_DATA_EVENT_HANDLER
-                                    usbClientDrvTable[pCurrentEndpoint->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress, EVENT_DATA_ISOC_READ, ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer, pCurrentEndpoint->dataCount );
-                                    ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 0;
-                                #endif
+                                // Give the packet to the user in the one way the user selected.  If the data
+                                // event handler consumed the data, mark the packet as used.  Otherwise the
+                                // packet stays valid until the application releases it through currentBufferUser.
+                                switch (((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->deliveryMode)
+                                {
+                                    #if defined( USB_ENABLE_ISOC_TRANSFER_EVENT )
+                                    case USB_ISOC_DELIVERY_QUEUED:
+                                        if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                        {
+                                            USB_EVENT_DATA *data;
+
+                                            data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                            data->event = EVENT_TRANSFER;
+                                            data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
+                                            data->TransferData.pUserData        = ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer;
+                                            data->TransferData.bErrorCode       = USB_SUCCESS;
+                                            data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
+                                            data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
+                                            data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                            SPSCQueueAdd(&usbEventQueue);
+                                        }
+                                        else
+                                        {
+                                            SPSCQueueOverflow(&usbEventQueue);
+
+                                            // Nobody will see the packet, so do not let it stop the ring.
+                                            ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->lostEventCount++;
+                                            ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 0;
+                                        }
+                                        break;
+                                    #endif
+
+                                    #ifdef USB_HOST_APP_DATA_EVENT_HANDLER
+                                    case USB_ISOC_DELIVERY_ISR:
+                                        ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->deliveredCount++;
+                                        if (usbClientDrvTable[pCurrentEndpoint->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress, EVENT_DATA_ISOC_READ, ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer, pCurrentEndpoint->dataCount ))
+                                        {
+                                            ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 0;
+                                        }
+                                        break;
+                                    #endif
+
+                                    default:
+                                        // The user polls the buffers.
+                                        break;
+                                }
                                 
                                 // Move to the next data buffer.
                                 ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB++;
@@ -3513,6 +4449,11 @@ void _USB_FindNextToken( void )
                                 {
                                     ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB = 0;
                                 }
+
+                                #ifdef USB_ISOCHRONOUS_PREARM
+                                    // Arm the next ping-pong BDT now, so the next interval does not wait for it.
+                                    _USB_PrearmIsochronousRead();
+                                #endif
                                 break;
 
                             case TSUBSTATE_ERROR:
@@ -3522,21 +4463,22 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->transferState     = TSTATE_ISOCHRONOUS_READ | TSUBSTATE_ISOCHRONOUS_READ_DATA;
                                 pCurrentEndpoint->wIntervalCount    = pCurrentEndpoint->wInterval;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bErrorCode       = pCurrentEndpoint->bErrorCode;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3553,7 +4495,10 @@ void _USB_FindNextToken( void )
                             case TSUBSTATE_ISOCHRONOUS_WRITE_DATA:
                                 if (!((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid)
                                 {
-                                    // We have buffer underrun.
+                                    // We have buffer underrun.  Count the missed interval, and wait for
+                                    // the next one so we do not find this endpoint again in this frame.
+                                    ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->overrunCount++;
+                                    pCurrentEndpoint->wIntervalCount = pCurrentEndpoint->wInterval;
                                 }
                                 else
                                 {
@@ -3575,37 +4520,52 @@ void _USB_FindNextToken( void )
 
                                 // Update the valid data length for this buffer.
                                 ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 0;
-                                #if defined( USB_ENABLE_ISOC_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
-                                    {
-                                        USB_EVENT_DATA *data;
-
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
-                                        data->event = EVENT_TRANSFER;
-                                        data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
-                                        data->TransferData.pUserData        = ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer;
-                                        data->TransferData.bErrorCode       = USB_SUCCESS;
-                                        data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
-                                        data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
-                                        data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
-                                    }
-                                    else
-                                    {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
-                                    }
-                                #endif
+                                ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->packetCount++;
 
-                                // If the user wants an event from the interrupt handler to handle the data as quickly as
-                                // possible, send up the event.
-                                #ifdef USB_HOST_APP_DATA_EVENT_HANDLER
-                                    usbClientDrvTable[pCurrentEndpoint->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress, EVENT_DATA_ISOC_WRITE, ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer, pCurrentEndpoint->dataCount );
-                                #endif
-                                                                
-                                // Move to the next data buffer.
-                                ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB++;
-                                if (((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB >= ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->totalBuffers)
+                                // Tell the user in the one way the user selected.
+                                switch (((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->deliveryMode)
                                 {
-                                    ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB = 0;
+                                    #if defined( USB_ENABLE_ISOC_TRANSFER_EVENT )
+                                    case USB_ISOC_DELIVERY_QUEUED:
+                                        if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                        {
+                                            USB_EVENT_DATA *data;
+
+                                            data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                            data->event = EVENT_TRANSFER;
+                                            data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
+                                            data->TransferData.pUserData        = ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer;
+                                            data->TransferData.bErrorCode       = USB_SUCCESS;
+                                            data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
+                                            data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
+                                            data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                            SPSCQueueAdd(&usbEventQueue);
+                                        }
+                                        else
+                                        {
+                                            SPSCQueueOverflow(&usbEventQueue);
+                                            ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->lostEventCount++;
+                                        }
+                                        break;
+                                    #endif
+
+                                    #ifdef USB_HOST_APP_DATA_EVENT_HANDLER
+                                    case USB_ISOC_DELIVERY_ISR:
+                                        ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->deliveredCount++;
+                                        usbClientDrvTable[pCurrentEndpoint->clientDriver].DataEventHandler( usbDeviceInfo.deviceAddress, EVENT_DATA_ISOC_WRITE, ((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].pBuffer, pCurrentEndpoint->dataCount );
+                                        break;
+                                    #endif
+
+                                    default:
+                                        // The user polls the buffers.
+                                        break;
+                                }
+                                                                
+                                // Move to the next data buffer.
+                                ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB++;
+                                if (((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB >= ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->totalBuffers)
+                                {
+                                    ((ISOCHRONOUS_DATA *)pCurrentEndpoint->pUserData)->currentBufferUSB = 0;
                                 }
 								((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->buffers[((ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData))->currentBufferUSB].bfDataLengthValid = 1;                                
                                 break;
@@ -3618,11 +4578,11 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->wIntervalCount    = pCurrentEndpoint->wInterval;
 
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
@@ -3630,10 +4590,11 @@ void _USB_FindNextToken( void )
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3686,11 +4647,11 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->wIntervalCount            = pCurrentEndpoint->wInterval;
                                 pCurrentEndpoint->status.bfTransferComplete = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_TRANSFER;
                                         data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                         data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3698,10 +4659,11 @@ void _USB_FindNextToken( void )
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3711,11 +4673,11 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->wIntervalCount            = pCurrentEndpoint->wInterval;
                                 pCurrentEndpoint->status.bfTransferComplete = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
@@ -3723,10 +4685,11 @@ void _USB_FindNextToken( void )
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3751,11 +4714,11 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->wIntervalCount            = pCurrentEndpoint->wInterval;
                                 pCurrentEndpoint->status.bfTransferComplete = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_TRANSFER;
                                         data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                         data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3763,10 +4726,11 @@ void _USB_FindNextToken( void )
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3776,11 +4740,11 @@ void _USB_FindNextToken( void )
                                 pCurrentEndpoint->wIntervalCount            = pCurrentEndpoint->wInterval;
                                 pCurrentEndpoint->status.bfTransferComplete = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
@@ -3788,10 +4752,11 @@ void _USB_FindNextToken( void )
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3853,11 +4818,11 @@ TryBulk:
                                 pCurrentEndpoint->transferState               = TSTATE_IDLE;
                                 pCurrentEndpoint->status.bfTransferComplete   = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_TRANSFER;
                                         data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                         data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3865,10 +4830,11 @@ TryBulk:
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3877,11 +4843,11 @@ TryBulk:
                                 pCurrentEndpoint->transferState               = TSTATE_IDLE;
                                 pCurrentEndpoint->status.bfTransferComplete   = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
@@ -3889,10 +4855,11 @@ TryBulk:
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3916,11 +4883,11 @@ TryBulk:
                                 pCurrentEndpoint->transferState               = TSTATE_IDLE;
                                 pCurrentEndpoint->status.bfTransferComplete   = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_TRANSFER;
                                         data->TransferData.dataCount        = pCurrentEndpoint->dataCount;
                                         data->TransferData.pUserData        = pCurrentEndpoint->pUserData;
@@ -3928,10 +4895,11 @@ TryBulk:
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -3940,11 +4908,11 @@ TryBulk:
                                 pCurrentEndpoint->transferState               = TSTATE_IDLE;
                                 pCurrentEndpoint->status.bfTransferComplete   = 1;
                                 #if defined( USB_ENABLE_TRANSFER_EVENT )
-                                    if (StructQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
+                                    if (SPSCQueueIsNotFull(&usbEventQueue, USB_EVENT_QUEUE_DEPTH))
                                     {
                                         USB_EVENT_DATA *data;
 
-                                        data = StructQueueAdd(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
+                                        data = SPSCQueueHead(&usbEventQueue, USB_EVENT_QUEUE_DEPTH);
                                         data->event = EVENT_BUS_ERROR;
                                         data->TransferData.dataCount        = 0;
                                         data->TransferData.pUserData        = NULL;
@@ -3952,10 +4920,11 @@ TryBulk:
                                         data->TransferData.bEndpointAddress = pCurrentEndpoint->bEndpointAddress;
                                         data->TransferData.bmAttributes.val = pCurrentEndpoint->bmAttributes.val;
                                         data->TransferData.clientDriver     = pCurrentEndpoint->clientDriver;
+                                        SPSCQueueAdd(&usbEventQueue);
                                     }
                                     else
                                     {
-                                        pCurrentEndpoint->bmAttributes.val = USB_EVENT_QUEUE_FULL;
+                                        SPSCQueueOverflow(&usbEventQueue);
                                     }
                                 #endif
                                 break;
@@ -4031,7 +5000,26 @@ TryBulk:
 BOOL _USB_FindServiceEndpoint( BYTE transferType )
 {
     USB_ENDPOINT_INFO           *pEndpoint;
-    USB_INTERFACE_INFO          *pInterface;
+    BYTE                        i;
+
+    #if defined( USB_HOST_COUNT_SCHEDULING )
+        usbSchedulingDecisions++;
+    #endif
+
+    // Control and bulk transfers only use the bus time that is left in the
+    // frame after the periodic reservation.
+    if ((transferType == USB_TRANSFER_TYPE_CONTROL) || (transferType == USB_TRANSFER_TYPE_BULK))
+    {
+        i = 1;
+        if (usbDeviceInfo.flags.bfIsLowSpeed)
+        {
+            i = 8;
+        }
+        if (usbBusInfo.wFrameBytes + (USB_NON_PERIODIC_MAX_PACKET_SIZE + USB_TRANSACTION_OVERHEAD_BYTES) * i > USB_FRAME_BYTES)
+        {
+            return FALSE;
+        }
+    }
 
     // Check endpoint 0.
     if ((usbDeviceInfo.pEndpoint0->bmAttributes.bfTransferType == transferType) &&
@@ -4042,93 +5030,71 @@ BOOL _USB_FindServiceEndpoint( BYTE transferType )
     }
 
     usbBusInfo.countBulkTransactions = 0;
-    pEndpoint = NULL;
-    pInterface = usbDeviceInfo.pInterfaceList;
-    if (pInterface && pInterface->pCurrentSetting)
-    {
-        pEndpoint = pInterface->pCurrentSetting->pEndpointList;
-    }
+    transferType &= 0x03;
 
-    while (pInterface)
+    // Only look at the active endpoints of this transfer type.
+    for (i = activeEndpointsStart[transferType]; i < activeEndpointsStart[transferType+1]; i++)
     {
-        if (pEndpoint != NULL)
-        {
-			if (pEndpoint->bmAttributes.bfTransferType == transferType)
-			{
-				switch (transferType)
+        pEndpoint = activeEndpoints[i];
+		switch (transferType)
+		{
+			case USB_TRANSFER_TYPE_CONTROL:
+				if (!pEndpoint->status.bfTransferComplete)
 				{
-					case USB_TRANSFER_TYPE_CONTROL:
-						if (!pEndpoint->status.bfTransferComplete)
-						{
-							pCurrentEndpoint = pEndpoint;
-							return TRUE;
-						}
-						break;
-
-					#ifdef USB_SUPPORT_ISOCHRONOUS_TRANSFERS
-					case USB_TRANSFER_TYPE_ISOCHRONOUS:
-					#endif
-					#ifdef USB_SUPPORT_INTERRUPT_TRANSFERS
-					case USB_TRANSFER_TYPE_INTERRUPT:
-					#endif
-					#if defined( USB_SUPPORT_ISOCHRONOUS_TRANSFERS ) || defined( USB_SUPPORT_INTERRUPT_TRANSFERS )
-						if (pEndpoint->status.bfTransferComplete)
-						{
-							// The endpoint doesn't need servicing.  If the interval count
-							// has reached 0 and the user has not initiated another transaction,
-							// reset the interval count for the next interval.
-							if (pEndpoint->wIntervalCount == 0)
-							{
-								// Reset the interval count for the next packet.
-								pEndpoint->wIntervalCount = pEndpoint->wInterval;
-							}
-						}
-						else
-						{
-							if (pEndpoint->wIntervalCount == 0)
-							{
-    							pCurrentEndpoint = pEndpoint;
-    							return TRUE;
-    			            }				
-						}
-						break;
-					#endif
-
-					#ifdef USB_SUPPORT_BULK_TRANSFERS
-					case USB_TRANSFER_TYPE_BULK:
-						#ifdef ALLOW_MULTIPLE_NAKS_PER_FRAME
-						if (!pEndpoint->status.bfTransferComplete)
-						#else
-						if (!pEndpoint->status.bfTransferComplete &&
-							!pEndpoint->status.bfLastTransferNAKd)
-						#endif
-						{
-							usbBusInfo.countBulkTransactions ++;
-							if (usbBusInfo.countBulkTransactions > usbBusInfo.lastBulkTransaction)
-							{
-								usbBusInfo.lastBulkTransaction  = usbBusInfo.countBulkTransactions;
-								pCurrentEndpoint                = pEndpoint;
-								return TRUE;
-							}
-						}
-						break;
-					#endif
+					pCurrentEndpoint = pEndpoint;
+					return TRUE;
 				}
-			}
-
-	        // Go to the next endpoint.
-            pEndpoint = pEndpoint->next;
-        }
-
-        if (pEndpoint == NULL)
-        {
-            // Go to the next interface.
-            pInterface = pInterface->next;
-            if (pInterface && pInterface->pCurrentSetting)
-            {
-                pEndpoint = pInterface->pCurrentSetting->pEndpointList;
-            }
-        }
+				break;
+
+			#ifdef USB_SUPPORT_ISOCHRONOUS_TRANSFERS
+			case USB_TRANSFER_TYPE_ISOCHRONOUS:
+			#endif
+			#ifdef USB_SUPPORT_INTERRUPT_TRANSFERS
+			case USB_TRANSFER_TYPE_INTERRUPT:
+			#endif
+			#if defined( USB_SUPPORT_ISOCHRONOUS_TRANSFERS ) || defined( USB_SUPPORT_INTERRUPT_TRANSFERS )
+				if (pEndpoint->status.bfTransferComplete)
+				{
+					// The endpoint doesn't need servicing.  If the interval count
+					// has reached 0 and the user has not initiated another transaction,
+					// reset the interval count for the next interval.
+					if (pEndpoint->wIntervalCount == 0)
+					{
+						// Reset the interval count for the next packet.
+						pEndpoint->wIntervalCount = pEndpoint->wInterval;
+					}
+				}
+				else
+				{
+					if (pEndpoint->wIntervalCount == 0)
+					{
+						pCurrentEndpoint = pEndpoint;
+						return TRUE;
+					}
+				}
+				break;
+			#endif
+
+			#ifdef USB_SUPPORT_BULK_TRANSFERS
+			case USB_TRANSFER_TYPE_BULK:
+				#ifdef ALLOW_MULTIPLE_NAKS_PER_FRAME
+				if (!pEndpoint->status.bfTransferComplete)
+				#else
+				if (!pEndpoint->status.bfTransferComplete &&
+					!pEndpoint->status.bfLastTransferNAKd)
+				#endif
+				{
+					usbBusInfo.countBulkTransactions ++;
+					if (usbBusInfo.countBulkTransactions > usbBusInfo.lastBulkTransaction)
+					{
+						usbBusInfo.lastBulkTransaction  = usbBusInfo.countBulkTransactions;
+						pCurrentEndpoint                = pEndpoint;
+						return TRUE;
+					}
+				}
+				break;
+			#endif
+		}
     }
 
     // No endpoints with the desired description are ready for servicing.
@@ -4136,6 +5102,52 @@ BOOL _USB_FindServiceEndpoint( BYTE transferType )
 }
 
 
+/****************************************************************************
+  Function:
+    void _USB_FlushControlQueue( void )
+
+  Description:
+    This function removes every request from the EP0 request queue, and
+    calls their callbacks with USB_DEVICE_DETACHED.
+
+  Precondition:
+    None
+
+  Parameters:
+    None - None
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_CONTROL_QUEUE_DEPTH is
+    defined in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+
+void _USB_FlushControlQueue( void )
+{
+    USB_CONTROL_REQUEST *request;
+
+    // The host is in the DETACHED state here, so the callbacks cannot queue
+    // new requests, but the queue is emptied one request at a time anyway.
+    usbControlQueue.bfServicing = 1;
+    while (SPSCQueueIsNotEmpty(&usbControlQueue))
+    {
+        request = SPSCQueuePeek(&usbControlQueue, USB_HOST_CONTROL_QUEUE_DEPTH, 0);
+        if (request->callback != NULL)
+        {
+            request->callback( request->deviceAddress, USB_DEVICE_DETACHED,
+                    (request->wLength <= USB_HOST_CONTROL_DATA_SIZE) ? request->data : request->pUserData,
+                    0, request->context );
+        }
+        SPSCQueueRemove(&usbControlQueue, 1);
+    }
+    usbControlQueue.bfIssued    = 0;
+    usbControlQueue.bfServicing = 0;
+}
+#endif
+
 /****************************************************************************
   Function:
     void _USB_FreeConfigMemory( void )
@@ -4159,6 +5171,11 @@ BOOL _USB_FindServiceEndpoint( BYTE transferType )
 
 void _USB_FreeConfigMemory( void )
 {
+#if defined( USB_HOST_ARENA_SIZE )
+    // The nodes are released with the arena, and the descriptor cache may
+    // still use them, so only the list is dropped.
+    usbDeviceInfo.pInterfaceList = NULL;
+#else
     USB_INTERFACE_INFO          *pTempInterface;
     USB_INTERFACE_SETTING_INFO  *pTempSetting;
     USB_ENDPOINT_INFO           *pTempEndpoint;
@@ -4174,15 +5191,28 @@ void _USB_FreeConfigMemory( void )
             while (usbDeviceInfo.pInterfaceList->pInterfaceSettings->pEndpointList != NULL)
             {
                 pTempEndpoint = usbDeviceInfo.pInterfaceList->pInterfaceSettings->pEndpointList->next;
-                USB_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList->pInterfaceSettings->pEndpointList );
+                USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList->pInterfaceSettings->pEndpointList );
                 usbDeviceInfo.pInterfaceList->pInterfaceSettings->pEndpointList = pTempEndpoint;
             }
-            USB_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList->pInterfaceSettings );
+            USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList->pInterfaceSettings );
             usbDeviceInfo.pInterfaceList->pInterfaceSettings = pTempSetting;
         }
-        USB_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList );
+        USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pInterfaceList );
         usbDeviceInfo.pInterfaceList = pTempInterface;
     }
+#endif
+    _USB_ScheduleBandwidth( NULL, NULL );
+    _USB_BuildActiveEndpointLists();
+
+    #if defined( USB_HOST_ARENA_SIZE )
+        // Give back the arena used by the lists.  This is done after the
+        // active endpoint table no longer points into it.
+        if (usbArenaConfigStart != USB_ARENA_NO_MARK)
+        {
+            usbArenaUsed        = usbArenaConfigStart;
+            usbArenaConfigStart = USB_ARENA_NO_MARK;
+        }
+    #endif
 
     pCurrentEndpoint = usbDeviceInfo.pEndpoint0;
 
@@ -4212,26 +5242,47 @@ void _USB_FreeConfigMemory( void )
 
 void _USB_FreeMemory( void )
 {
+#if defined( USB_HOST_ARENA_SIZE )
+    // The nodes are released with the arena, and the descriptor cache may
+    // still use them, so only the list is dropped.
+    usbDeviceInfo.pConfigurationDescriptorList = NULL;
+#else
     BYTE    *pTemp;
 
     while (usbDeviceInfo.pConfigurationDescriptorList != NULL)
     {
         pTemp = (BYTE *)usbDeviceInfo.pConfigurationDescriptorList->next;
-        USB_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList->descriptor );
-        USB_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList );
+        USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList->descriptor );
+        USB_DEVICE_FREE_AND_CLEAR( usbDeviceInfo.pConfigurationDescriptorList );
         usbDeviceInfo.pConfigurationDescriptorList = (USB_CONFIGURATION *)pTemp;
     }
+#endif
     if (pDeviceDescriptor != NULL)
     {
-        USB_FREE_AND_CLEAR( pDeviceDescriptor );
+        USB_DEVICE_FREE_AND_CLEAR( pDeviceDescriptor );
     }
     if (pEP0Data != NULL)
     {
-        USB_FREE_AND_CLEAR( pEP0Data );
+        USB_DEVICE_FREE_AND_CLEAR( pEP0Data );
     }
 
     _USB_FreeConfigMemory();
 
+    #if defined( USB_HOST_ARENA_SIZE )
+        usbArenaUsed        = 0;
+        usbArenaConfigStart = USB_ARENA_NO_MARK;
+    #endif
+
+    #if defined( USB_HOST_DESCRIPTOR_CACHE )
+        // Keep the part of the arena that holds the cached device.
+        if (usbDescriptorCache.flags.bfValid)
+        {
+            usbArenaUsed = usbDescriptorCache.arenaEnd;
+        }
+        usbDescriptorCache.flags.bfChecking = 0;
+        usbDescriptorCache.flags.bfUsed     = 0;
+    #endif
+
 }
 
 
@@ -4694,6 +5745,15 @@ BOOL _USB_ParseConfigurationDescriptor( void )
     USB_INTERFACE_INFO          *pTempInterfaceList;
     BYTE                        *ptr;
 
+    #if defined( USB_HOST_ARENA_SIZE )
+        // Everything taken from the arena from here on is released by
+        // _USB_FreeConfigMemory().
+        if (usbArenaConfigStart == USB_ARENA_NO_MARK)
+        {
+            usbArenaConfigStart = usbArenaUsed;
+        }
+    #endif
+
     // Prime the loops.
     currentEndpoint         = 0;
     error                   = FALSE;
@@ -4851,7 +5911,7 @@ BOOL _USB_ParseConfigurationDescriptor( void )
             if (newInterfaceInfo == NULL)
             {
                 // This is the first instance of this interface, so create a new node for it.
-                if ((newInterfaceInfo = (USB_INTERFACE_INFO *)USB_MALLOC( sizeof(USB_INTERFACE_INFO) )) == NULL)
+                if ((newInterfaceInfo = (USB_INTERFACE_INFO *)USB_DEVICE_MALLOC( sizeof(USB_INTERFACE_INFO) )) == NULL)
                 {
                     // Out of memory
                     error = TRUE; 
@@ -4875,7 +5935,7 @@ BOOL _USB_ParseConfigurationDescriptor( void )
             if (!error)
             {
                 // Create a new setting for this interface, and add it to the list.
-                if ((newSettingInfo = (USB_INTERFACE_SETTING_INFO *)USB_MALLOC( sizeof(USB_INTERFACE_SETTING_INFO) )) == NULL)
+                if ((newSettingInfo = (USB_INTERFACE_SETTING_INFO *)USB_DEVICE_MALLOC( sizeof(USB_INTERFACE_SETTING_INFO) )) == NULL)
                 {
                     // Out of memory
                     error = TRUE;   
@@ -4913,7 +5973,7 @@ BOOL _USB_ParseConfigurationDescriptor( void )
                     else
                     {
                         // Create an entry for the new endpoint.
-                        if ((newEndpointInfo = (USB_ENDPOINT_INFO *)USB_MALLOC( sizeof(USB_ENDPOINT_INFO) )) == NULL)
+                        if ((newEndpointInfo = (USB_ENDPOINT_INFO *)USB_DEVICE_MALLOC( sizeof(USB_ENDPOINT_INFO) )) == NULL)
                         {
                             // Out of memory
                             error = TRUE;   
@@ -4929,6 +5989,7 @@ BOOL _USB_ParseConfigurationDescriptor( void )
                         newEndpointInfo->dataCount                  = 0;  // Initialize to 0 since we set bfTransferComplete.
                         newEndpointInfo->transferState              = TSTATE_IDLE;
                         newEndpointInfo->clientDriver               = ClientDriver;
+                        newEndpointInfo->bSchedulePeriod            = 0;
 
                         // Special setup for isochronous endpoints.
                         if (newEndpointInfo->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS)
@@ -5005,13 +6066,13 @@ BOOL _USB_ParseConfigurationDescriptor( void )
                     newEndpointInfo = newSettingInfo->pEndpointList;
                     newSettingInfo->pEndpointList = newSettingInfo->pEndpointList->next;
                     
-                    USB_FREE_AND_CLEAR( newEndpointInfo );
+                    USB_DEVICE_FREE_AND_CLEAR( newEndpointInfo );
                 }    
     
-                USB_FREE_AND_CLEAR( newSettingInfo );
+                USB_DEVICE_FREE_AND_CLEAR( newSettingInfo );
             }
     
-            USB_FREE_AND_CLEAR( newInterfaceInfo );
+            USB_DEVICE_FREE_AND_CLEAR( newInterfaceInfo );
         }    
         return FALSE;
     }
@@ -5025,6 +6086,13 @@ BOOL _USB_ParseConfigurationDescriptor( void )
         DEBUG_PutString( "HOST: Parse Descriptor success\r\n" );
 
         usbDeviceInfo.pInterfaceList = pTempInterfaceList;
+        if (!_USB_ScheduleBandwidth( NULL, NULL ))
+        {
+            // The default settings should never need more than a frame.  If
+            // they do, their endpoints are serviced without reserved time.
+            DEBUG_PutString( "HOST: Periodic bandwidth exceeded\r\n" );
+        }
+        _USB_BuildActiveEndpointLists();
         return TRUE;
     }    
 }
@@ -5090,6 +6158,156 @@ void _USB_ResetDATA0( BYTE endpoint )
 }
 
 
+/****************************************************************************
+  Function:
+    BOOL _USB_ScheduleBandwidth( USB_INTERFACE_INFO *pChangedInterface,
+                USB_INTERFACE_SETTING_INFO *pNewSetting )
+
+  Description:
+    This function builds the reservation table of the frame scheduler.  Each
+    isochronous and interrupt endpoint of the current interface settings
+    gets bus time in every frame of its period, at the phase where the
+    busiest frame is least loaded.  If a frame would need more than
+    USB_PERIODIC_FRAME_BYTES, the table is not changed.
+
+  Precondition:
+    None
+
+  Parameters:
+    USB_INTERFACE_INFO *pChangedInterface   - Interface that is changing its
+                                                setting, or NULL
+    USB_INTERFACE_SETTING_INFO *pNewSetting - New setting of that interface
+
+  Return Values:
+    TRUE    - The periodic endpoints fit, and the table has been updated
+    FALSE   - The periodic endpoints need more bus time than a frame has
+
+  Remarks:
+    The period is the largest power of 2 that is not longer than the
+    endpoint's interval, up to USB_SCHEDULE_FRAMES.  Interrupt endpoints
+    with a longer interval are polled every USB_SCHEDULE_FRAMES frames.
+  ***************************************************************************/
+
+BOOL _USB_ScheduleBandwidth( USB_INTERFACE_INFO *pChangedInterface, USB_INTERFACE_SETTING_INFO *pNewSetting )
+{
+    USB_INTERFACE_INFO          *pInterface;
+    USB_INTERFACE_SETTING_INFO  *pSetting;
+    USB_ENDPOINT_INFO           *pEndpoint;
+    WORD                        reserved[USB_SCHEDULE_FRAMES];
+    WORD                        bytes;
+    WORD                        load;
+    WORD                        bestLoad;
+    BYTE                        period;
+    BYTE                        phase;
+    BYTE                        bestPhase;
+    BYTE                        frame;
+    BYTE                        pass;
+    #if defined( __C30__ ) || defined __XC16__
+        WORD                    interrupt_mask = 0;
+    #elif defined( __PIC32MX__ )
+        UINT32                  interrupt_mask = 0;
+    #else
+        #error Cannot save interrupt status
+    #endif
+
+    // The first pass checks that everything fits.  The second pass, which
+    // makes the same choices, stores them in the endpoints.
+    for (pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            // Guard against USB interrupts
+            interrupt_mask = U1IE;
+            U1IE = 0;
+        }
+
+        memset( reserved, 0, sizeof(reserved) );
+        for (pInterface = usbDeviceInfo.pInterfaceList; pInterface != NULL; pInterface = pInterface->next)
+        {
+            pSetting = pInterface->pCurrentSetting;
+            if (pInterface == pChangedInterface)
+            {
+                pSetting = pNewSetting;
+            }
+            if (pSetting == NULL)
+            {
+                continue;
+            }
+
+            for (pEndpoint = pSetting->pEndpointList; pEndpoint != NULL; pEndpoint = pEndpoint->next)
+            {
+                if ((pEndpoint->bmAttributes.bfTransferType != USB_TRANSFER_TYPE_ISOCHRONOUS) &&
+                    (pEndpoint->bmAttributes.bfTransferType != USB_TRANSFER_TYPE_INTERRUPT))
+                {
+                    continue;
+                }
+
+                period = 1;
+                while ((period < USB_SCHEDULE_FRAMES) && ((WORD)(period << 1) <= pEndpoint->wInterval))
+                {
+                    period <<= 1;
+                }
+                bytes = _USB_TransactionBytes( pEndpoint );
+
+                // Find the phase whose busiest frame has the most time left.
+                bestLoad  = 0xFFFF;
+                bestPhase = 0;
+                for (phase = 0; phase < period; phase++)
+                {
+                    load = 0;
+                    for (frame = phase; frame < USB_SCHEDULE_FRAMES; frame += period)
+                    {
+                        if (reserved[frame] > load)
+                        {
+                            load = reserved[frame];
+                        }
+                    }
+                    if (load < bestLoad)
+                    {
+                        bestLoad  = load;
+                        bestPhase = phase;
+                    }
+                }
+
+                if ((pass == 0) && (bestLoad + bytes > USB_PERIODIC_FRAME_BYTES))
+                {
+                    return FALSE;
+                }
+
+                for (frame = bestPhase; frame < USB_SCHEDULE_FRAMES; frame += period)
+                {
+                    reserved[frame] += bytes;
+                }
+
+                if (pass == 1)
+                {
+                    pEndpoint->bSchedulePeriod = period;
+                    pEndpoint->bSchedulePhase  = bestPhase;
+                }
+            }
+        }
+    }
+
+    memcpy( usbFrameReserved, reserved, sizeof(usbFrameReserved) );
+
+    #if defined( USB_HOST_COUNT_SCHEDULING )
+        usbFrameStatistics.wReservedPeak = 0;
+        for (frame = 0; frame < USB_SCHEDULE_FRAMES; frame++)
+        {
+            if (reserved[frame] > usbFrameStatistics.wReservedPeak)
+            {
+                usbFrameStatistics.wReservedPeak = reserved[frame];
+            }
+        }
+    #endif
+
+    // Re-enable USB interrupts
+    U1IE = interrupt_mask;
+
+    return TRUE;
+}
+
+
 /****************************************************************************
   Function:
     void _USB_SendToken( BYTE endpoint, BYTE tokenType )
@@ -5142,12 +6360,104 @@ void _USB_SendToken( BYTE endpoint, BYTE tokenType )
     U1ADDR = usbDeviceInfo.deviceAddressAndSpeed;
     U1TOK = (tokenType << 4) | (endpoint & 0x7F);
 
+    // Count the bus time of the transaction, unless it was reserved.
+    if (!pCurrentEndpoint->bSchedulePeriod)
+    {
+        usbBusInfo.wFrameBytes += _USB_TransactionBytes( (USB_ENDPOINT_INFO *)pCurrentEndpoint );
+    }
+
     // Lock out anyone from writing another token until this one has finished.
 //    U1CONbits.TOKBUSY = 1;
     usbBusInfo.flags.bfTokenAlreadyWritten = 1;
 }
 
 
+/****************************************************************************
+  Function:
+    void _USB_ServiceControlQueue( void )
+
+  Description:
+    This function checks if the request at the tail of the EP0 request queue
+    has completed.  If it has, its callback is called, and the next request
+    is sent right away.  Requests that cannot be sent are completed with the
+    error from USBHostIssueDeviceRequest().
+
+  Precondition:
+    None
+
+  Parameters:
+    None - None
+
+  Returns:
+    None
+
+  Remarks:
+    This function is available only if USB_HOST_CONTROL_QUEUE_DEPTH is
+    defined in usb_config.h.  The requests are sent with CLIENT_DRIVER_HOST
+    as the client driver, so their completion is not sent to the client
+    drivers as an event.
+  ***************************************************************************/
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+
+void _USB_ServiceControlQueue( void )
+{
+    USB_CONTROL_REQUEST *request;
+    BYTE                *pData;
+    DWORD               byteCount;
+    BYTE                errorCode;
+
+    usbControlQueue.bfServicing = 1;
+    while (SPSCQueueIsNotEmpty(&usbControlQueue))
+    {
+        request   = SPSCQueuePeek(&usbControlQueue, USB_HOST_CONTROL_QUEUE_DEPTH, 0);
+        pData     = (request->wLength <= USB_HOST_CONTROL_DATA_SIZE) ? request->data : request->pUserData;
+        byteCount = 0;
+
+        if (!usbControlQueue.bfIssued)
+        {
+            errorCode = USBHostIssueDeviceRequest( request->deviceAddress, request->bmRequestType,
+                            request->bRequest, request->wValue, request->wIndex, request->wLength,
+                            pData, request->dataDirection, CLIENT_DRIVER_HOST );
+            if (errorCode == USB_SUCCESS)
+            {
+                usbControlQueue.bfIssued = 1;
+                break;
+            }
+            if ((errorCode == USB_ENDPOINT_BUSY) || (errorCode == USB_INVALID_STATE))
+            {
+                // EP0 is being used by someone else, or the device is not
+                // running.  Try again on the next call.
+                break;
+            }
+        }
+        else
+        {
+            if (!USBHostTransferIsComplete( request->deviceAddress, 0, &errorCode, &byteCount ))
+            {
+                break;
+            }
+            usbControlQueue.bfIssued = 0;
+
+            if ((errorCode == USB_SUCCESS) && (request->dataDirection == USB_DEVICE_REQUEST_GET) &&
+                (pData == request->data) && (request->pUserData != NULL))
+            {
+                memcpy( request->pUserData, request->data, byteCount );
+                pData = request->pUserData;
+            }
+        }
+
+        // The request stays in the queue until the callback returns, so its
+        // data is not overwritten by a request the callback queues.
+        if (request->callback != NULL)
+        {
+            request->callback( request->deviceAddress, errorCode, pData, byteCount, request->context );
+        }
+        SPSCQueueRemove(&usbControlQueue, 1);
+    }
+    usbControlQueue.bfServicing = 0;
+}
+#endif
+
 /****************************************************************************
   Function:
     void _USB_SetBDT( BYTE token )
@@ -5181,6 +6491,12 @@ void _USB_SetBDT( BYTE token )
 
     if (token == USB_TOKEN_IN)
     {
+        // Any IN transfer uses the BDT that may have been armed for an
+        // isochronous read.
+        #ifdef USB_ISOCHRONOUS_PREARM
+            pIsochronousPrearmed = NULL;
+        #endif
+
         // Find the BDT we need to use.
         #if (USB_PING_PONG_MODE == USB_PING_PONG__FULL_PING_PONG)
             pBDT = BDT_IN;
@@ -5293,6 +6609,96 @@ void _USB_SetBDT( BYTE token )
 }
 
 
+/****************************************************************************
+  Function:
+    void _USB_PrearmIsochronousRead( void )
+
+  Description:
+    This function arms the next IN ping-pong BDT with the next isochronous
+    data buffer of the current endpoint, right after a transaction has
+    completed.  When the endpoint is serviced in its next interval, only the
+    token has to be written, so the transaction is not delayed by the BDT
+    set up.
+
+  Precondition:
+    pCurrentEndpoint must point to an isochronous IN endpoint, and no token
+    may be in progress.
+
+  Parameters:
+    None
+
+  Returns:
+    None
+
+  Remarks:
+    The host sends one token for each write to U1TOK, so two transactions
+    cannot be queued.  Only the BDT is prepared ahead of time.  The BDT is
+    not armed if the next buffer still holds data the application has not
+    processed.  Any other IN transfer re-arms the BDT for itself through
+    _USB_SetBDT().
+  ***************************************************************************/
+#ifdef USB_ISOCHRONOUS_PREARM
+
+void _USB_PrearmIsochronousRead( void )
+{
+    ISOCHRONOUS_DATA    *pIsochronousData;
+
+    pIsochronousData = (ISOCHRONOUS_DATA *)(pCurrentEndpoint->pUserData);
+    if (pIsochronousData->buffers[pIsochronousData->currentBufferUSB].bfDataLengthValid)
+    {
+        return;
+    }
+
+    _USB_SetDATA01( DTS_DATA0 );    // Always DATA0 for isochronous
+    _USB_SetBDT( USB_TOKEN_IN );
+
+    // The token is not sent yet, so the ping-pong pointer stays at this BDT.
+    usbDeviceInfo.flags.bfPingPongIn = ~usbDeviceInfo.flags.bfPingPongIn;
+
+    pIsochronousPrearmed        = (USB_ENDPOINT_INFO *)pCurrentEndpoint;
+    pIsochronousPrearmedBuffer  = pIsochronousData->buffers[pIsochronousData->currentBufferUSB].pBuffer;
+}
+#endif
+
+
+/****************************************************************************
+  Function:
+    WORD _USB_TransactionBytes( USB_ENDPOINT_INFO *pEndpoint )
+
+  Description:
+    This function returns the bus time of one transaction of the endpoint
+    with a full packet, including the protocol overhead.
+
+  Precondition:
+    None
+
+  Parameters:
+    USB_ENDPOINT_INFO *pEndpoint    - Endpoint of the transaction
+
+  Returns:
+    Bus time, in full-speed byte times
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+WORD _USB_TransactionBytes( USB_ENDPOINT_INFO *pEndpoint )
+{
+    WORD    bytes;
+
+    bytes = (pEndpoint->wMaxPacketSize & 0x07FF) + USB_TRANSACTION_OVERHEAD_BYTES;
+    if (pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS)
+    {
+        bytes = (pEndpoint->wMaxPacketSize & 0x07FF) + USB_ISOCHRONOUS_OVERHEAD_BYTES;
+    }
+    if (usbDeviceInfo.flags.bfIsLowSpeed)
+    {
+        bytes *= 8;
+    }
+    return bytes;
+}
+
+
 /****************************************************************************
   Function:
     BOOL _USB_TransferInProgress( void )
@@ -5352,6 +6758,116 @@ BOOL _USB_TransferInProgress( void )
 }
 
 
+/****************************************************************************
+  Function:
+    BOOL _USB_UseCachedConfiguration( void )
+
+  Description:
+    This function configures the attached device with the interface list
+    in the descriptor cache, instead of parsing the Configuration Descriptor
+    again.  The interfaces are set back to their default settings, and the
+    endpoints are set back to the state _USB_ParseConfigurationDescriptor()
+    leaves them in.
+
+  Precondition:
+    pCurrentConfigurationDescriptor points to the cached Configuration
+    Descriptor, and every descriptor of the device matched the cache.
+
+  Parameters:
+    None
+
+  Return Values:
+    TRUE    - The cached configuration is used
+    FALSE   - The application did not allow the power the device needs
+
+  Remarks:
+    Devices that support OTG are never cached, so the OTG flags are set as
+    for a device without an OTG descriptor.
+
+    This function is available only if USB_HOST_DESCRIPTOR_CACHE is defined
+    in usb_config.h.
+  ***************************************************************************/
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+
+BOOL _USB_UseCachedConfiguration( void )
+{
+    USB_INTERFACE_INFO          *pInterface;
+    USB_INTERFACE_SETTING_INFO  *pSetting;
+    USB_ENDPOINT_INFO           *pEndpoint;
+    USB_VBUS_POWER_EVENT_DATA   powerRequest;
+
+    // No OTG support.  Set before the power check, as the caller uses
+    // bfConfiguredOTG to hold the device if the power is refused.
+    usbDeviceInfo.flags.bfSupportsOTG   = 0;
+    usbDeviceInfo.flags.bfConfiguredOTG = 1;
+    #ifdef USB_SUPPORT_OTG
+        usbDeviceInfo.flags.bfAllowHNP = 1;
+    #endif
+
+    // Check Max Power to see if we can support this configuration.
+    powerRequest.current = pCurrentConfigurationDescriptor[8];  // bMaxPower
+    powerRequest.port    = 0;                                   // Port 0
+    if (!USB_HOST_APP_EVENT_HANDLER( USB_ROOT_HUB, EVENT_VBUS_REQUEST_POWER,
+            &powerRequest, sizeof(USB_VBUS_POWER_EVENT_DATA) ))
+    {
+        usbDeviceInfo.errorCode = USB_ERROR_INSUFFICIENT_POWER;
+        return FALSE;
+    }
+
+    pInterface = usbDescriptorCache.pInterfaceList;
+    while (pInterface)
+    {
+        pInterface->pCurrentSetting = NULL;
+        pSetting = pInterface->pInterfaceSettings;
+        while (pSetting)
+        {
+            if (pSetting->interfaceAltSetting == 0)
+            {
+                pInterface->pCurrentSetting = pSetting;
+            }
+
+            pEndpoint = pSetting->pEndpointList;
+            while (pEndpoint)
+            {
+                pEndpoint->status.val                   = 0x00;
+                pEndpoint->status.bfUseDTS              = 1;
+                pEndpoint->status.bfTransferComplete    = 1;  // Initialize to success to allow preprocessing loops.
+                pEndpoint->dataCount                    = 0;  // Initialize to 0 since we set bfTransferComplete.
+                pEndpoint->transferState                = TSTATE_IDLE;
+                pEndpoint->bSchedulePeriod              = 0;
+                if (pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS)
+                {
+                    pEndpoint->status.bfUseDTS = 0;
+                }
+
+                // The interval was already converted when the descriptor was parsed.
+                pEndpoint->wIntervalCount               = pEndpoint->wInterval;
+
+                pEndpoint = pEndpoint->next;
+            }
+            pSetting = pSetting->next;
+        }
+        pInterface = pInterface->next;
+    }
+
+    // Set configuration.
+    usbDeviceInfo.currentConfiguration      = pCurrentConfigurationDescriptor[5];  // bConfigurationValue
+    usbDeviceInfo.currentConfigurationPower = pCurrentConfigurationDescriptor[8];  // bMaxPower
+    usbDeviceInfo.pInterfaceList            = usbDescriptorCache.pInterfaceList;
+    usbDescriptorCache.flags.bfUsed         = 1;
+
+    DEBUG_PutString( "HOST: Using cached configuration\r\n" );
+
+    if (!_USB_ScheduleBandwidth( NULL, NULL ))
+    {
+        DEBUG_PutString( "HOST: Periodic bandwidth exceeded\r\n" );
+    }
+    _USB_BuildActiveEndpointLists();
+    return TRUE;
+}
+#endif
+
+
 // *****************************************************************************
 // *****************************************************************************
 // Section: Interrupt Handlers
@@ -5399,6 +6915,9 @@ void __ISR(_USB_1_VECTOR, ipl4) _USB1Interrupt(void)
     #error Cannot define timer interrupt vector.
 #endif
 {
+    #if defined( USB_HOST_MEASURE_ISR_TIME ) && defined( __PIC32MX__ )
+        DWORD   isrTime = ReadCoreTimer();
+    #endif
 
     #if defined( __C30__) || defined __XC16__
         IFS5 &= 0xFFBF;
@@ -5881,7 +7400,7 @@ void __ISR(_USB_1_VECTOR, ipl4) _USB1Interrupt(void)
     if (U1IEbits.SOFIE && U1IRbits.SOFIF)
     {
         USB_ENDPOINT_INFO           *pEndpoint;
-        USB_INTERFACE_INFO          *pInterface;
+        BYTE                        i;
 
         #if defined(USB_ENABLE_SOF_EVENT) && defined(USB_HOST_APP_DATA_EVENT_HANDLER)
             //Notify ping all client drivers of SOF event (address, event, data, sizeof_data)
@@ -5890,33 +7409,48 @@ void __ISR(_USB_1_VECTOR, ipl4) _USB1Interrupt(void)
 
         U1IR = USB_INTERRUPT_SOF; // Clear the interrupt by writing a '1' to the flag.
 
-        pInterface = usbDeviceInfo.pInterfaceList;
-        while (pInterface)
+        #if defined( USB_HOST_COUNT_SCHEDULING )
+            if (usbSchedulingDecisions > usbSchedulingDecisionsMax)
+            {
+                usbSchedulingDecisionsMax = usbSchedulingDecisions;
+            }
+            usbSchedulingDecisions = 0;
+
+            if (usbBusInfo.wFrameBytes > usbFrameStatistics.wUsedPeak)
+            {
+                usbFrameStatistics.wUsedPeak = usbBusInfo.wFrameBytes;
+            }
+            usbFrameStatistics.dwUsedTotal += usbBusInfo.wFrameBytes;
+            usbFrameStatistics.dwFrames++;
+        #endif
+
+        // Move to the next frame of the schedule.  Its periodic bus time is
+        // already taken.
+        usbBusInfo.bFrameIndex = (usbBusInfo.bFrameIndex + 1) & (USB_SCHEDULE_FRAMES - 1);
+        usbBusInfo.wFrameBytes = usbFrameReserved[usbBusInfo.bFrameIndex];
+
+        for (i = 0; i < activeEndpointsStart[4]; i++)
         {
-            if (pInterface->pCurrentSetting)
+            pEndpoint = activeEndpoints[i];
+
+            if (pEndpoint->bSchedulePeriod)
             {
-                pEndpoint = pInterface->pCurrentSetting->pEndpointList;
-                while (pEndpoint)
+                // An endpoint with reserved bus time is due only in its reserved frames.
+                pEndpoint->wIntervalCount = (pEndpoint->bSchedulePhase - usbBusInfo.bFrameIndex) & (pEndpoint->bSchedulePeriod - 1);
+            }
+            // Decrement the interval count of all other active interrupt and isochronous endpoints.
+            else if ((pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_INTERRUPT) ||
+                (pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS))
+            {
+                if (pEndpoint->wIntervalCount != 0)
                 {
-                    // Decrement the interval count of all active interrupt and isochronous endpoints.
-                    if ((pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_INTERRUPT) ||
-                        (pEndpoint->bmAttributes.bfTransferType == USB_TRANSFER_TYPE_ISOCHRONOUS))
-                    {
-                        if (pEndpoint->wIntervalCount != 0)
-                        {
-                            pEndpoint->wIntervalCount--;
-                        }
-                    }
-    
-                    #ifndef ALLOW_MULTIPLE_NAKS_PER_FRAME
-                        pEndpoint->status.bfLastTransferNAKd = 0;
-                    #endif
-    
-                    pEndpoint = pEndpoint->next;
+                    pEndpoint->wIntervalCount--;
                 }
             }
-            
-            pInterface = pInterface->next;
+
+            #ifndef ALLOW_MULTIPLE_NAKS_PER_FRAME
+                pEndpoint->status.bfLastTransferNAKd = 0;
+            #endif
         }
 
         usbBusInfo.flags.bfControlTransfersDone     = 0;
@@ -5984,6 +7518,14 @@ void __ISR(_USB_1_VECTOR, ipl4) _USB1Interrupt(void)
         U1EIR = 0xFF;   // Clear the interrupts by writing '1' to the flags.
         U1IR = USB_INTERRUPT_ERROR; // Clear the interrupt by writing a '1' to the flag.
     }
+
+    #if defined( USB_HOST_MEASURE_ISR_TIME ) && defined( __PIC32MX__ )
+        isrTime = ReadCoreTimer() - isrTime;
+        if (isrTime > usbISRMaxTime)
+        {
+            usbISRMaxTime = isrTime;
+        }
+    #endif
 }
 
 
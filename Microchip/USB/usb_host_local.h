@@ -245,6 +245,21 @@ HOLDING state machine values
 #define TSUBSTATE_BULK_WRITE_DATA               0x0000  //
 #define TSUBSTATE_BULK_WRITE_COMPLETE           0x0001  //
 
+//******************************************************************************
+// Section: Bus Bandwidth Constants
+//******************************************************************************
+
+// Bus time is counted in full-speed byte times.  A low-speed byte takes 8 of
+// them.  The protocol overhead values are from the USB 2.0 specification,
+// sections 5.6.3 and 5.7.3.
+
+#define USB_FRAME_BYTES                         1500    // Byte times in a full-speed frame.
+#define USB_PERIODIC_FRAME_BYTES                1350    // Periodic transfers may use 90% of a frame.
+#define USB_ISOCHRONOUS_OVERHEAD_BYTES          9       // Protocol overhead of an isochronous transaction.
+#define USB_TRANSACTION_OVERHEAD_BYTES          13      // Protocol overhead of other transactions.
+#define USB_NON_PERIODIC_MAX_PACKET_SIZE        64      // Largest control or bulk packet at full speed.
+#define USB_SCHEDULE_FRAMES                     32      // Length of the reservation table.  Must be a power of 2.
+
 //******************************************************************************
 // Section: USB Peripheral Constants
 //******************************************************************************
@@ -403,6 +418,8 @@ typedef struct _USB_BUS_INFO
         WORD            val;                                //
     }                   flags;                              //
 //    volatile DWORD      dBytesSentInFrame;                  // The number of bytes sent during the current frame. Isochronous use only.
+    volatile WORD       wFrameBytes;                        // Bus time used in the current frame, including the periodic reservation.
+    volatile BYTE       bFrameIndex;                        // Current frame in the reservation table.
     volatile BYTE       lastBulkTransaction;                // The last bulk transaction sent.
     volatile BYTE       countBulkTransactions;              // The number of active bulk transactions.
 } USB_BUS_INFO;
@@ -419,6 +436,9 @@ typedef struct _USB_CONFIGURATION
     BYTE                        *descriptor;    // Complete Configuration Descriptor.
     struct _USB_CONFIGURATION   *next;          // Pointer to next node.
     BYTE                        configNumber;   // Number of this Configuration.
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+    DWORD                       dwHash;         // Hash of the Configuration Descriptor, to check a cached copy.
+#endif
 } USB_CONFIGURATION;
 
 
@@ -464,6 +484,8 @@ typedef struct _USB_ENDPOINT_INFO
     volatile BYTE               bErrorCode;                     // If bfError is set, this indicates the reason
     volatile WORD               countNAKs;                      // Count of NAK's of current transaction.
     WORD                        timeoutNAKs;                    // Count of NAK's for a timeout, if bfNAKTimeoutEnabled.
+    BYTE                        bSchedulePeriod;                // Frames between reserved transactions, or 0 if no bus time is reserved.
+    BYTE                        bSchedulePhase;                 // First reserved frame in the reservation table.
 
 } USB_ENDPOINT_INFO;
 
@@ -537,6 +559,42 @@ typedef struct _USB_DEVICE_INFO
 } USB_DEVICE_INFO;
 
 
+// *****************************************************************************
+/* USB Descriptor Cache
+
+This structure holds the descriptors and the interface list of the last
+device that was configured.  They are kept in the arena after the device is
+detached.  If the same device is attached again, its configuration
+descriptors are only checked against the cache instead of being read and
+parsed again.
+*/
+#if defined( USB_HOST_DESCRIPTOR_CACHE )
+    typedef struct _USB_DESCRIPTOR_CACHE
+    {
+        WORD                idVendor;                       // Vendor ID of the cached device.
+        WORD                idProduct;                      // Product ID of the cached device.
+        WORD                bcdDevice;                      // Device release number of the cached device.
+        BYTE                bNumConfigurations;             // Number of configurations of the cached device.
+        BYTE                requestedConfiguration;         // usbDeviceInfo.currentConfiguration when the configuration was selected.
+        WORD                arenaEnd;                       // Bytes of the arena that hold the cached data.
+        USB_CONFIGURATION   *pConfigurationDescriptorList;  // Cached list of Configuration Descriptors.
+        USB_CONFIGURATION   *pConfigurationNode;            // Configuration the interface list was parsed from.
+        USB_INTERFACE_INFO  *pInterfaceList;                // Cached list of interfaces.
+
+        union
+        {
+            struct
+            {
+                BYTE        bfValid                     : 1;    // The cache holds a device.
+                BYTE        bfChecking                  : 1;    // The attached device matches the cache.
+                BYTE        bfUsed                      : 1;    // The attached device was configured from the cache.
+            };
+            BYTE            val;
+        }                   flags;
+    } USB_DESCRIPTOR_CACHE;
+#endif
+
+
 // *****************************************************************************
 /* USB Root Hub Information
 
@@ -587,24 +645,74 @@ the client drivers.
 
 This structure defines the queue of USB events that can be generated by the
 ISR that need to be synchronized to the USB event tasks loop (see
-USB_EVENT_DATA, above).  See "struct_queue.h" for usage and operations.
+USB_EVENT_DATA, above).  See "spsc_queue.h" for usage and operations.  The
+ISR is the only producer and USBHostTasks() is the only consumer.
 */
 #if defined( USB_ENABLE_TRANSFER_EVENT )
     #ifndef USB_EVENT_QUEUE_DEPTH
         #define USB_EVENT_QUEUE_DEPTH   4       // Default depth of 4 events
     #endif
+    #if (USB_EVENT_QUEUE_DEPTH & (USB_EVENT_QUEUE_DEPTH - 1)) || (USB_EVENT_QUEUE_DEPTH > 128)
+        #error USB_EVENT_QUEUE_DEPTH must be a power of 2, up to 128
+    #endif
 
     typedef struct _usb_event_queue
     {
-        int             head;
-        int             tail;
-        int             count;
+        volatile BYTE   head;                               // Events added (written by the ISR only).
+        volatile BYTE   tail;                               // Events removed (written by USBHostTasks() only).
+        BYTE            highWater;                          // Most events that have been queued at once.
+        DWORD           overflows;                          // Events lost because the queue was full.
         USB_EVENT_DATA  buffer[USB_EVENT_QUEUE_DEPTH];
 
     } USB_EVENT_QUEUE;
 #endif
 
 
+// *****************************************************************************
+/* Control Request Queue
+
+This structure defines the queue of requests for EP0 that
+USBHostQueueDeviceRequest() adds and USBHostTasks() sends one after another.
+The request at the tail stays in the queue until its callback returns.  Data
+of up to USB_HOST_CONTROL_DATA_SIZE bytes is kept in the entry, so the caller
+does not have to keep a buffer for it.
+*/
+#if defined( USB_HOST_CONTROL_QUEUE_DEPTH )
+    #if (USB_HOST_CONTROL_QUEUE_DEPTH & (USB_HOST_CONTROL_QUEUE_DEPTH - 1)) || (USB_HOST_CONTROL_QUEUE_DEPTH > 128)
+        #error USB_HOST_CONTROL_QUEUE_DEPTH must be a power of 2, up to 128
+    #endif
+    #ifndef USB_HOST_CONTROL_DATA_SIZE
+        #define USB_HOST_CONTROL_DATA_SIZE  8       // Default of 8 bytes kept in each request
+    #endif
+
+    typedef struct _USB_CONTROL_REQUEST
+    {
+        BYTE                    deviceAddress;      // Device the request is for.
+        BYTE                    bmRequestType;      // Setup packet fields.
+        BYTE                    bRequest;
+        BYTE                    dataDirection;      // USB_DEVICE_REQUEST_SET or USB_DEVICE_REQUEST_GET
+        WORD                    wValue;
+        WORD                    wIndex;
+        WORD                    wLength;
+        BYTE                    *pUserData;         // Caller's data buffer, or NULL.
+        USB_CONTROL_CALLBACK    callback;           // Called when the request completes, or NULL.
+        void                    *context;           // Passed to the callback.
+        BYTE                    data[USB_HOST_CONTROL_DATA_SIZE];   // Data of short requests.
+    } USB_CONTROL_REQUEST;
+
+    typedef struct _usb_control_queue
+    {
+        volatile BYTE       head;                   // Requests added (written by USBHostQueueDeviceRequest() only).
+        volatile BYTE       tail;                   // Requests completed (written by USBHostTasks() only).
+        BYTE                highWater;              // Most requests that have been queued at once.
+        DWORD               overflows;              // Requests refused because the queue was full.
+        BYTE                bfIssued    : 1;        // The request at the tail has been sent on EP0.
+        BYTE                bfServicing : 1;        // _USB_ServiceControlQueue() is running.
+        USB_CONTROL_REQUEST buffer[USB_HOST_CONTROL_QUEUE_DEPTH];
+    } USB_CONTROL_QUEUE;
+#endif
+
+
 /********************************************************************
  * USB Endpoint Control Registers
  *******************************************************************/
@@ -641,13 +749,18 @@ USB_EVENT_DATA, above).  See "struct_queue.h" for usage and operations.
 //******************************************************************************
 //******************************************************************************
 
+void *               _USB_ArenaAlloc( WORD size );
+void                 _USB_BuildActiveEndpointLists( void );
 void                 _USB_CheckCommandAndEnumerationAttempts( void );
+void                 _USB_DeliverIsochronousData( HOST_TRANSFER_DATA *pTransfer );
+DWORD                _USB_DescriptorHash( BYTE *pDescriptor, WORD length );
 BOOL                 _USB_FindClassDriver( BYTE bClass, BYTE bSubClass, BYTE bProtocol, BYTE *pbClientDrv );
 BOOL                 _USB_FindDeviceLevelClientDriver( void );
 USB_ENDPOINT_INFO *  _USB_FindEndpoint( BYTE endpoint );
 USB_INTERFACE_INFO * _USB_FindInterface ( BYTE bInterface, BYTE bAltSetting );
 void                 _USB_FindNextToken( void );
 BOOL                 _USB_FindServiceEndpoint( BYTE transferType );
+void                 _USB_FlushControlQueue( void );
 void                 _USB_FreeConfigMemory( void );
 void                 _USB_FreeMemory( void );
 void                 _USB_InitControlRead( USB_ENDPOINT_INFO *pEndpoint, BYTE *pControlData, WORD controlSize,
@@ -658,10 +771,15 @@ void                 _USB_InitRead( USB_ENDPOINT_INFO *pEndpoint, BYTE *pData, W
 void                 _USB_InitWrite( USB_ENDPOINT_INFO *pEndpoint, BYTE *pData, WORD size );
 void                 _USB_NotifyClients( BYTE DevAddress, USB_EVENT event, void *data, unsigned int size );
 BOOL                 _USB_ParseConfigurationDescriptor( void );
+void                 _USB_PrearmIsochronousRead( void );
 void                 _USB_ResetDATA0( BYTE endpoint );
+BOOL                 _USB_ScheduleBandwidth( USB_INTERFACE_INFO *pChangedInterface, USB_INTERFACE_SETTING_INFO *pNewSetting );
 void                 _USB_SendToken( BYTE endpoint, BYTE tokenType );
+void                 _USB_ServiceControlQueue( void );
 void                 _USB_SetBDT( BYTE  direction );
+WORD                 _USB_TransactionBytes( USB_ENDPOINT_INFO *pEndpoint );
 BOOL                 _USB_TransferInProgress( void );
+BOOL                 _USB_UseCachedConfiguration( void );
 
 
 #endif // _USB_HOST_LOCAL_
@@ -47,6 +47,7 @@
 #define BAUDRATE2       57600 //19200
 #define BRG_DIV2        4 //16
 #define BRGH2           1 //0
+#define UART2_TX_BUFFER_SIZE    2048    // Send from the UART2 interrupt, so logging does not stall USB
 
 #define DEMO_TIMEOUT_LIMIT  0xF000
 
@@ -0,0 +1,329 @@
+/******************************************************************************
+            JPEG frame pool
+
+This file provides a fixed pool of frame buffers for the captured MJPEG
+frames.  FramePoolPayload() is called by the USB side for each isochronous
+packet, and the application takes the completed frames with
+FramePoolGetReady() and gives them back with FramePoolRelease().
+
+******************************************************************************/
+
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "frame_pool.h"
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static void _FramePoolEndFrame( FRAME_POOL *pool )
+
+  Description:
+    This function completes the buffer being filled.  A good frame is made
+    READY, and a frame that did not fit or had a stream error is dropped.
+
+  Precondition:
+    The frame assembler has just completed a frame.
+
+  Parameters:
+    FRAME_POOL *pool    - Frame pool
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static void _FramePoolEndFrame( FRAME_POOL *pool )
+{
+    FRAME_BUFFER    *frame = pool->pFilling;
+
+    if (frame == NULL)
+    {
+        return;
+    }
+    pool->pFilling = NULL;
+
+    if (pool->bfOverflow)
+    {
+        pool->overflowFrames++;
+        frame->state = FRAME_BUFFER_FREE;
+    }
+    else if (pool->uvc.lastFrame.bfError)
+    {
+        pool->errorFrames++;
+        frame->state = FRAME_BUFFER_FREE;
+    }
+    else
+    {
+        frame->info     = pool->uvc.lastFrame;
+        frame->sequence = pool->sequence++;
+        pool->readyFrames++;
+        frame->state    = FRAME_BUFFER_READY;
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    static void _FramePoolStartFrame( FRAME_POOL *pool )
+
+  Description:
+    This function takes a buffer for the frame that has just started.  A
+    free buffer is taken if there is one.  Otherwise the oldest ready frame
+    is dropped and its buffer is reused, so the application always gets the
+    latest frames.  If there is no such buffer either, the new frame is
+    dropped.
+
+  Precondition:
+    None
+
+  Parameters:
+    FRAME_POOL *pool    - Frame pool
+
+  Returns:
+    None
+
+  Remarks:
+    The ready frame that FramePoolGetReady() is taking, pTaking, is not
+    reused.
+  ***************************************************************************/
+
+static void _FramePoolStartFrame( FRAME_POOL *pool )
+{
+    FRAME_BUFFER    *frame;
+    BYTE            i;
+
+    pool->bfOverflow = 0;
+    frame = NULL;
+    for (i = 0; i < FRAME_POOL_COUNT; i++)
+    {
+        if (pool->frames[i].state == FRAME_BUFFER_FREE)
+        {
+            frame = &pool->frames[i];
+            break;
+        }
+        if ((pool->frames[i].state == FRAME_BUFFER_READY) && (&pool->frames[i] != pool->pTaking))
+        {
+            if ((frame == NULL) || ((LONG)(pool->frames[i].sequence - frame->sequence) < 0))
+            {
+                frame = &pool->frames[i];
+            }
+        }
+    }
+    if (frame == NULL)
+    {
+        pool->droppedFrames++;
+        return;
+    }
+    if (frame->state == FRAME_BUFFER_READY)
+    {
+        pool->droppedFrames++;
+    }
+
+    pool->pFilling         = frame;
+    pool->pFilling->length = 0;
+    pool->pFilling->state  = FRAME_BUFFER_FILLING;
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    void FramePoolInit( FRAME_POOL *pool )
+
+  Description:
+    This function frees all of the frame buffers and initializes the frame
+    assembler.
+
+  Precondition:
+    The USB side is not calling FramePoolPayload().
+
+  Parameters:
+    FRAME_POOL *pool    - Frame pool
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+void FramePoolInit( FRAME_POOL *pool )
+{
+    BYTE    i;
+
+    for (i = 0; i < FRAME_POOL_COUNT; i++)
+    {
+        pool->frames[i].length = 0;
+        pool->frames[i].state  = FRAME_BUFFER_FREE;
+    }
+    UVCStreamInit( &pool->uvc );
+    pool->pFilling       = NULL;
+    pool->pTaking        = NULL;
+    pool->sequence       = 0;
+    pool->readyFrames    = 0;
+    pool->droppedFrames  = 0;
+    pool->overflowFrames = 0;
+    pool->errorFrames    = 0;
+    pool->bfOverflow     = 0;
+}
+
+
+/****************************************************************************
+  Function:
+    void FramePoolPayload( FRAME_POOL *pool, BYTE *data, WORD length )
+
+  Description:
+    This function passes one isochronous packet to the frame pool.  The
+    payload data is copied to the buffer being filled, and the buffer is
+    made READY when the frame is complete.
+
+  Precondition:
+    FramePoolInit() has been called.
+
+  Parameters:
+    FRAME_POOL *pool    - Frame pool
+    BYTE *data          - Received packet, starting with the payload header
+    WORD length         - Length of the received packet
+
+  Returns:
+    None
+
+  Remarks:
+    This function is the producer side of the pool.  It is called from the
+    data event handler, in the USB interrupt.
+  ***************************************************************************/
+
+void FramePoolPayload( FRAME_POOL *pool, BYTE *data, WORD length )
+{
+    BYTE    *payload;
+    WORD    payloadLength;
+    BYTE    result;
+
+    result = UVCStreamPayload( &pool->uvc, data, length, &payload, &payloadLength );
+
+    // When both are set, the end belongs to the previous frame.
+    if ((result & UVC_STREAM_FRAME_START) && (result & UVC_STREAM_FRAME_END))
+    {
+        _FramePoolEndFrame( pool );
+    }
+    if (result & UVC_STREAM_FRAME_START)
+    {
+        _FramePoolStartFrame( pool );
+    }
+
+    if ((result & UVC_STREAM_FRAME_DATA) && (pool->pFilling != NULL) && !pool->bfOverflow)
+    {
+        if (pool->pFilling->length + payloadLength > FRAME_POOL_SIZE)
+        {
+            pool->bfOverflow = 1;
+        }
+        else
+        {
+            memcpy( pool->pFilling->data + pool->pFilling->length, payload, payloadLength );
+            pool->pFilling->length += payloadLength;
+        }
+    }
+
+    if ((result & UVC_STREAM_FRAME_END) && !(result & UVC_STREAM_FRAME_START))
+    {
+        _FramePoolEndFrame( pool );
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    FRAME_BUFFER * FramePoolGetReady( FRAME_POOL *pool )
+
+  Description:
+    This function takes the oldest complete frame from the pool.
+
+  Precondition:
+    FramePoolInit() has been called.
+
+  Parameters:
+    FRAME_POOL *pool    - Frame pool
+
+  Returns:
+    The frame buffer, or NULL if no frame is ready.  The buffer belongs to
+    the application until FramePoolRelease() is called.
+
+  Remarks:
+    The USB side may reuse a ready buffer for a new frame at any time.  The
+    buffer is therefore marked in pTaking before it is checked again and
+    made IN_USE.  If the USB side took it first, the search is repeated.
+  ***************************************************************************/
+
+FRAME_BUFFER * FramePoolGetReady( FRAME_POOL *pool )
+{
+    FRAME_BUFFER    *frame;
+    BYTE            i;
+
+    do
+    {
+        frame = NULL;
+        for (i = 0; i < FRAME_POOL_COUNT; i++)
+        {
+            if (pool->frames[i].state == FRAME_BUFFER_READY)
+            {
+                if ((frame == NULL) || ((LONG)(pool->frames[i].sequence - frame->sequence) < 0))
+                {
+                    frame = &pool->frames[i];
+                }
+            }
+        }
+        if (frame == NULL)
+        {
+            return NULL;
+        }
+
+        pool->pTaking = frame;
+        if (frame->state == FRAME_BUFFER_READY)
+        {
+            frame->state = FRAME_BUFFER_IN_USE;
+        }
+        pool->pTaking = NULL;
+    } while (frame->state != FRAME_BUFFER_IN_USE);
+
+    return frame;
+}
+
+
+/****************************************************************************
+  Function:
+    void FramePoolRelease( FRAME_POOL *pool, FRAME_BUFFER *frame )
+
+  Description:
+    This function gives a frame buffer back to the pool.
+
+  Precondition:
+    The buffer has been taken with FramePoolGetReady().
+
+  Parameters:
+    FRAME_POOL *pool        - Frame pool
+    FRAME_BUFFER *frame     - Frame buffer to release
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+void FramePoolRelease( FRAME_POOL *pool, FRAME_BUFFER *frame )
+{
+    frame->state = FRAME_BUFFER_FREE;
+}
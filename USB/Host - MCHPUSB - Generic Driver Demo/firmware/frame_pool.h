@@ -0,0 +1,127 @@
+/******************************************************************************
+            JPEG frame pool
+
+This file provides a fixed pool of frame buffers for the captured MJPEG
+frames.  The USB interrupt fills one buffer while the application decodes or
+sends another, so the capture keeps running at the negotiated frame rate.
+
+******************************************************************************/
+
+#ifndef _FRAME_POOL_H
+#define _FRAME_POOL_H
+
+#include "GenericTypeDefs.h"
+#include "uvc_stream.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Configuration
+// *****************************************************************************
+// *****************************************************************************
+
+// Number of frame buffers.  Two lets the USB side fill one frame while the
+// application decodes and sends another.  While the application is busy,
+// each new frame replaces the ready one, so the application gets the latest
+// frame when it is done, or the one being filled at that moment.  A third
+// buffer would always have a complete frame waiting, but see
+// FRAME_POOL_RAM_LIMIT.
+#ifndef FRAME_POOL_COUNT
+    #define FRAME_POOL_COUNT        2
+#endif
+
+// Size of each frame buffer, in bytes.  Frames that do not fit are dropped.
+// 40 KB is the size of the single frame buffer that the pool replaced, so
+// every frame that fitted before still fits.
+#ifndef FRAME_POOL_SIZE
+    #define FRAME_POOL_SIZE         (40 * 1024)
+#endif
+
+// RAM that the frame pool may use.  The PIC32MX795 has 128 KB of RAM, and
+// the rest of the demo needs about 38 KB of it: the 16 KB heap that holds
+// the isochronous buffers, the 8 KB TJpgDec work area, the 6 KB USB arena,
+// the 2 KB UART2 transmit buffer, the 2 KB UVC descriptor table and the
+// stack.  Three 40 KB buffers do not fit, so a third buffer is traded for
+// frames of the full size.
+#ifndef FRAME_POOL_RAM_LIMIT
+    #define FRAME_POOL_RAM_LIMIT    (88 * 1024)
+#endif
+
+#if (FRAME_POOL_COUNT * FRAME_POOL_SIZE) > FRAME_POOL_RAM_LIMIT
+    #error "The frame pool does not fit in RAM.  Reduce FRAME_POOL_COUNT or FRAME_POOL_SIZE."
+#endif
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// *****************************************************************************
+/* Frame Buffer States
+
+The USB side moves a buffer from FREE or READY to FILLING, and from FILLING
+to READY or FREE.  The application moves it from READY to IN_USE and from
+IN_USE to FREE.  READY is the only state both sides change.  The
+application sets pTaking to the buffer before it makes it IN_USE, and the
+USB side does not reuse that buffer, so no locking is needed.
+*/
+
+typedef enum
+{
+    FRAME_BUFFER_FREE = 0,      // Available for a new frame.
+    FRAME_BUFFER_FILLING,       // Being filled by the USB side.
+    FRAME_BUFFER_READY,         // Holds a complete frame.
+    FRAME_BUFFER_IN_USE         // Being used by the application.
+} FRAME_BUFFER_STATE;
+
+
+// *****************************************************************************
+/* Frame Buffer
+
+This structure holds one captured frame.
+*/
+
+typedef struct _FRAME_BUFFER
+{
+    BYTE            data[FRAME_POOL_SIZE];  // Frame data, without the payload headers.
+    DWORD           length;                 // Bytes of frame data.
+    DWORD           sequence;               // Order in which the frames were completed.
+    UVC_FRAME_INFO  info;                   // Frame information from the payload headers.
+    volatile BYTE   state;                  // FRAME_BUFFER_STATE
+} FRAME_BUFFER;
+
+
+// *****************************************************************************
+/* Frame Pool
+
+This structure holds the frame buffers and the frame assembler that fills
+them.
+*/
+
+typedef struct _FRAME_POOL
+{
+    FRAME_BUFFER    frames[FRAME_POOL_COUNT];   // Frame buffers.
+    UVC_STREAM      uvc;                        // Frame assembler of the payloads.
+    FRAME_BUFFER    *pFilling;                  // Buffer being filled, or NULL.
+    FRAME_BUFFER * volatile pTaking;            // Ready buffer the application is taking, or NULL.
+    DWORD           sequence;                   // Sequence number of the next frame.
+    DWORD           readyFrames;                // Frames completed into the pool.
+    DWORD           droppedFrames;              // Frames dropped for a newer one, or because no buffer was free.
+    DWORD           overflowFrames;             // Frames dropped because they were too big.
+    DWORD           errorFrames;                // Frames dropped because of stream errors.
+    BYTE            bfOverflow : 1;             // The frame being filled did not fit.
+} FRAME_POOL;
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+void FramePoolInit( FRAME_POOL *pool );
+void FramePoolPayload( FRAME_POOL *pool, BYTE *data, WORD length );
+FRAME_BUFFER * FramePoolGetReady( FRAME_POOL *pool );
+void FramePoolRelease( FRAME_POOL *pool, FRAME_BUFFER *frame );
+
+#endif
@@ -0,0 +1,317 @@
+/******************************************************************************
+            JPEG frame upload
+
+This file sends captured JPEG frames over UART2 with the binary packet
+protocol described in frame_upload.h.  Packets are only written when the
+UART2 transmit ring buffer has room for the whole packet, so a frame is sent
+a few packets at a time from the main loop without stalling USB.
+
+******************************************************************************/
+
+#include "GenericTypeDefs.h"
+#include "HardwareProfile.h"
+#include "frame_upload.h"
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static void _FrameUploadByte( FRAME_UPLOAD *upload, BYTE data )
+
+  Description:
+    This function sends one byte of a packet, and adds it to the packet CRC.
+
+  Precondition:
+    None
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+    BYTE data               - Byte to send
+
+  Returns:
+    None
+
+  Remarks:
+    The CRC is CRC-16/CCITT, polynomial 0x1021, MSB first.
+  ***************************************************************************/
+
+static void _FrameUploadByte( FRAME_UPLOAD *upload, BYTE data )
+{
+    BYTE    i;
+
+    upload->crc ^= (WORD)data << 8;
+    for (i = 0; i < 8; i++)
+    {
+        if (upload->crc & 0x8000)
+        {
+            upload->crc = (upload->crc << 1) ^ 0x1021;
+        }
+        else
+        {
+            upload->crc <<= 1;
+        }
+    }
+    UART2PutChar( data );
+}
+
+
+/****************************************************************************
+  Function:
+    static void _FrameUploadDWord( FRAME_UPLOAD *upload, DWORD data )
+
+  Description:
+    This function sends a DWORD of a packet, little endian.
+
+  Precondition:
+    None
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+    DWORD data              - Value to send
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static void _FrameUploadDWord( FRAME_UPLOAD *upload, DWORD data )
+{
+    _FrameUploadByte( upload, (BYTE)data );
+    _FrameUploadByte( upload, (BYTE)(data >> 8) );
+    _FrameUploadByte( upload, (BYTE)(data >> 16) );
+    _FrameUploadByte( upload, (BYTE)(data >> 24) );
+}
+
+
+/****************************************************************************
+  Function:
+    static void _FrameUploadBegin( FRAME_UPLOAD *upload, BYTE type,
+                WORD length )
+
+  Description:
+    This function sends the header of a packet.
+
+  Precondition:
+    None
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+    BYTE type               - FRAME_UPLOAD_TYPE_xxx
+    WORD length             - Payload length
+
+  Returns:
+    None
+
+  Remarks:
+    The sync bytes are not part of the CRC.
+  ***************************************************************************/
+
+static void _FrameUploadBegin( FRAME_UPLOAD *upload, BYTE type, WORD length )
+{
+    UART2PutChar( FRAME_UPLOAD_SYNC0 );
+    UART2PutChar( FRAME_UPLOAD_SYNC1 );
+
+    upload->crc = 0xFFFF;
+    _FrameUploadByte( upload, type );
+    _FrameUploadByte( upload, upload->packetSequence++ );
+    _FrameUploadByte( upload, (BYTE)upload->frameNumber );
+    _FrameUploadByte( upload, (BYTE)(upload->frameNumber >> 8) );
+    _FrameUploadByte( upload, (BYTE)length );
+    _FrameUploadByte( upload, (BYTE)(length >> 8) );
+}
+
+
+/****************************************************************************
+  Function:
+    static void _FrameUploadEnd( FRAME_UPLOAD *upload )
+
+  Description:
+    This function sends the CRC that ends a packet.
+
+  Precondition:
+    _FrameUploadBegin() and the payload have been sent.
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static void _FrameUploadEnd( FRAME_UPLOAD *upload )
+{
+    WORD    crc = upload->crc;
+
+    UART2PutChar( (BYTE)crc );
+    UART2PutChar( (BYTE)(crc >> 8) );
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    void FrameUploadInit( FRAME_UPLOAD *upload )
+
+  Description:
+    This function initializes the upload information.
+
+  Precondition:
+    None
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+void FrameUploadInit( FRAME_UPLOAD *upload )
+{
+    upload->pFrame          = NULL;
+    upload->offset          = 0;
+    upload->frameCount      = 0;
+    upload->frameNumber     = 0;
+    upload->crc             = 0;
+    upload->packetSequence  = 0;
+    upload->bfStartSent     = 0;
+}
+
+
+/****************************************************************************
+  Function:
+    void FrameUploadStart( FRAME_UPLOAD *upload, FRAME_BUFFER *frame )
+
+  Description:
+    This function starts sending a frame.  The packets are sent by
+    FrameUploadTasks().
+
+  Precondition:
+    No frame is being sent.
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+    FRAME_BUFFER *frame     - Frame to send
+
+  Returns:
+    None
+
+  Remarks:
+    The frame buffer must not be released until FrameUploadTasks() returns
+    TRUE.
+  ***************************************************************************/
+
+void FrameUploadStart( FRAME_UPLOAD *upload, FRAME_BUFFER *frame )
+{
+    upload->pFrame      = frame;
+    upload->offset      = 0;
+    upload->bfStartSent = 0;
+    upload->frameNumber++;
+}
+
+
+/****************************************************************************
+  Function:
+    BOOL FrameUploadTasks( FRAME_UPLOAD *upload )
+
+  Description:
+    This function sends the next packets of the frame, as many as the
+    UART2 transmit ring buffer has room for.
+
+  Precondition:
+    FrameUploadInit() has been called.
+
+  Parameters:
+    FRAME_UPLOAD *upload    - Upload information
+
+  Return Values:
+    TRUE    - No frame is being sent.  The last frame has been completed.
+    FALSE   - The frame is still being sent.
+
+  Remarks:
+    Without UART2_TX_BUFFER_SIZE, each call sends one packet and waits for
+    it to go out.
+  ***************************************************************************/
+
+BOOL FrameUploadTasks( FRAME_UPLOAD *upload )
+{
+    FRAME_BUFFER    *frame;
+    WORD            chunk;
+    WORD            i;
+
+    frame = upload->pFrame;
+    if (frame == NULL)
+    {
+        return TRUE;
+    }
+
+    while (1)
+    {
+        chunk = 0;
+        if (upload->bfStartSent && (upload->offset < frame->length))
+        {
+            chunk = FRAME_UPLOAD_CHUNK_SIZE;
+            if (chunk > frame->length - upload->offset)
+            {
+                chunk = frame->length - upload->offset;
+            }
+        }
+
+        #if defined (UART2_TX_BUFFER_SIZE) && defined (__PIC32MX__)
+            // The START payload is 8 bytes, and a DATA payload is 4 + chunk.
+            if (UART2TxFree() < FRAME_UPLOAD_HEADER_SIZE + (upload->bfStartSent ? 4 + chunk : 8) + FRAME_UPLOAD_CRC_SIZE)
+            {
+                return FALSE;
+            }
+        #endif
+
+        if (!upload->bfStartSent)
+        {
+            _FrameUploadBegin( upload, FRAME_UPLOAD_TYPE_START, 8 );
+            _FrameUploadDWord( upload, frame->length );
+            _FrameUploadDWord( upload, frame->info.dwPresentationTime );
+            _FrameUploadEnd( upload );
+            upload->bfStartSent = 1;
+        }
+        else if (chunk != 0)
+        {
+            _FrameUploadBegin( upload, FRAME_UPLOAD_TYPE_DATA, 4 + chunk );
+            _FrameUploadDWord( upload, upload->offset );
+            for (i = 0; i < chunk; i++)
+            {
+                _FrameUploadByte( upload, frame->data[upload->offset + i] );
+            }
+            _FrameUploadEnd( upload );
+            upload->offset += chunk;
+        }
+        else
+        {
+            _FrameUploadBegin( upload, FRAME_UPLOAD_TYPE_END, 0 );
+            _FrameUploadEnd( upload );
+            upload->pFrame = NULL;
+            upload->frameCount++;
+            return TRUE;
+        }
+
+        #if !defined (UART2_TX_BUFFER_SIZE) || !defined (__PIC32MX__)
+            return FALSE;
+        #endif
+    }
+}
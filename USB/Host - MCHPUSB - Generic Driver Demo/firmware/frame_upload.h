@@ -0,0 +1,103 @@
+/******************************************************************************
+            JPEG frame upload
+
+This file provides a binary protocol for sending captured JPEG frames over
+UART2.  Each frame is split into packets with a sync pattern, a packet
+sequence number, a length and a CRC, so the receiver can find the packets
+between the text log lines and detect lost or broken data.
+
+Packet layout (multi-byte fields are little endian):
+
+    offset  size    field
+    0       2       Sync, FRAME_UPLOAD_SYNC0 FRAME_UPLOAD_SYNC1
+    2       1       Packet type, FRAME_UPLOAD_TYPE_xxx
+    3       1       Packet sequence number, incremented for each packet
+    4       2       Frame number
+    6       2       Payload length (n)
+    8       n       Payload
+    8+n     2       CRC-16/CCITT (0x1021, initial 0xFFFF) of bytes 2 to 8+n-1
+
+Payloads:
+
+    START   DWORD frame length, DWORD presentation time (PTS)
+    DATA    DWORD offset of the data in the frame, then the data
+    END     None
+
+******************************************************************************/
+
+#ifndef _FRAME_UPLOAD_H
+#define _FRAME_UPLOAD_H
+
+#include "GenericTypeDefs.h"
+#include "HardwareProfile.h"
+#include "frame_pool.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define FRAME_UPLOAD_SYNC0          0xA5
+#define FRAME_UPLOAD_SYNC1          0x5A
+
+#define FRAME_UPLOAD_TYPE_START     0x01    // Frame length and PTS
+#define FRAME_UPLOAD_TYPE_DATA      0x02    // Frame data
+#define FRAME_UPLOAD_TYPE_END       0x03    // The whole frame has been sent
+
+#define FRAME_UPLOAD_HEADER_SIZE    8       // Sync to payload length
+#define FRAME_UPLOAD_CRC_SIZE       2
+
+// Frame data bytes in each DATA packet.
+#ifndef FRAME_UPLOAD_CHUNK_SIZE
+    #define FRAME_UPLOAD_CHUNK_SIZE 256
+#endif
+
+// Largest packet, in bytes.
+#define FRAME_UPLOAD_PACKET_SIZE    (FRAME_UPLOAD_HEADER_SIZE + 4 + FRAME_UPLOAD_CHUNK_SIZE + FRAME_UPLOAD_CRC_SIZE)
+
+// FrameUploadTasks() waits until a whole packet fits in the UART2 transmit
+// buffer, so a smaller buffer would stop the upload for good.
+#if defined (UART2_TX_BUFFER_SIZE) && defined (__PIC32MX__)
+    #if (UART2_TX_BUFFER_SIZE < FRAME_UPLOAD_PACKET_SIZE)
+        #error "UART2_TX_BUFFER_SIZE must hold FRAME_UPLOAD_PACKET_SIZE bytes.  Reduce FRAME_UPLOAD_CHUNK_SIZE."
+    #endif
+#endif
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// *****************************************************************************
+/* Frame Upload
+
+This structure holds the progress of the frame being sent.
+*/
+
+typedef struct _FRAME_UPLOAD
+{
+    FRAME_BUFFER    *pFrame;            // Frame being sent, or NULL.
+    DWORD           offset;             // Next frame byte to send.
+    DWORD           frameCount;         // Frames sent.
+    WORD            frameNumber;        // Frame number of the frame being sent.
+    WORD            crc;                // CRC of the packet being sent.
+    BYTE            packetSequence;     // Sequence number of the next packet.
+    BYTE            bfStartSent : 1;    // The START packet of the frame has been sent.
+} FRAME_UPLOAD;
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+void FrameUploadInit( FRAME_UPLOAD *upload );
+void FrameUploadStart( FRAME_UPLOAD *upload, FRAME_BUFFER *frame );
+BOOL FrameUploadTasks( FRAME_UPLOAD *upload );
+
+#define FrameUploadIsBusy( upload )     ((upload)->pFrame != NULL)
+
+#endif
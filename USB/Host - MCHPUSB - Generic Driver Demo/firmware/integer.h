@@ -10,6 +10,14 @@
 #include <windows.h>
 #include <tchar.h>
 
+#elif defined(__GENERIC_TYPE_DEFS_H_)	/* Microchip Application Libraries */
+
+/* Use the types in GenericTypeDefs.h and add the ones it does not have */
+typedef unsigned char	UCHAR;
+typedef unsigned short	USHORT;
+typedef unsigned short	WCHAR;
+typedef unsigned long	ULONG;
+
 #else			/* Embedded platform */
 
 /* These types must be 16-bit, 32-bit or larger integer */
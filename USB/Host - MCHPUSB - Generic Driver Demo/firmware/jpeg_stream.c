@@ -0,0 +1,366 @@
+/******************************************************************************
+            JPEG stream input
+
+This file provides a TJpgDec input function that reads the MJPEG payload
+directly from the isochronous data buffers.  The buffers are filled by the
+USB interrupt, and are released back to the stack as soon as their payload
+has been passed to the decoder.
+
+******************************************************************************/
+
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "usb_config.h"
+#include "USB/usb.h"
+#include "USB/usb_host_generic.h"
+#include "jpeg_stream.h"
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static void _JpegStreamRelease( JPEG_STREAM *stream )
+
+  Description:
+    This function gives the buffer held by the stream input back to the
+    USB stack, and moves to the next buffer.
+
+  Precondition:
+    None
+
+  Parameters:
+    JPEG_STREAM *stream - Stream information
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static void _JpegStreamRelease( JPEG_STREAM *stream )
+{
+    ISOCHRONOUS_DATA *isoc = stream->pIsocData;
+
+    if (stream->bfReading)
+    {
+        isoc->buffers[isoc->currentBufferUser].bfDataLengthValid = 0;
+        isoc->currentBufferUser++;
+        if (isoc->currentBufferUser >= isoc->totalBuffers)
+        {
+            isoc->currentBufferUser = 0;
+        }
+        stream->bfReading = 0;
+    }
+    stream->dataLeft = 0;
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL _JpegStreamNextPayload( JPEG_STREAM *stream, BOOL wait,
+                BYTE *result )
+
+  Description:
+    This function releases the current buffer and passes the next buffers to
+    the frame assembler, until one of them starts or ends a frame or holds
+    frame data.  The read position is set at its payload data.
+
+  Precondition:
+    None
+
+  Parameters:
+    JPEG_STREAM *stream - Stream information
+    BOOL wait           - Wait for the next buffer to be filled
+    BYTE *result        - UVC_STREAM_xxx bits from UVCStreamPayload()
+
+  Return Values:
+    TRUE    - A payload is ready
+    FALSE   - No buffer is available, or the device has been detached
+
+  Remarks:
+    While waiting, USBHostTasks() is called so the event queue keeps being
+    serviced.
+  ***************************************************************************/
+
+static BOOL _JpegStreamNextPayload( JPEG_STREAM *stream, BOOL wait, BYTE *result )
+{
+    ISOCHRONOUS_DATA        *isoc = stream->pIsocData;
+    ISOCHRONOUS_DATA_BUFFER *buffer;
+
+    _JpegStreamRelease( stream );
+
+    while (1)
+    {
+        buffer = &isoc->buffers[isoc->currentBufferUser];
+        if (!buffer->bfDataLengthValid)
+        {
+            if (!wait || USBHostGenericDeviceDetached( stream->deviceAddress ))
+            {
+                return FALSE;
+            }
+            USBHostTasks();
+            continue;
+        }
+
+        stream->bfReading = 1;
+        *result = UVCStreamPayload( &stream->uvc, buffer->pBuffer, buffer->dataLength,
+                        &stream->pData, &stream->dataLeft );
+        if (*result & (UVC_STREAM_FRAME_START | UVC_STREAM_FRAME_END | UVC_STREAM_FRAME_DATA))
+        {
+            return TRUE;
+        }
+        _JpegStreamRelease( stream );
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL _JpegStreamFrameEnded( JPEG_STREAM *stream )
+
+  Description:
+    This function checks if the frame being read has been completed by the
+    frame assembler.
+
+  Precondition:
+    None
+
+  Parameters:
+    JPEG_STREAM *stream - Stream information
+
+  Return Values:
+    TRUE    - The current payload is the last one of the frame
+    FALSE   - More payloads of the frame will follow
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static BOOL _JpegStreamFrameEnded( JPEG_STREAM *stream )
+{
+    return !stream->uvc.bfInFrame || stream->uvc.bfEndPending;
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    void JpegStreamInit( JPEG_STREAM *stream, BYTE deviceAddress,
+                ISOCHRONOUS_DATA *isocData )
+
+  Description:
+    This function initializes the stream information.
+
+  Precondition:
+    None
+
+  Parameters:
+    JPEG_STREAM *stream         - Stream information
+    BYTE deviceAddress          - Address of the camera
+    ISOCHRONOUS_DATA *isocData  - Isochronous data buffers of the video
+                                    streaming endpoint
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+void JpegStreamInit( JPEG_STREAM *stream, BYTE deviceAddress, ISOCHRONOUS_DATA *isocData )
+{
+    stream->pIsocData     = isocData;
+    stream->pData         = NULL;
+    stream->dataLeft      = 0;
+    stream->deviceAddress = deviceAddress;
+    stream->bfEndOfFrame  = 0;
+    stream->bfReading     = 0;
+    stream->bfPending     = 0;
+    UVCStreamInit( &stream->uvc );
+}
+
+
+/****************************************************************************
+  Function:
+    BOOL JpegStreamStart( JPEG_STREAM *stream )
+
+  Description:
+    This function looks for the start of a JPEG frame in the isochronous
+    data buffers.  Payloads that are not the first of a frame, or do not
+    start with an SOI marker, are released.
+
+  Precondition:
+    JpegStreamInit() has been called.
+
+  Parameters:
+    JPEG_STREAM *stream - Stream information
+
+  Return Values:
+    TRUE    - A frame has started.  Call jd_prepare() with JpegStreamInput().
+    FALSE   - No frame start in the received data yet.
+
+  Remarks:
+    This function does not wait for data.
+  ***************************************************************************/
+
+BOOL JpegStreamStart( JPEG_STREAM *stream )
+{
+    BYTE    result;
+
+    if (stream->bfPending)
+    {
+        // The previous frame was cut short by this one.
+        stream->bfPending = 0;
+        result = UVC_STREAM_FRAME_START;
+    }
+    else if (!_JpegStreamNextPayload( stream, FALSE, &result ))
+    {
+        return FALSE;
+    }
+
+    while (1)
+    {
+        if ((result & UVC_STREAM_FRAME_START) && (stream->dataLeft >= 2) &&
+            (stream->pData[0] == 0xFF) && (stream->pData[1] == 0xD8))
+        {
+            stream->bfEndOfFrame = _JpegStreamFrameEnded( stream );
+            return TRUE;
+        }
+        if (!_JpegStreamNextPayload( stream, FALSE, &result ))
+        {
+            return FALSE;
+        }
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    void JpegStreamEnd( JPEG_STREAM *stream )
+
+  Description:
+    This function skips the rest of the frame, and gives the buffer held by
+    the stream input back to the USB stack.  Call it after the decoder has
+    finished with the frame.
+
+  Precondition:
+    None
+
+  Parameters:
+    JPEG_STREAM *stream - Stream information
+
+  Returns:
+    None
+
+  Remarks:
+    The information of the frame is in stream->uvc.lastFrame when this
+    function returns, unless the device has been detached.  If the next
+    frame has already started, its first buffer is kept for
+    JpegStreamStart().
+  ***************************************************************************/
+
+void JpegStreamEnd( JPEG_STREAM *stream )
+{
+    BYTE    result;
+
+    while (!stream->bfEndOfFrame && !stream->bfPending)
+    {
+        if (!_JpegStreamNextPayload( stream, TRUE, &result ))
+        {
+            break;
+        }
+        if (result & UVC_STREAM_FRAME_START)
+        {
+            stream->bfPending = 1;
+            break;
+        }
+        stream->bfEndOfFrame = _JpegStreamFrameEnded( stream );
+    }
+
+    if (!stream->bfPending)
+    {
+        _JpegStreamRelease( stream );
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    UINT JpegStreamInput( JDEC *jd, BYTE *buff, UINT nbyte )
+
+  Description:
+    This is the TJpgDec input function.  It copies the payload of the
+    current frame to the decoder's input buffer, moving through the
+    isochronous data buffers as they are filled.
+
+  Precondition:
+    JpegStreamStart() has returned TRUE, and the JPEG_STREAM has been passed
+    to jd_prepare() as the device identifier.
+
+  Parameters:
+    JDEC *jd    - Decompressor object
+    BYTE *buff  - Destination buffer, or NULL to skip the data
+    UINT nbyte  - Number of bytes to read
+
+  Returns:
+    Number of bytes read.  It is less than nbyte if the frame has ended,
+    a new frame has started, or the device has been detached.
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+UINT JpegStreamInput( JDEC *jd, BYTE *buff, UINT nbyte )
+{
+    JPEG_STREAM *stream = (JPEG_STREAM *)jd->device;
+    BYTE        result;
+    UINT        count;
+    UINT        n;
+
+    count = 0;
+    while ((count < nbyte) && !stream->bfPending)
+    {
+        if (stream->dataLeft == 0)
+        {
+            if (stream->bfEndOfFrame || !_JpegStreamNextPayload( stream, TRUE, &result ))
+            {
+                break;
+            }
+            if (result & UVC_STREAM_FRAME_START)
+            {
+                // The next frame has started.  This frame is truncated, and
+                // the buffer is kept for JpegStreamStart().
+                stream->bfPending = 1;
+                break;
+            }
+            stream->bfEndOfFrame = _JpegStreamFrameEnded( stream );
+            continue;
+        }
+
+        n = nbyte - count;
+        if (n > stream->dataLeft)
+        {
+            n = stream->dataLeft;
+        }
+        if (buff != NULL)
+        {
+            memcpy( buff + count, stream->pData, n );
+        }
+        stream->pData    += n;
+        stream->dataLeft -= n;
+        count            += n;
+    }
+
+    return count;
+}
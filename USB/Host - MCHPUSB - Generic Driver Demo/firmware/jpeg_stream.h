@@ -0,0 +1,55 @@
+/******************************************************************************
+            JPEG stream input
+
+This file provides a TJpgDec input function that reads the MJPEG payload
+directly from the isochronous data buffers, so a frame can be decoded while
+it is still arriving without copying it to a staging buffer first.
+
+******************************************************************************/
+
+#ifndef _JPEG_STREAM_H
+#define _JPEG_STREAM_H
+
+#include "GenericTypeDefs.h"
+#include "USB/usb.h"
+#include "tjpgd.h"
+#include "uvc_stream.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// *****************************************************************************
+/* JPEG Stream
+
+This structure holds the read position of a JPEG frame in the isochronous
+data buffers.  Pass a pointer to it as the device identifier of jd_prepare().
+*/
+
+typedef struct _JPEG_STREAM
+{
+    ISOCHRONOUS_DATA    *pIsocData;         // Isochronous data buffers the payload is read from.
+    BYTE                *pData;             // Next payload byte to read.
+    WORD                dataLeft;           // Payload bytes left in the current buffer.
+    UVC_STREAM          uvc;                // Frame assembler of the payloads.
+    BYTE                deviceAddress;      // Address of the camera.
+    BYTE                bfEndOfFrame : 1;   // The last payload of the frame has been read.
+    BYTE                bfReading    : 1;   // A buffer is held by the stream input.
+    BYTE                bfPending    : 1;   // The held buffer is the first payload of the next frame.
+} JPEG_STREAM;
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+void JpegStreamInit( JPEG_STREAM *stream, BYTE deviceAddress, ISOCHRONOUS_DATA *isocData );
+BOOL JpegStreamStart( JPEG_STREAM *stream );
+void JpegStreamEnd( JPEG_STREAM *stream );
+UINT JpegStreamInput( JDEC *jd, BYTE *buff, UINT nbyte );
+
+#endif
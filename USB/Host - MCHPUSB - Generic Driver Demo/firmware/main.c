@@ -40,6 +40,7 @@ CONSEQUENTIAL DAMAGES, FOR ANY REASON WHATSOEVER.
 *******************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 #include "GenericTypeDefs.h"
 #include "HardwareProfile.h"
 #include "usb_config.h"
@@ -48,6 +49,34 @@ CONSEQUENTIAL DAMAGES, FOR ANY REASON WHATSOEVER.
 #include "user.h"
 #include "LCDBlocking.h"
 #include "timer.h"
+#include "jpeg_stream.h"
+#include "uvc_descriptor.h"
+#include "frame_pool.h"
+#include "frame_upload.h"
+
+//t[v[ɎMĂfR[h
+//RgAEgƁAAC\NiXobt@璼ڃfR[h
+#define USE_FRAME_POOL
+//fR[ht[UART2ŃoCiM(USE_FRAME_POOLKv)
+#define USE_FRAME_UPLOAD
+#if defined(USE_FRAME_UPLOAD) && !defined(USE_FRAME_POOL)
+	#error USE_FRAME_UPLOAD needs USE_FRAME_POOL
+#endif
+//yC[h̏荞݂̊O(C[v)ōs(USE_FRAME_POOLKv)
+//RgAEgƁA荞݂̒Ńt[v[ɃRs[
+#define USE_DEFERRED_PAYLOAD
+#if defined(USE_DEFERRED_PAYLOAD) && !defined(USE_FRAME_POOL)
+	#error USE_DEFERRED_PAYLOAD needs USE_FRAME_POOL
+#endif
+//Mf̃tH[}bgATCYAt[Ԋu(100nsP)
+//CfbNXAlternate Setting̓fBXNv^I
+#define VIDEO_FORMAT			UVC_VS_FORMAT_MJPEG
+#define VIDEO_WIDTH				640
+#define VIDEO_HEIGHT			480
+#define VIDEO_FRAME_INTERVAL	2000000//5Hz
+//v[u/R~bg̓r̒l(GET_DEF/GET_MIN/GET_MAXȂ)ǂݏoUART2ɏo͂
+//RgAEgƁAKvȃNGXg𑱂Ĕs
+//#define SHOW_NEGOTIATION
 
 // *****************************************************************************
 // *****************************************************************************
@@ -78,28 +107,11 @@ typedef enum
 {
     DEMO_INITIALIZE = 0,                // Initialize the app when a device is attached
     DEMO_STATE_IDLE,
-    DEMO_STATE_GET_INFO,
-    DEMO_STATE_WAIT_GET_INFO,
-    DEMO_STATE_GET_DEF,
-    DEMO_STATE_WAIT_GET_DEF,
-    DEMO_STATE_GET_MIN,
-    DEMO_STATE_WAIT_GET_MIN,
-    DEMO_STATE_GET_MAX,
-    DEMO_STATE_WAIT_GET_MAX,
-    DEMO_STATE_GET_CUR,
-    DEMO_STATE_WAIT_GET_CUR,
-    DEMO_STATE_SET_CUR,
-    DEMO_STATE_WAIT_SET_CUR,
-    DEMO_STATE_GET_CUR2,
-    DEMO_STATE_WAIT_GET_CUR2,
-    DEMO_STATE_GET_INFO2,//Commit
-    DEMO_STATE_WAIT_GET_INFO2,//Commit
-    DEMO_STATE_GET_CUR3,//Commit
-    DEMO_STATE_WAIT_GET_CUR3,//Commit
-    DEMO_STATE_SET_CUR2,//Commit
-    DEMO_STATE_WAIT_SET_CUR2,//Commit
+    DEMO_STATE_NEGOTIATE,               // Issue the next probe/commit request
+    DEMO_STATE_WAIT_NEGOTIATE,          // Requests are chained from the completion callbacks
     DEMO_STATE_SET_ISOCHRONOUS,
     DEMO_STATE_WAIT_SET_ISOCHRONOUS,
+    DEMO_STATE_DECODE_JPEG,
 
     DEMO_STATE_ERROR                    // An error has occured
 
@@ -138,7 +150,8 @@ BOOL InitializeSystem ( void )
     UART2Init();
     // Set Default demo state
     DemoState = DEMO_INITIALIZE;
-	if(USBHostIsochronousBuffersCreate(&isocData,2,1024)){
+	//C[v~܂ĂAobt@̐[ms]܂ł̓pPbg𗎂ƂȂ
+	if(USBHostIsochronousBuffersCreate(&isocData,USB_MAX_ISOCHRONOUS_DATA_BUFFERS,1024)){
     	UART2PrintString( "CreateIsochronousBuffers\r\n" );
 	}else{
         UART2PrintString( "Fail:CreateIsochronousBuffers\r\n" );
@@ -201,17 +214,17 @@ BOOL CheckForNewAttach ( void )
 #define VS_PROBE_CONTROL  0x01
 #define VS_COMMIT_CONTROL 0x02
 
-BYTE control(int req, int cs, int index, BYTE* buf, int size){
+BYTE control(int req, int cs, int index, BYTE* buf, int size, USB_CONTROL_CALLBACK callback){
 	BYTE bRequest = req;//GET_CUR,GET_MINȂ
 	WORD wValue = cs << 8;
 	WORD wIndex = index;//Entity ID and Interface ܂ End Point
 	WORD wLength = size;//p[^̒
 	if(req == SET_CUR){
 		BYTE bmRequestType = USB_HOST_TO_DEVICE | USB_REQUEST_TYPE_CLASS | USB_RECIPIENT_INTERFACE;
-		return USBHostIssueDeviceRequest(deviceAddress,bmRequestType,bRequest,wValue,wIndex,wLength,buf,USB_DEVICE_REQUEST_SET,0);
+		return USBHostQueueDeviceRequest(deviceAddress,bmRequestType,bRequest,wValue,wIndex,wLength,buf,USB_DEVICE_REQUEST_SET,callback,NULL);
 	}else{
 		BYTE bmRequestType = USB_DEVICE_TO_HOST | USB_REQUEST_TYPE_CLASS | USB_RECIPIENT_INTERFACE;
-		return USBHostIssueDeviceRequest(deviceAddress,bmRequestType,bRequest,wValue,wIndex,wLength,buf,USB_DEVICE_REQUEST_GET,0);
+		return USBHostQueueDeviceRequest(deviceAddress,bmRequestType,bRequest,wValue,wIndex,wLength,buf,USB_DEVICE_REQUEST_GET,callback,NULL);
 	}
 }
 void packet_dump(BYTE* data,long size){
@@ -223,24 +236,345 @@ void packet_dump(BYTE* data,long size){
 	}
     UART2PrintString( "\r\n" );
 }
+void print_dec(long val){
+	//UART2PutDec1oCg܂łȂ̂ŁAƂɏo͂
+	long div = 1000000000;
+	while(div > 1 && val / div == 0){
+		div /= 10;
+	}
+	while(div){
+		UART2PutDec((val / div) % 10);
+		div /= 10;
+	}
+}
 BYTE param[34];
 BYTE temp[34];
-//int param_len = 34;
-int param_len = 26;
-BYTE jpeg[40 * 1024];
+#define PARAM_LEN 26//v[u/R~bg̃p[^̒(UVC1.0)
+UVC_DESCRIPTOR_TABLE uvcTable;//rfIXg[~OC^[tF[X̃fBXNv^
+UVC_FRAME_ENTRY* uvcFrame;//I񂾃t[
+DWORD uvcFrameInterval;//I񂾃t[Ԋu
+UVC_ALT_SETTING_ENTRY* uvcAltSetting;//IAlternate Setting
+void set_param(BYTE* buf){
+	//I񂾃tH[}bgAt[At[Ԋuv[u/R~bg̃p[^ɂ
+	int j;
+	for(j = 0;j < PARAM_LEN;j++){
+		buf[j] = 0;
+	}
+	buf[2] = uvcFrame->bFormatIndex;
+	buf[3] = uvcFrame->bFrameIndex;
+	buf[4] = uvcFrameInterval;
+	buf[5] = uvcFrameInterval >> 8;
+	buf[6] = uvcFrameInterval >> 16;
+	buf[7] = uvcFrameInterval >> 24;
+}
+//v[u/R~bg̎菇
+#define STEP_FILL		0x01//sOɑI񂾃p[^
+#define STEP_SELECT_ALT	0x02//dwMaxPayloadTransferSizeAlternate SettingI
+#define STEP_OPTIONAL	0x04//G[łɐi
+typedef struct{
+	BYTE req;
+	BYTE cs;
+	BYTE* buf;
+	BYTE size;
+	BYTE flags;
+}NEGOTIATE_STEP;
+const NEGOTIATE_STEP negotiateSteps[] = {
+#ifdef SHOW_NEGOTIATION
+	{GET_INFO,	VS_PROBE_CONTROL,	param,	1,			STEP_OPTIONAL},
+	{GET_DEF,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_OPTIONAL},
+	{GET_MIN,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_OPTIONAL},
+	{GET_MAX,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_OPTIONAL},
+	{GET_CUR,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_OPTIONAL},
+#endif
+	{SET_CUR,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_FILL},
+	{GET_CUR,	VS_PROBE_CONTROL,	temp,	PARAM_LEN,	STEP_SELECT_ALT},
+#ifdef SHOW_NEGOTIATION
+	{GET_INFO,	VS_COMMIT_CONTROL,	param,	1,			STEP_OPTIONAL},
+	{GET_CUR,	VS_COMMIT_CONTROL,	temp,	PARAM_LEN,	STEP_OPTIONAL},
+#endif
+	{SET_CUR,	VS_COMMIT_CONTROL,	temp,	PARAM_LEN,	STEP_FILL},
+};
+#define NEGOTIATE_STEPS (sizeof(negotiateSteps) / sizeof(negotiateSteps[0]))
+BYTE negotiateStep;//ɔsXebv
+void negotiate_done(BYTE address, BYTE errorCode, BYTE* data, DWORD byteCount, void* context);
+BYTE negotiate_issue(void){
+	const NEGOTIATE_STEP* step = &negotiateSteps[negotiateStep];
+	if(step->flags & STEP_FILL){
+		set_param(step->buf);
+	}
+	return control(step->req, step->cs, uvcTable.bStreamingInterface, step->buf, step->size, negotiate_done);
+}
+void negotiate_done(BYTE address, BYTE errorCode, BYTE* data, DWORD byteCount, void* context){
+	//USBHostTasks烊NGXg̊ɌĂ΂ÃNGXgL[ɓ
+	const NEGOTIATE_STEP* step = &negotiateSteps[negotiateStep];
+	BYTE* buf = step->buf;
+	if(DemoState != DEMO_STATE_WAIT_NEGOTIATE){
+		return;//ؒfꂽ
+	}
+	if(errorCode != USB_SUCCESS && !(step->flags & STEP_OPTIONAL)){
+		UART2PrintString( "Negotiation error=" );
+		UART2PutHex(errorCode);
+		UART2PrintString( "\r\n" );
+		DemoState = DEMO_STATE_ERROR;
+		return;
+	}
+#ifdef SHOW_NEGOTIATION
+	UART2PrintString( "STEP=" );
+	print_dec(negotiateStep);
+	UART2PrintString( " " );
+	packet_dump(buf, byteCount);
+#endif
+	if(step->flags & STEP_SELECT_ALT){
+		//dwMaxPayloadTransferSizeŏAlternate SettingI
+		uvcAltSetting = UVCDescriptorSelectAltSetting(&uvcTable,
+			(DWORD)buf[22] | ((DWORD)buf[23] << 8) | ((DWORD)buf[24] << 16) | ((DWORD)buf[25] << 24));
+		if(uvcAltSetting == NULL){
+        	UART2PrintString( "Alternate setting not found\r\n" );
+			DemoState = DEMO_STATE_ERROR;
+			return;
+		}
+        UART2PrintString( "ALT=" );
+		print_dec(uvcAltSetting->bAlternateSetting);
+        UART2PrintString( " PACKET=" );
+		print_dec(uvcAltSetting->wMaxPacketSize);
+        UART2PrintString( "\r\n" );
+	}
+	negotiateStep++;
+	if(negotiateStep >= NEGOTIATE_STEPS){
+		DemoState = DEMO_STATE_SET_ISOCHRONOUS;
+	}else if(negotiate_issue() == USB_SUCCESS){
+		DemoState = DEMO_STATE_WAIT_NEGOTIATE;
+	}else{
+		//L[ɓȂAC[vōĎs
+		DemoState = DEMO_STATE_NEGOTIATE;
+	}
+}
+
+#define JPEG_WORK_SIZE  (8 * 1024)  // TJpgDec̃[NGA
+JDEC jdec;
+BYTE jpegWork[JPEG_WORK_SIZE];
+long jpeg_cnt = 0;
+#ifdef USB_HOST_COUNT_SCHEDULING
+USB_FRAME_STATISTICS frameStatistics;
+#endif
+#ifdef USB_HOST_MEASURE_ENUMERATION_TIME
+BOOL firstFrame = FALSE;//ڑ̍ŏ̃t[҂Ă
+#endif
+#ifdef USE_FRAME_POOL
+FRAME_POOL framePool;
+FRAME_BUFFER* jpegFrame;
+DWORD jpegOffset;
+DWORD payloadCount;//t[v[ɓꂽpPbg̐
+#ifdef USE_FRAME_UPLOAD
+FRAME_UPLOAD frameUpload;
+FRAME_BUFFER* uploadFrame;
+#endif
+#else
+JPEG_STREAM jpegStream;
+#endif
+
+#ifdef USE_DEFERRED_PAYLOAD
+void payload_tasks(void){
+	ISOCHRONOUS_DATA_BUFFER* buffer;
+	//荞݂ŎMς݂̃obt@Ƀt[v[֓āA
+	while(1){
+		buffer = &isocData.buffers[isocData.currentBufferUser];
+		if(!buffer->bfDataLengthValid){
+			break;
+		}
+		FramePoolPayload(&framePool, buffer->pBuffer, buffer->dataLength);
+		payloadCount++;
+		buffer->bfDataLengthValid = 0;
+		isocData.currentBufferUser++;
+		if(isocData.currentBufferUser >= isocData.totalBuffers){
+			isocData.currentBufferUser = 0;
+		}
+	}
+}
+#endif
+UINT jpeg_output(JDEC* jd, void* bitmap, JRECT* rect){
+	//fR[hCxgL[Ȃ悤ɁAUSB̏
+	USBHostTasks();
+#ifdef USE_DEFERRED_PAYLOAD
+	//fR[hɓ͂yC[h荞
+	payload_tasks();
+#endif
+	//\悪Ȃ̂ŁAfR[hʂ͎̂Ă
+	return 1;
+}
+void jpeg_print(JRESULT rc, UVC_FRAME_INFO* info){
+#ifdef USB_HOST_MEASURE_ENUMERATION_TIME
+	if(firstFrame){
+		DWORD attachTime;
+		DWORD enumTime;
+		//ڑŏ̃t[܂ł̎ԂƁÂ̗񋓂ɂ(ms)
+		enumTime = USBHostGetEnumerationTime(&attachTime);
+		firstFrame = FALSE;
+		UART2PrintString( "TTFF=" );
+		print_dec((ReadCoreTimer() - attachTime) / (GetSystemClock() / 2000));
+		UART2PrintString( " ENUM=" );
+		print_dec(enumTime / (GetSystemClock() / 2000));
+#ifdef USB_HOST_DESCRIPTOR_CACHE
+		//fBXNv^LbVg
+		UART2PrintString( " CACHE=" );
+		UART2PutDec(USBHostDescriptorCacheUsed());
+#endif
+		UART2PrintString( "\r\n" );
+	}
+#endif
+	jpeg_cnt++;
+	UART2PrintString( "JPEG-CNT=" );
+	print_dec(jpeg_cnt);
+	UART2PrintString( " SIZE=" );
+	print_dec(jdec.width);
+	UART2PrintString( "x" );
+	print_dec(jdec.height);
+	UART2PrintString( " RC=" );
+	UART2PutDec(rc);
+	//t[̏̓yC[hwb_
+	UART2PrintString( " BYTES=" );
+	print_dec(info->frameSize);
+	UART2PrintString( " PTS=" );
+	UART2PutHexDWord(info->dwPresentationTime);
+	if(info->bfError){
+		UART2PrintString( " ERR" );
+	}
+#ifdef USE_FRAME_POOL
+	//v[ɓȂt[̐
+	UART2PrintString( " DROP=" );
+	print_dec(framePool.droppedFrames);
+	UART2PrintString( "/" );
+	print_dec(framePool.overflowFrames);
+	UART2PrintString( "/" );
+	print_dec(framePool.errorFrames);
+#endif
+	//OtŗƂpPbg̐
+	UART2PrintString( " OVR=" );
+	print_dec(isocData.overrunCount);
+	//MpPbg̐ƁApPbg̐(vĂΓdɏĂȂ)
+	UART2PrintString( " PKT=" );
+	print_dec(isocData.packetCount);
+#ifdef USE_FRAME_POOL
+	UART2PrintString( "/" );
+	print_dec(payloadCount);
+#endif
+#ifdef UART2_TX_BUFFER_SIZE
+	//MOtŎ̂Ă̐ƁAO̍őgp
+	UART2PrintString( " TXDROP=" );
+	print_dec(UART2TxDropped());
+	UART2PrintString( " TXPEAK=" );
+	print_dec(UART2TxPeak());
+#endif
+#ifdef USB_ENABLE_TRANSFER_EVENT
+	{
+		BYTE eventHighWater;
+		DWORD eventOverflows;
+		//CxgL[̍őgpƁAĎ̂ĂCxg̐
+		USBHostGetEventQueueStatus(&eventHighWater, &eventOverflows);
+		UART2PrintString( " EVQ=" );
+		print_dec(eventHighWater);
+		UART2PrintString( "/" );
+		print_dec(eventOverflows);
+	}
+#endif
+#ifdef USB_HOST_ARENA_SIZE
+	{
+		WORD arenaUsed;
+		WORD arenaPeak;
+		//fBXNv^pA[i̎gpʂƍőgp
+		USBHostGetArenaStatus(&arenaUsed, &arenaPeak);
+		UART2PrintString( " ARENA=" );
+		print_dec(arenaUsed);
+		UART2PrintString( "/" );
+		print_dec(arenaPeak);
+	}
+#endif
+#ifdef USB_HOST_MEASURE_ISR_TIME
+	//O̕\USB荞݂̍ő又(us)
+	UART2PrintString( " ISR=" );
+	print_dec(USBHostGetMaxISRTime(TRUE) / (GetSystemClock() / 2000000));
+#endif
+#ifdef USB_HOST_COUNT_SCHEDULING
+	//1t[ł̃Gh|Cg̍ő
+	UART2PrintString( " SCHED=" );
+	print_dec(USBHostGetMaxSchedulingDecisions(TRUE));
+	//1t[̃oXgp(/ő/]̗\)
+	USBHostGetFrameStatistics(&frameStatistics, TRUE);
+	UART2PrintString( " BW=" );
+	print_dec(frameStatistics.dwFrames ? frameStatistics.dwUsedTotal / frameStatistics.dwFrames : 0);
+	UART2PrintString( "/" );
+	print_dec(frameStatistics.wUsedPeak);
+	UART2PrintString( "/" );
+	print_dec(frameStatistics.wReservedPeak);
+#endif
+	UART2PrintString( "\r\n" );
+}
+#ifdef USE_FRAME_POOL
+UINT jpeg_input(JDEC* jd, BYTE* buff, UINT nbyte){
+	//t[obt@ǂݏoBbuffNULLȂǂݔ΂
+	if(nbyte > jpegFrame->length - jpegOffset){
+		nbyte = jpegFrame->length - jpegOffset;
+	}
+	if(buff){
+		memcpy(buff, jpegFrame->data + jpegOffset, nbyte);
+	}
+	jpegOffset += nbyte;
+	return nbyte;
+}
+void jpeg_decode(void){
+	JRESULT rc;
+#ifdef USE_DEFERRED_PAYLOAD
+	payload_tasks();
+#endif
+#ifdef USE_FRAME_UPLOAD
+	//M̃t[΁AI܂Ŏ̃t[͎Ȃ
+	if(FrameUploadIsBusy(&frameUpload)){
+		if(FrameUploadTasks(&frameUpload)){
+			FramePoolRelease(&framePool, uploadFrame);
+		}
+		return;
+	}
+#endif
+	//Mς݂̃t[ȂΉȂ
+	jpegFrame = FramePoolGetReady(&framePool);
+	if(jpegFrame == NULL){
+		return;
+	}
+	jpegOffset = 0;
+	rc = jd_prepare(&jdec, jpeg_input, jpegWork, sizeof(jpegWork), NULL);
+	if(rc == JDR_OK){
+		rc = jd_decomp(&jdec, jpeg_output, 0);
+	}
+	jpeg_print(rc, &jpegFrame->info);
+#ifdef USE_FRAME_UPLOAD
+	//MIv[ɕԂ
+	uploadFrame = jpegFrame;
+	FrameUploadStart(&frameUpload, uploadFrame);
+#else
+	FramePoolRelease(&framePool, jpegFrame);
+#endif
+}
+#else
+void jpeg_decode(void){
+	JRESULT rc;
+	//t[̐擪͂܂ł͉Ȃ
+	if(!JpegStreamStart(&jpegStream)){
+		return;
+	}
+	rc = jd_prepare(&jdec, JpegStreamInput, jpegWork, sizeof(jpegWork), &jpegStream);
+	if(rc == JDR_OK){
+		rc = jd_decomp(&jdec, jpeg_output, 0);
+	}
+	JpegStreamEnd(&jpegStream);
+	jpeg_print(rc, &jpegStream.uvc.lastFrame);
+}
+#endif
 void ManageDemoState ( void )
 {
-	int j;
-	DWORD   byteCount;
-	BYTE    errorCode;
     BYTE RetVal;
 	//ڑĂȂ珉
     if (USBHostGenericDeviceDetached(deviceAddress) && deviceAddress != 0)
     {
-		long i;
-		for(i = 0;i < sizeof(jpeg);i++){
-			jpeg[i] = 0;
-		}
         UART2PrintString( "Generic demo device detached - polled\r\n" );
         DemoState = DEMO_INITIALIZE;
         deviceAddress   = 0;
@@ -254,7 +588,29 @@ void ManageDemoState ( void )
 		//ڑꂽAǂݏoɈڍs
         if (CheckForNewAttach())
         {
-			DemoState = DEMO_STATE_GET_INFO;
+			DemoState = DEMO_STATE_NEGOTIATE;
+			negotiateStep = 0;
+			//fBXNv^tH[}bgƃt[T
+			uvcFrame = NULL;
+			if(UVCDescriptorParse(&uvcTable, USBHostGetCurrentConfigurationDescriptor(deviceAddress))){
+				uvcFrame = UVCDescriptorFindFrame(&uvcTable, VIDEO_FORMAT, VIDEO_WIDTH, VIDEO_HEIGHT);
+			}
+			if(uvcFrame == NULL){
+	        	UART2PrintString( "Video format not found\r\n" );
+				DemoState = DEMO_STATE_ERROR;
+			}else{
+				uvcFrameInterval = UVCDescriptorFindInterval(&uvcTable, uvcFrame, VIDEO_FRAME_INTERVAL);
+	        	UART2PrintString( "FORMAT=" );
+				print_dec(uvcFrame->bFormatIndex);
+	        	UART2PrintString( " FRAME=" );
+				print_dec(uvcFrame->bFrameIndex);
+	        	UART2PrintString( " INTERVAL=" );
+				print_dec(uvcFrameInterval);
+	        	UART2PrintString( "\r\n" );
+			}
+#ifdef USB_HOST_MEASURE_ENUMERATION_TIME
+			firstFrame = TRUE;
+#endif
         	UART2PrintString( "USB_Ver=" );
 			UART2PutDec(((USB_DEVICE_DESCRIPTOR *)pDeviceDescriptor)->bcdUSB >> 8);
         	UART2PrintString( "-" );
@@ -262,218 +618,58 @@ void ManageDemoState ( void )
         	UART2PrintString( "\r\n" );
         }
         break;
-	case DEMO_STATE_GET_INFO:
-		if(control(GET_INFO, VS_PROBE_CONTROL, 1, param, 1) == USB_SUCCESS){
-        	UART2PrintString( "GET_INFO, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_INFO;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_INFO:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_INFO, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(param,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState = DEMO_STATE_GET_DEF;
-		}
-		break;
-	case DEMO_STATE_GET_DEF:
-		if(control(GET_DEF, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_DEF, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_DEF;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_DEF:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_DEF, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState = DEMO_STATE_GET_MIN;
-		}
-		break;
-	case DEMO_STATE_GET_MIN:
-		if(control(GET_MIN, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_MIN, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_MIN;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_MIN:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_MIN, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState = DEMO_STATE_GET_MAX;
-		}
-		break;
-	case DEMO_STATE_GET_MAX:
-		if(control(GET_MAX, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_MAX, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_MAX;
+	case DEMO_STATE_NEGOTIATE:
+		//2Ԗڈȍ~̃NGXg͊R[obNL[ɓ
+		if(negotiate_issue() == USB_SUCCESS){
+			DemoState = DEMO_STATE_WAIT_NEGOTIATE;
 		}
 		break;
-	case DEMO_STATE_WAIT_GET_MAX:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_MAX, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState = DEMO_STATE_GET_CUR;
-		}
-		break;
-	case DEMO_STATE_GET_CUR:
-		if(control(GET_CUR, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_CUR, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_CUR;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_CUR:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_CUR, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState =DEMO_STATE_SET_CUR ;
-		}
-		break;
-	case DEMO_STATE_SET_CUR:
-		for(j = 0;j < param_len;j++){
-			temp[j] = 0;
-		}
-		temp[2] = 2;//tH[}bgCfbNX
-		temp[3] = 1;//t[CfbNX
-		/*temp[4] = 0x80;
-		temp[5] = 0x84;
-		temp[6] = 0x1E;
-		temp[7] = 0x00;*/
-		temp[4] = 0x15;//30Hz
-		temp[5] = 0x16;
-		temp[6] = 0x05;
-		temp[7] = 0x00;
-		if(control(SET_CUR, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "SET_CUR, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_SET_CUR;
-		}
-		break;
-	case DEMO_STATE_WAIT_SET_CUR:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=SET_CUR, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState =DEMO_STATE_GET_CUR2 ;
-		}
-		break;
-	case DEMO_STATE_GET_CUR2:
-		if(control(GET_CUR, VS_PROBE_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_CUR2, VS_PROBE_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_CUR2;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_CUR2:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_CUR2, VS_PROBE_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState =DEMO_STATE_GET_INFO2 ;
-		}
-		break;
-	case DEMO_STATE_GET_INFO2:
-		if(control(GET_INFO, VS_COMMIT_CONTROL, 1, param, 1) == USB_SUCCESS){
-        	UART2PrintString( "GET_INFO, VS_COMMIT_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_INFO2;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_INFO2:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_INFO, VS_COMMIT_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(param,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState = DEMO_STATE_GET_CUR3;
-		}
-		break;
-	case DEMO_STATE_GET_CUR3:
-		if(control(GET_CUR, VS_COMMIT_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "GET_CUR2, VS_COMMIT_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_GET_CUR3;
-		}
-		break;
-	case DEMO_STATE_WAIT_GET_CUR3:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=GET_CUR2, VS_COMMIT_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState =DEMO_STATE_SET_CUR2 ;
-		}
-		break;
-	case DEMO_STATE_SET_CUR2:
-		for(j = 0;j < param_len;j++){
-			temp[j] = 0;
-		}
-		temp[2] = 2;
-		temp[3] = 0x01;//640x480 30Hz
-		//temp[3] = 0x02;//160x120 30Hz
-		//temp[3] = 0x0C;//800x600
-		temp[4] = 0x80;//5Hz
-		temp[5] = 0x84;
-		temp[6] = 0x1E;
-		temp[7] = 0x00;
-		/*temp[4] = 0x15;//30Hz
-		temp[5] = 0x16;
-		temp[6] = 0x05;
-		temp[7] = 0x00;*/
-		if(control(SET_CUR, VS_COMMIT_CONTROL, 1, temp, param_len) == USB_SUCCESS){
-        	UART2PrintString( "SET_CUR, VS_COMMIT_CONTROL\r\n" );
-			DemoState = DEMO_STATE_WAIT_SET_CUR2;
-		}
-		break;
-	case DEMO_STATE_WAIT_SET_CUR2:
-		if (USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount )){
-        	UART2PrintString( "OK=SET_CUR, VS_COMMIT_CONTROL\r\n" );
-        	UART2PrintString( "Byte Count=" );
-			UART2PutDec(byteCount);
-        	UART2PrintString( "\r\n" );
-			packet_dump(temp,byteCount);
-        	UART2PrintString( "\r\n" );
-			DemoState =DEMO_STATE_SET_ISOCHRONOUS ;
-		}
+	case DEMO_STATE_WAIT_NEGOTIATE:
 		break;
 	case DEMO_STATE_SET_ISOCHRONOUS:
-		if(USBHostIssueDeviceRequest( deviceAddress, 0x01, USB_REQUEST_SET_INTERFACE,
-            0x06/*Alternate Setting:0x1*/, 0x01/*interface:0x03*/, 0, NULL, USB_DEVICE_REQUEST_SET,
-            0x00 )== USB_SUCCESS){
+		//O̐ڑŎcpPbgƃJE^
+		USBHostIsochronousBuffersReset(&isocData, isocData.totalBuffers);
+#if defined(USE_FRAME_POOL) && !defined(USE_DEFERRED_PAYLOAD)
+		//荞݂̒ŃpPbg󂯎
+		isocData.deliveryMode = USB_ISOC_DELIVERY_ISR;
+#else
+		//pPbg̓C[vŃOǂނ̂ŁACxg͗vȂ
+		isocData.deliveryMode = USB_ISOC_DELIVERY_NONE;
+#endif
+#ifdef USE_FRAME_POOL
+		//Mn߂OɃv[ɂ
+		FramePoolInit(&framePool);
+		payloadCount = 0;
+#endif
+#ifdef USE_FRAME_UPLOAD
+		FrameUploadInit(&frameUpload);
+#endif
+		RetVal = USBHostIssueDeviceRequest( deviceAddress, 0x01, USB_REQUEST_SET_INTERFACE,
+            uvcAltSetting->bAlternateSetting, uvcTable.bStreamingInterface, 0, NULL, USB_DEVICE_REQUEST_SET,
+            0x00 );
+		if(RetVal == USB_SUCCESS){
           	UART2PrintString( "USB_REQUEST_SET_INTERFACE=OK!\r\n" );
 			DemoState =DEMO_STATE_WAIT_SET_ISOCHRONOUS ;
+		}else if(RetVal != USB_ENDPOINT_BUSY){
+			//EP0gpȂ玟̃[vōĎsBшsȂǂ͍ĎsĂȂ̂Ŏ~߂
+          	UART2PrintString( "USB_REQUEST_SET_INTERFACE error=" );
+			UART2PutHex(RetVal);
+          	UART2PrintString( "\r\n" );
+			DemoState = DEMO_STATE_ERROR;
 		}
 		break;
 	case DEMO_STATE_WAIT_SET_ISOCHRONOUS:
-		if(USBHostReadIsochronous(deviceAddress,0x81,&isocData) == USB_SUCCESS){
+		if(USBHostReadIsochronous(deviceAddress,uvcAltSetting->bEndpointAddress,&isocData) == USB_SUCCESS){
           		//UART2PrintString( "USBHostReadIsochronous=OK!\r\n" );
-			DemoState = DEMO_STATE_ERROR;
+#ifndef USE_FRAME_POOL
+			JpegStreamInit(&jpegStream, deviceAddress, &isocData);
+#endif
+			DemoState = DEMO_STATE_DECODE_JPEG;
 		}
 		break;
+	case DEMO_STATE_DECODE_JPEG:
+		jpeg_decode();
+		break;
     case DEMO_STATE_ERROR:
         break;
     default:
@@ -485,101 +681,26 @@ void ManageDemoState ( void )
 
 BOOL USB_ApplicationEventHandler ( BYTE address, USB_EVENT event, void *data, DWORD size )
 {
-	static int aaa = 0;
-	static long data_cnt = 0;
-	static long data_cnt_bak = 0;
-	static long jpeg_cnt = 0;
-	static long jpeg_size = 0;
-	static long jpeg_size_bak = 0;
-	static long jpeg_ptr = 0;
-	static long jpeg_start = 0;
     #ifdef USB_GENERIC_SUPPORT_SERIAL_NUMBERS
         BYTE i;
     #endif
-	int j;
     // Handle specific events.
     switch ( (INT)event )
     {
         case EVENT_TRANSFER:         // A USB transfer has completed
-		case EVENT_DATA_ISOC_READ:
-			for(j = 0;j < size-1;j++){
-				if(((BYTE*)data)[j] == 0xFF){
-						if(((BYTE*)data)[j+1] == 0xD8){
-							if(((BYTE*)data)[j+2] == 0xFF){
-							if(((BYTE*)data)[j+3] == 0xE0){
-								jpeg_size = data_cnt -jpeg_size_bak;
-								jpeg_size_bak = data_cnt;
-		            			/*UART2PrintString( "JPEG-SIZE=" );
-								UART2PutDec((jpeg_size/100000) % 10);
-								UART2PutDec((jpeg_size/10000) % 10);
-								UART2PutDec((jpeg_size/1000) % 10);
-								UART2PutDec((jpeg_size/100) % 10);
-								UART2PutDec((jpeg_size/10) % 10);
-								UART2PutDec(jpeg_size % 10);
-		            			UART2PrintString( "JPEG-CNT=" );
-								UART2PutDec((jpeg_cnt/1000) % 10);
-								UART2PutDec((jpeg_cnt/100) % 10);
-								UART2PutDec((jpeg_cnt/10) % 10);
-								UART2PutDec(jpeg_cnt % 10);
-		            			UART2PrintString( "\r\n" );*/
-								if(jpeg_cnt == 1){
-			            			UART2PrintString( "JPEG-SIZE=" );
-									UART2PutDec((jpeg_ptr/100000) % 10);
-									UART2PutDec((jpeg_ptr/10000) % 10);
-									UART2PutDec((jpeg_ptr/1000) % 10);
-									UART2PutDec((jpeg_ptr/100) % 10);
-									UART2PutDec((jpeg_ptr/10) % 10);
-									UART2PutDec(jpeg_ptr % 10);
-		            				UART2PrintString( "\r\n" );
-									packet_dump(jpeg,jpeg_ptr);
-								}
-								jpeg_cnt++;
-								jpeg_start = j;
-								//packet_dump((data + j),4);
-							}
-							
-							}
-						}
-					}
-			}
-			if((size != 0x0C) && jpeg_cnt == 1){
-				int i;
-				for(i = 0x0C;i < size;i++){
-					if(jpeg_ptr == 0){
-            			UART2PrintString( "jpeg_start=" );
-						i = jpeg_start;
-						UART2PutDec(jpeg_cnt % 10);
-            			UART2PrintString( "\r\n" );
-					}
-					jpeg[jpeg_ptr++] = ((BYTE*)data)[i];
-				}
-			}
-			if(size != 0x0C){
-			/*if(aaa >= 0 && aaa <= 0){
-	            UART2PrintString( "DATA=" );
-				packet_dump(data,size);
-	            UART2PrintString( "\r\n ");
-				aaa++;
-			}*/
-			}
-			data_cnt += size;
-			/*if(data_cnt > data_cnt_bak + 1024 * 10){
-				//data_cnt = 1024 * 100;
-	            UART2PrintString( "a" );
-				UART2PutDec((data_cnt/1000000) % 10);
-				UART2PutDec((data_cnt/100000) % 10);
-				UART2PutDec((data_cnt/10000) % 10);
-				UART2PutDec((data_cnt/1000) % 10);
-				UART2PutDec((data_cnt/100) % 10);
-				UART2PutDec((data_cnt/10) % 10);
-				UART2PutDec(data_cnt % 10);
-	            UART2PrintString( "\r\n" );
-				data_cnt_bak = data_cnt;
-			}*/
-
             return TRUE;
+            break;
+		case EVENT_DATA_ISOC_READ:
+#if defined(USE_FRAME_POOL) && !defined(USE_DEFERRED_PAYLOAD)
+			//荞݂̒Ńt[v[ɃRs[āAobt@͂ɉ
+			FramePoolPayload(&framePool, data, size);
+			payloadCount++;
+			return TRUE;
+#else
+			//USB_ISOC_DELIVERY_NONEȂ̂ŗȂBobt@̓C[v
+			return FALSE;
+#endif
 			break;
-            UART2PrintString( "a" );
         case EVENT_GENERIC_ATTACH:
             return TRUE;
             break;
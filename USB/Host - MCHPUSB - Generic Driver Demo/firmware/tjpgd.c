@@ -105,6 +105,109 @@ const BYTE Clip8[1024] = {
 
 
 
+#if JD_FORMAT != 2
+/*------------------------------------------------*/
+/* Conversion tables for YCbCr to RGB conversion  */
+/* (indexed by the Cb/Cr sample without leveling) */
+/*------------------------------------------------*/
+
+static
+const SHORT Cr2R[256] = {	/* R - Y = 1.402 * (Cr - 128) */
+	-179, -178, -177, -175, -174, -172, -171, -170, -168, -167, -165, -164, -163, -161, -160, -158,
+	-157, -156, -154, -153, -151, -150, -149, -147, -146, -144, -143, -142, -140, -139, -137, -136,
+	-135, -133, -132, -130, -129, -128, -126, -125, -123, -122, -121, -119, -118, -116, -115, -114,
+	-112, -111, -109, -108, -107, -105, -104, -102, -101, -100, -98, -97, -95, -94, -93, -91,
+	-90, -88, -87, -86, -84, -83, -81, -80, -79, -77, -76, -74, -73, -72, -70, -69,
+	-67, -66, -64, -63, -62, -60, -59, -57, -56, -55, -53, -52, -50, -49, -48, -46,
+	-45, -43, -42, -41, -39, -38, -36, -35, -34, -32, -31, -29, -28, -27, -25, -24,
+	-22, -21, -20, -18, -17, -15, -14, -13, -11, -10, -8, -7, -6, -4, -3, -1,
+	0, 1, 3, 4, 6, 7, 8, 10, 11, 13, 14, 15, 17, 18, 20, 21,
+	22, 24, 25, 27, 28, 29, 31, 32, 34, 35, 36, 38, 39, 41, 42, 43,
+	45, 46, 48, 49, 50, 52, 53, 55, 56, 57, 59, 60, 62, 63, 64, 66,
+	67, 69, 70, 72, 73, 74, 76, 77, 79, 80, 81, 83, 84, 86, 87, 88,
+	90, 91, 93, 94, 95, 97, 98, 100, 101, 102, 104, 105, 107, 108, 109, 111,
+	112, 114, 115, 116, 118, 119, 121, 122, 123, 125, 126, 128, 129, 130, 132, 133,
+	135, 136, 137, 139, 140, 142, 143, 144, 146, 147, 149, 150, 151, 153, 154, 156,
+	157, 158, 160, 161, 163, 164, 165, 167, 168, 170, 171, 172, 174, 175, 177, 178
+};
+
+
+static
+const SHORT Cb2B[256] = {	/* B - Y = 1.772 * (Cb - 128) */
+	-227, -225, -223, -222, -220, -218, -216, -214, -213, -211, -209, -207, -206, -204, -202, -200,
+	-198, -197, -195, -193, -191, -190, -188, -186, -184, -183, -181, -179, -177, -175, -174, -172,
+	-170, -168, -167, -165, -163, -161, -159, -158, -156, -154, -152, -151, -149, -147, -145, -144,
+	-142, -140, -138, -136, -135, -133, -131, -129, -128, -126, -124, -122, -120, -119, -117, -115,
+	-113, -112, -110, -108, -106, -105, -103, -101, -99, -97, -96, -94, -92, -90, -89, -87,
+	-85, -83, -82, -80, -78, -76, -74, -73, -71, -69, -67, -66, -64, -62, -60, -58,
+	-57, -55, -53, -51, -50, -48, -46, -44, -43, -41, -39, -37, -35, -34, -32, -30,
+	-28, -27, -25, -23, -21, -19, -18, -16, -14, -12, -11, -9, -7, -5, -4, -2,
+	0, 2, 4, 5, 7, 9, 11, 12, 14, 16, 18, 19, 21, 23, 25, 27,
+	28, 30, 32, 34, 35, 37, 39, 41, 43, 44, 46, 48, 50, 51, 53, 55,
+	57, 58, 60, 62, 64, 66, 67, 69, 71, 73, 74, 76, 78, 80, 82, 83,
+	85, 87, 89, 90, 92, 94, 96, 97, 99, 101, 103, 105, 106, 108, 110, 112,
+	113, 115, 117, 119, 120, 122, 124, 126, 128, 129, 131, 133, 135, 136, 138, 140,
+	142, 144, 145, 147, 149, 151, 152, 154, 156, 158, 159, 161, 163, 165, 167, 168,
+	170, 172, 174, 175, 177, 179, 181, 183, 184, 186, 188, 190, 191, 193, 195, 197,
+	198, 200, 202, 204, 206, 207, 209, 211, 213, 214, 216, 218, 220, 222, 223, 225
+};
+
+
+static
+const LONG Cr2G[256] = {	/* -0.71414 * (Cr - 128), scaled up 16 bits */
+	5990656, 5943854, 5897052, 5850250, 5803448, 5756646, 5709844, 5663042, 5616240, 5569438, 5522636, 5475834, 5429032, 5382230, 5335428, 5288626,
+	5241824, 5195022, 5148220, 5101418, 5054616, 5007814, 4961012, 4914210, 4867408, 4820606, 4773804, 4727002, 4680200, 4633398, 4586596, 4539794,
+	4492992, 4446190, 4399388, 4352586, 4305784, 4258982, 4212180, 4165378, 4118576, 4071774, 4024972, 3978170, 3931368, 3884566, 3837764, 3790962,
+	3744160, 3697358, 3650556, 3603754, 3556952, 3510150, 3463348, 3416546, 3369744, 3322942, 3276140, 3229338, 3182536, 3135734, 3088932, 3042130,
+	2995328, 2948526, 2901724, 2854922, 2808120, 2761318, 2714516, 2667714, 2620912, 2574110, 2527308, 2480506, 2433704, 2386902, 2340100, 2293298,
+	2246496, 2199694, 2152892, 2106090, 2059288, 2012486, 1965684, 1918882, 1872080, 1825278, 1778476, 1731674, 1684872, 1638070, 1591268, 1544466,
+	1497664, 1450862, 1404060, 1357258, 1310456, 1263654, 1216852, 1170050, 1123248, 1076446, 1029644, 982842, 936040, 889238, 842436, 795634,
+	748832, 702030, 655228, 608426, 561624, 514822, 468020, 421218, 374416, 327614, 280812, 234010, 187208, 140406, 93604, 46802,
+	0, -46802, -93604, -140406, -187208, -234010, -280812, -327614, -374416, -421218, -468020, -514822, -561624, -608426, -655228, -702030,
+	-748832, -795634, -842436, -889238, -936040, -982842, -1029644, -1076446, -1123248, -1170050, -1216852, -1263654, -1310456, -1357258, -1404060, -1450862,
+	-1497664, -1544466, -1591268, -1638070, -1684872, -1731674, -1778476, -1825278, -1872080, -1918882, -1965684, -2012486, -2059288, -2106090, -2152892, -2199694,
+	-2246496, -2293298, -2340100, -2386902, -2433704, -2480506, -2527308, -2574110, -2620912, -2667714, -2714516, -2761318, -2808120, -2854922, -2901724, -2948526,
+	-2995328, -3042130, -3088932, -3135734, -3182536, -3229338, -3276140, -3322942, -3369744, -3416546, -3463348, -3510150, -3556952, -3603754, -3650556, -3697358,
+	-3744160, -3790962, -3837764, -3884566, -3931368, -3978170, -4024972, -4071774, -4118576, -4165378, -4212180, -4258982, -4305784, -4352586, -4399388, -4446190,
+	-4492992, -4539794, -4586596, -4633398, -4680200, -4727002, -4773804, -4820606, -4867408, -4914210, -4961012, -5007814, -5054616, -5101418, -5148220, -5195022,
+	-5241824, -5288626, -5335428, -5382230, -5429032, -5475834, -5522636, -5569438, -5616240, -5663042, -5709844, -5756646, -5803448, -5850250, -5897052, -5943854
+};
+
+
+static
+const LONG Cb2G[256] = {	/* -0.34414 * (Cb - 128), scaled up 16 bits and rounded */
+	2919680, 2897126, 2874572, 2852018, 2829464, 2806910, 2784356, 2761802, 2739248, 2716694, 2694140, 2671586, 2649032, 2626478, 2603924, 2581370,
+	2558816, 2536262, 2513708, 2491154, 2468600, 2446046, 2423492, 2400938, 2378384, 2355830, 2333276, 2310722, 2288168, 2265614, 2243060, 2220506,
+	2197952, 2175398, 2152844, 2130290, 2107736, 2085182, 2062628, 2040074, 2017520, 1994966, 1972412, 1949858, 1927304, 1904750, 1882196, 1859642,
+	1837088, 1814534, 1791980, 1769426, 1746872, 1724318, 1701764, 1679210, 1656656, 1634102, 1611548, 1588994, 1566440, 1543886, 1521332, 1498778,
+	1476224, 1453670, 1431116, 1408562, 1386008, 1363454, 1340900, 1318346, 1295792, 1273238, 1250684, 1228130, 1205576, 1183022, 1160468, 1137914,
+	1115360, 1092806, 1070252, 1047698, 1025144, 1002590, 980036, 957482, 934928, 912374, 889820, 867266, 844712, 822158, 799604, 777050,
+	754496, 731942, 709388, 686834, 664280, 641726, 619172, 596618, 574064, 551510, 528956, 506402, 483848, 461294, 438740, 416186,
+	393632, 371078, 348524, 325970, 303416, 280862, 258308, 235754, 213200, 190646, 168092, 145538, 122984, 100430, 77876, 55322,
+	32768, 10214, -12340, -34894, -57448, -80002, -102556, -125110, -147664, -170218, -192772, -215326, -237880, -260434, -282988, -305542,
+	-328096, -350650, -373204, -395758, -418312, -440866, -463420, -485974, -508528, -531082, -553636, -576190, -598744, -621298, -643852, -666406,
+	-688960, -711514, -734068, -756622, -779176, -801730, -824284, -846838, -869392, -891946, -914500, -937054, -959608, -982162, -1004716, -1027270,
+	-1049824, -1072378, -1094932, -1117486, -1140040, -1162594, -1185148, -1207702, -1230256, -1252810, -1275364, -1297918, -1320472, -1343026, -1365580, -1388134,
+	-1410688, -1433242, -1455796, -1478350, -1500904, -1523458, -1546012, -1568566, -1591120, -1613674, -1636228, -1658782, -1681336, -1703890, -1726444, -1748998,
+	-1771552, -1794106, -1816660, -1839214, -1861768, -1884322, -1906876, -1929430, -1951984, -1974538, -1997092, -2019646, -2042200, -2064754, -2087308, -2109862,
+	-2132416, -2154970, -2177524, -2200078, -2222632, -2245186, -2267740, -2290294, -2312848, -2335402, -2357956, -2380510, -2403064, -2425618, -2448172, -2470726,
+	-2493280, -2515834, -2538388, -2560942, -2583496, -2606050, -2628604, -2651158, -2673712, -2696266, -2718820, -2741374, -2763928, -2786482, -2809036, -2831590
+};
+#endif
+
+
+
+
+
+/*---------------------------------------------*/
+/* Size of huffman fast lookup table           */
+/*---------------------------------------------*/
+
+#define HUFF_BIT	9					/* Number of bits to look up at once (code words up to 9 bits) */
+#define HUFF_LEN	(1 << HUFF_BIT)		/* Number of entries in the lookup table */
+
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Allocate a memory block from memory pool                              */
@@ -184,6 +287,10 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 	UINT i, j, b, np, cls, num;
 	BYTE d, *pb, *pd;
 	WORD hc, *ph;
+#if JD_FASTDECODE == 2
+	UINT span;
+	WORD *pl;
+#endif
 
 
 	while (ndata) {	/* Process all tables in the segment */
@@ -220,6 +327,23 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 			if (!cls && d > 11) return JDR_FMT1;
 			*pd++ = d;
 		}
+
+#if JD_FASTDECODE == 2
+		pl = alloc_pool(jd, HUFF_LEN * sizeof (WORD));	/* Allocate a memory block for the lookup table */
+		if (!pl) return JDR_MEM1;			/* Err: not enough memory */
+		jd->hufflut[num][cls] = pl;
+		for (i = 0; i < HUFF_LEN; i++) pl[i] = 0;	/* Default: code word is longer than HUFF_BIT */
+		pd = jd->huffdata[num][cls];
+		for (j = i = 0; i < HUFF_BIT; i++) {	/* Register code words up to HUFF_BIT in the lookup table */
+			for (b = pb[i]; b; b--, j++) {
+				span = 1 << (HUFF_BIT - 1 - i);		/* Number of entries that start with this code word */
+				hc = ph[j] << (HUFF_BIT - 1 - i);	/* First entry of the code word */
+				if (hc + span > HUFF_LEN) return JDR_FMT1;	/* Err: wrong code word table */
+				while (span--) pl[hc++] = (WORD)((i + 1) << 8 | pd[j]);	/* Code length and decoded data */
+			}
+		}
+		jd->longofs[num][cls] = (BYTE)j;	/* Code words longer than HUFF_BIT start here */
+#endif
 	}
 
 	return JDR_OK;
@@ -232,6 +356,8 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 /* Extract N bits from input stream                                      */
 /*-----------------------------------------------------------------------*/
 
+#if JD_FASTDECODE == 0
+
 static
 INT bitext (	/* >=0: extracted data, <0: error code */
 	JDEC* jd,	/* Pointer to the decompressor object */
@@ -276,6 +402,74 @@ INT bitext (	/* >=0: extracted data, <0: error code */
 	return (INT)v;
 }
 
+#else
+
+/* Fill the bit register up to nbit bits */
+static
+INT fillbits (	/* >=0: number of bits in the bit register, <0: error code */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT nbit	/* Number of bits required (1 to 16) */
+)
+{
+	BYTE *dp;
+	UINT dc, d, f, wbit;
+	DWORD w;
+
+
+	wbit = jd->dbit;
+	if (wbit >= nbit) return (INT)wbit;	/* Enough bits are available */
+
+	dc = jd->dctr; dp = jd->dptr;	/* Number of data available, read ptr */
+	w = jd->wreg & ((1UL << wbit) - 1);	/* Remaining bits in the bit register */
+	f = 0;
+	do {
+		if (jd->marker) {
+			d = 0xFF;			/* Input stream has stalled at a marker. Generate stuff bits */
+		} else {
+			if (!dc) {			/* No input data is available, re-fill input buffer */
+				dp = jd->inbuf;	/* Top of input buffer */
+				dc = jd->infunc(jd, dp, JD_SZBUF);
+				if (!dc) return 0 - JDR_INP;	/* Err: read error or wrong stream termination */
+			}
+			d = *dp++; dc--;	/* Get next data byte */
+			if (f) {			/* In flag sequence? */
+				f = 0;			/* Exit flag sequence */
+				if (d != 0) jd->marker = (BYTE)d;	/* Not an escaped 0xFF but a marker */
+				d = 0xFF;		/* The flag is a data 0xFF */
+			} else {
+				if (d == 0xFF) {	/* Is start of flag sequence? */
+					f = 1; continue;	/* Enter flag sequence, get trailing byte */
+				}
+			}
+		}
+		w = w << 8 | d;			/* Shift 8 bits in the bit register */
+		wbit += 8;
+	} while (wbit < nbit);
+	jd->wreg = w; jd->dctr = dc; jd->dptr = dp;
+
+	return (INT)wbit;
+}
+
+
+static
+INT bitext (	/* >=0: extracted data, <0: error code */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT nbit	/* Number of bits to extract (1 to 11) */
+)
+{
+	INT wbit;
+
+
+	wbit = fillbits(jd, nbit);		/* Prepare nbit bits in the bit register */
+	if (wbit < 0) return wbit;		/* Err: input */
+	wbit -= nbit;
+	jd->dbit = (BYTE)wbit;			/* Snip the data bits */
+
+	return (INT)(jd->wreg >> wbit) & ((1 << nbit) - 1);
+}
+
+#endif
+
 
 
 
@@ -286,11 +480,14 @@ INT bitext (	/* >=0: extracted data, <0: error code */
 static
 INT huffext (			/* >=0: decoded data, <0: error code */
 	JDEC* jd,			/* Pointer to the decompressor object */
-	const BYTE* hbits,	/* Pointer to the bit distribution table */
-	const WORD* hcode,	/* Pointer to the code word table */
-	const BYTE* hdata	/* Pointer to the data table */
+	UINT id,			/* Huffman table ID (0:Y, 1:C) */
+	UINT cls			/* Table class (0:DC, 1:AC) */
 )
 {
+	const BYTE* hbits = jd->huffbits[id][cls];	/* Pointer to the bit distribution table */
+	const WORD* hcode = jd->huffcode[id][cls];	/* Pointer to the code word table */
+	const BYTE* hdata = jd->huffdata[id][cls];	/* Pointer to the data table */
+#if JD_FASTDECODE == 0
 	BYTE msk, s, *dp;
 	UINT dc, v, f, bl, nd;
 
@@ -336,6 +533,47 @@ INT huffext (			/* >=0: decoded data, <0: error code */
 	} while (bl);
 
 	return 0 - JDR_FMT1;	/* Err: code not found (may be collapted data) */
+
+#else
+	INT wbit;
+	UINT v, bl, nd;
+	DWORD w;
+
+
+	wbit = fillbits(jd, 16);	/* Prepare 16 bits (max code length) in the bit register */
+	if (wbit < 0) return wbit;	/* Err: input */
+	w = jd->wreg;
+
+#if JD_FASTDECODE == 2
+	/* Look up the short code words in the table */
+	v = jd->hufflut[id][cls][(UINT)(w >> (wbit - HUFF_BIT)) & (HUFF_LEN - 1)];
+	if (v) {					/* Found in the table? */
+		jd->dbit = (BYTE)(wbit - (v >> 8));	/* Snip the code word */
+		return v & 0xFF;		/* Return the decoded data */
+	}
+	hbits += HUFF_BIT;			/* Search the code words longer than HUFF_BIT */
+	hcode += jd->longofs[id][cls];
+	hdata += jd->longofs[id][cls];
+	bl = HUFF_BIT + 1;
+#else
+	bl = 1;						/* Search all code words */
+#endif
+	for ( ; bl <= 16; bl++) {	/* Incremental search in each bit length */
+		nd = *hbits++;
+		if (nd) {
+			v = (UINT)(w >> (wbit - bl)) & ((1UL << bl) - 1);
+			do {				/* Search the code word in this bit length */
+				if (v == *hcode++) {	/* Matched? */
+					jd->dbit = (BYTE)(wbit - bl);	/* Snip the code word */
+					return *hdata;		/* Return the decoded data */
+				}
+				hdata++;
+			} while (--nd);
+		}
+	}
+
+	return 0 - JDR_FMT1;	/* Err: code not found (may be collapted data) */
+#endif
 }
 
 
@@ -454,6 +692,144 @@ void block_idct (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Apply Inverse-DCT to a block which has only low frequency elements    */
+/*-----------------------------------------------------------------------*/
+
+static
+void block_idct4 (
+	LONG* src,	/* Input block data (non-zero elements are only in the top-left 4x4) */
+	BYTE* dst	/* Pointer to the destination to store the block as byte array */
+)
+{
+	const LONG M13 = (LONG)(1.41421*4096), M2 = (LONG)(1.08239*4096), M4 = (LONG)(2.61313*4096), M5 = (LONG)(1.84776*4096);
+	LONG v0, v1, v2, v3, v4, v5, v6, v7;
+	LONG t10, t11, t13;
+	UINT i;
+
+	/* Process columns (right four columns are all zero and left as is) */
+	for (i = 0; i < 4; i++) {
+		t10 = src[8 * 0];	/* Get even elements (element 4 and 6 are zero) */
+		v1 = src[8 * 2];
+
+		t11 = (v1 * M13 >> 12) - v1;	/* Process the even elements */
+		v0 = t10 + v1;
+		v3 = t10 - v1;
+		v1 = t11 + t10;
+		v2 = t10 - t11;
+
+		v5 = src[8 * 1];	/* Get odd elements (element 5 and 7 are zero) */
+		v7 = src[8 * 3];
+
+		t11 = v5 + v7;		/* Process the odd elements */
+		t10 = v5 - v7;
+		t13 = t10 * M5 >> 12;
+		v4 = t13 - (v5 * M2 >> 12);
+		v6 = t13 - (-v7 * M4 >> 12) - t11;
+		v5 = (t10 * M13 >> 12) - v6;
+		v4 -= v5;
+		v7 = t11;
+
+		src[8 * 0] = v0 + v7;	/* Write-back transformed values */
+		src[8 * 7] = v0 - v7;
+		src[8 * 1] = v1 + v6;
+		src[8 * 6] = v1 - v6;
+		src[8 * 2] = v2 + v5;
+		src[8 * 5] = v2 - v5;
+		src[8 * 3] = v3 + v4;
+		src[8 * 4] = v3 - v4;
+
+		src++;	/* Next column */
+	}
+
+	/* Process rows (right four elements in each row are zero) */
+	src -= 4;
+	for (i = 0; i < 8; i++) {
+		t10 = src[0] + (128L << 8);	/* Get even elements (remove DC offset (-128) here) */
+		v1 = src[2];
+
+		t11 = (v1 * M13 >> 12) - v1;	/* Process the even elements */
+		v0 = t10 + v1;
+		v3 = t10 - v1;
+		v1 = t11 + t10;
+		v2 = t10 - t11;
+
+		v5 = src[1];				/* Get odd elements */
+		v7 = src[3];
+
+		t11 = v5 + v7;				/* Process the odd elements */
+		t10 = v5 - v7;
+		t13 = t10 * M5 >> 12;
+		v4 = t13 - (v5 * M2 >> 12);
+		v6 = t13 - (-v7 * M4 >> 12) - t11;
+		v5 = (t10 * M13 >> 12) - v6;
+		v4 -= v5;
+		v7 = t11;
+
+		dst[0] = BYTECLIP((v0 + v7) >> 8);	/* Descale the transformed values 8 bits and output */
+		dst[7] = BYTECLIP((v0 - v7) >> 8);
+		dst[1] = BYTECLIP((v1 + v6) >> 8);
+		dst[6] = BYTECLIP((v1 - v6) >> 8);
+		dst[2] = BYTECLIP((v2 + v5) >> 8);
+		dst[5] = BYTECLIP((v2 - v5) >> 8);
+		dst[3] = BYTECLIP((v3 + v4) >> 8);
+		dst[4] = BYTECLIP((v3 - v4) >> 8);
+		dst += 8;
+
+		src += 8;	/* Next row */
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Skip a block in the input stream (only the DC value is tracked)       */
+/*-----------------------------------------------------------------------*/
+
+static
+JRESULT block_skip (
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT cmp	/* Component number 0:Y, 1:Cb, 2:Cr */
+)
+{
+	UINT i, id;
+	INT b, e;
+
+
+	id = cmp ? 1 : 0;						/* Huffman table ID of the component */
+
+	/* Extract a DC element and update the DC value for the following blocks */
+	b = huffext(jd, id, 0);					/* Extract a huffman coded data (bit length) */
+	if (b < 0) return 0 - b;				/* Err: invalid code or input */
+	if (b) {								/* If there is any difference from previous block */
+		e = bitext(jd, b);					/* Extract data bits */
+		if (e < 0) return 0 - e;			/* Err: input */
+		b = 1 << (b - 1);					/* MSB position */
+		if (!(e & b)) e -= (b << 1) - 1;	/* Restore sign if needed */
+		jd->dcv[cmp] = (SHORT)(jd->dcv[cmp] + e);	/* Save current DC value for next block */
+	}
+
+	/* Skip following 63 AC elements in the input stream */
+	i = 1;					/* Top of the AC elements */
+	do {
+		b = huffext(jd, id, 1);				/* Extract a huffman coded value (zero runs and bit length) */
+		if (b == 0) break;					/* EOB? */
+		if (b < 0) return 0 - b;			/* Err: invalid code or input error */
+		i += (UINT)b >> 4;					/* Skip zero elements */
+		if (i >= 64) return JDR_FMT1;		/* Too long zero run */
+		if (b &= 0x0F) {					/* Bit length */
+			e = bitext(jd, b);				/* Discard data bits */
+			if (e < 0) return 0 - e;		/* Err: input device */
+		}
+	} while (++i < 64);		/* Next AC element */
+
+	return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Load all blocks in the MCU into working buffer                        */
 /*-----------------------------------------------------------------------*/
@@ -464,11 +840,9 @@ JRESULT mcu_load (
 )
 {
 	LONG *tmp = (LONG*)jd->workbuf;	/* Block working buffer for de-quantize and IDCT */
-	UINT blk, nby, nbc, i, z, id, cmp;
+	UINT blk, nby, nbc, i, z, zm, id, cmp;
 	INT b, d, e;
 	BYTE *bp;
-	const BYTE *hb, *hd;
-	const WORD *hc;
 	const LONG *dqf;
 
 
@@ -480,11 +854,16 @@ JRESULT mcu_load (
 		cmp = (blk < nby) ? 0 : blk - nby + 1;	/* Component number 0:Y, 1:Cb, 2:Cr */
 		id = cmp ? 1 : 0;						/* Huffman table ID of the component */
 
+#if JD_FORMAT == 2
+		if (cmp) {	/* Grayscale output does not use C blocks: only skip them in the input stream */
+			e = block_skip(jd, cmp);
+			if (e != JDR_OK) return e;
+			continue;
+		}
+#endif
+
 		/* Extract a DC element from input stream */
-		hb = jd->huffbits[id][0];				/* Huffman table for the DC element */
-		hc = jd->huffcode[id][0];
-		hd = jd->huffdata[id][0];
-		b = huffext(jd, hb, hc, hd);			/* Extract a huffman coded data (bit length) */
+		b = huffext(jd, id, 0);					/* Extract a huffman coded data (bit length) */
 		if (b < 0) return 0 - b;				/* Err: invalid code or input */
 		d = jd->dcv[cmp];						/* DC value of previous block */
 		if (b) {								/* If there is any difference from previous block */
@@ -500,12 +879,10 @@ JRESULT mcu_load (
 
 		/* Extract following 63 AC elements from input stream */
 		for (i = 1; i < 64; i++) tmp[i] = 0;	/* Clear rest of elements */
-		hb = jd->huffbits[id][1];				/* Huffman table for the AC elements */
-		hc = jd->huffcode[id][1];
-		hd = jd->huffdata[id][1];
 		i = 1;					/* Top of the AC elements */
+		zm = 0;					/* Positions of non-zero AC elements (OR of raster-order index) */
 		do {
-			b = huffext(jd, hb, hc, hd);		/* Extract a huffman coded value (zero runs and bit length) */
+			b = huffext(jd, id, 1);				/* Extract a huffman coded value (zero runs and bit length) */
 			if (b == 0) break;					/* EOB? */
 			if (b < 0) return 0 - b;			/* Err: invalid code or input error */
 			z = (UINT)b >> 4;					/* Number of leading zero elements */
@@ -520,13 +897,24 @@ JRESULT mcu_load (
 				if (!(d & b)) d -= (b << 1) - 1;/* Restore negative value if needed */
 				z = ZIG(i);						/* Zigzag-order to raster-order converted index */
 				tmp[z] = d * dqf[z] >> 8;		/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+				zm |= z;
 			}
 		} while (++i < 64);		/* Next AC element */
 
-		if (JD_USE_SCALE && jd->scale == 3)
+		if (JD_USE_SCALE && jd->scale == 3) {
 			*bp = (*tmp / 256) + 128;	/* If scale ratio is 1/8, IDCT can be ommited and only DC element is used */
-		else
+			jd->nidct[0]++;
+		} else if (!zm) {				/* Only DC element: the block is flat */
+			d = BYTECLIP((*tmp + (128L << 8)) >> 8);
+			for (i = 0; i < 64; i++) bp[i] = (BYTE)d;
+			jd->nidct[0]++;
+		} else if (!(zm & 0x24)) {		/* All non-zero elements are in the top-left 4x4 */
+			block_idct4(tmp, bp);
+			jd->nidct[1]++;
+		} else {
 			block_idct(tmp, bp);		/* Apply IDCT and store the block to the MCU buffer */
+			jd->nidct[2]++;
+		}
 
 		bp += 64;				/* Next block */
 	}
@@ -537,10 +925,45 @@ JRESULT mcu_load (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Skip all blocks in the MCU without de-quantize and IDCT               */
+/*-----------------------------------------------------------------------*/
+
+static
+JRESULT mcu_skip (
+	JDEC* jd		/* Pointer to the decompressor object */
+)
+{
+	UINT blk, nby;
+	JRESULT rc;
+
+
+	nby = jd->msx * jd->msy;	/* Number of Y blocks (1, 2 or 4) */
+	for (blk = 0; blk < nby + 2; blk++) {
+		rc = block_skip(jd, (blk < nby) ? 0 : blk - nby + 1);
+		if (rc != JDR_OK) return rc;
+	}
+
+	return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
 /*-----------------------------------------------------------------------*/
 
+#if JD_FORMAT == 1	/* RGB565: pack the pixel into a WORD as it is converted */
+#define	PIXSZ	2
+#define	PUTRGB(p, r, g, b)	(*(WORD*)(p) = (WORD)((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | ((b) >> 3)))
+#elif JD_FORMAT == 2	/* Grayscale: only the Y component is output */
+#define	PIXSZ	1
+#else				/* RGB888 */
+#define	PIXSZ	3
+#define	PUTRGB(p, r, g, b)	((p)[0] = (BYTE)(r), (p)[1] = (BYTE)(g), (p)[2] = (BYTE)(b))
+#endif
+
 static
 JRESULT mcu_output (
 	JDEC* jd,	/* Pointer to the decompressor object */
@@ -549,10 +972,13 @@ JRESULT mcu_output (
 	UINT y		/* MCU position in the image (top of the MCU) */
 )
 {
-	const INT CVACC = (sizeof (INT) > 2) ? 1024 : 128;
 	UINT ix, iy, mx, my, rx, ry;
-	INT yy, cb, cr;
-	BYTE *py, *pc, *rgb24;
+#if JD_FORMAT != 2
+	UINT hs, vs;
+	INT yy, r, g, b;
+	BYTE *pc;
+#endif
+	BYTE *py, *op;
 	JRECT rect;
 
 
@@ -568,73 +994,128 @@ JRESULT mcu_output (
 	rect.top = y; rect.bottom = y + ry - 1;
 
 
-	if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
+#if JD_FORMAT == 2
+	op = (BYTE*)jd->workbuf;
+	if (!JD_USE_SCALE || !jd->scale) {	/* Not scaled */
 
-		/* Build an RGB MCU from discrete comopnents */
-		rgb24 = (BYTE*)jd->workbuf;
+		/* Build a grayscale MCU from the Y blocks */
 		for (iy = 0; iy < my; iy++) {
-			pc = jd->mcubuf;
-			py = pc + iy * 8;
-			if (my == 16) {		/* Double block height? */
-				pc += 64 * 4 + (iy >> 1) * 8;
-				if (iy >= 8) py += 64;
-			} else {			/* Single block height */
-				pc += mx * 8 + iy * 8;
-			}
+			py = jd->mcubuf + (iy / 8) * mx * 8 + (iy % 8) * 8;	/* Y samples of the line */
 			for (ix = 0; ix < mx; ix++) {
-				cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
-				cr = pc[64] - 128;
-				if (mx == 16) {					/* Double block width? */
-					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
-					pc += ix & 1;				/* Increase chroma pointer every two pixels */
-				} else {						/* Single block width */
-					pc++;						/* Increase chroma pointer every pixel */
+				if (ix == 8) py += 64 - 8;	/* Jump to next block if double block width */
+				*op++ = *py++;
+			}
+		}
+
+	} else if (jd->scale != 3) {	/* For 1/2 and 1/4 scaling */
+
+		/* Get averaged Y value of each square correcponds to a pixel */
+		UINT x, y, a, s, w;
+
+		s = jd->scale * 2;	/* Bumber of shifts for averaging */
+		w = 1 << jd->scale;	/* Width of square (it never crosses the block boundary) */
+		for (iy = 0; iy < my; iy += w) {
+			for (ix = 0; ix < mx; ix += w) {
+				py = jd->mcubuf + ((iy / 8) * jd->msx + ix / 8) * 64 + (iy % 8) * 8 + ix % 8;	/* Top-left Y sample of the square */
+				a = 0;
+				for (y = 0; y < w; y++) {	/* Accumulate Y value in the square */
+					for (x = 0; x < w; x++) a += py[x];
+					py += 8;
 				}
-				yy = *py++;			/* Get Y component */
+				*op++ = (BYTE)(a >> s);		/* Put the averaged Y value as a pixel */
+			}
+		}
 
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+	} else {	/* For only 1/8 scaling (left-top pixel in each block are the DC value of the block) */
+
+		/* Build a 1/8 descaled grayscale MCU from the Y blocks */
+		for (iy = 0; iy < my; iy += 8) {
+			py = jd->mcubuf;
+			if (iy == 8) py += 64 * 2;
+			for (ix = 0; ix < mx; ix += 8) {
+				*op++ = *py;
+				py += 64;
 			}
 		}
+	}
+#else
+	hs = jd->msx - 1; vs = jd->msy - 1;					/* Chroma subsampling (0:None, 1:Half) */
+	if (!JD_USE_SCALE || !jd->scale) {	/* Not scaled */
 
-		/* Descale the MCU rectangular if needed */
-		if (JD_USE_SCALE && jd->scale) {
-			UINT x, y, r, g, b, s, w, a;
-			BYTE *op;
-
-			/* Get averaged RGB value of each square correcponds to a pixel */
-			s = jd->scale * 2;	/* Bumber of shifts for averaging */
-			w = 1 << jd->scale;	/* Width of square */
-			a = (mx - w) * 3;	/* Bytes to skip for next line in the square */
-			op = (BYTE*)jd->workbuf;
-			for (iy = 0; iy < my; iy += w) {
-				for (ix = 0; ix < mx; ix += w) {
-					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * 3;
-					r = g = b = 0;
-					for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
-						for (x = 0; x < w; x++) {
-							r += *rgb24++;
-							g += *rgb24++;
-							b += *rgb24++;
-						}
-						rgb24 += a;
-					}							/* Put the averaged RGB value as a pixel */
-					*op++ = (BYTE)(r >> s);
-					*op++ = (BYTE)(g >> s);
-					*op++ = (BYTE)(b >> s);
+		/* Build an RGB MCU from discrete comopnents */
+		pc = jd->mcubuf + mx * my;	/* Cb block (Cr block follows it) */
+		for (iy = 0; iy < my; iy += 1 << vs) {
+			py = jd->mcubuf + (iy / 8) * mx * 8 + (iy % 8) * 8;	/* Y samples of the line */
+			op = (BYTE*)jd->workbuf + iy * mx * PIXSZ;
+			for (ix = 0; ix < mx; ix += 1 << hs) {
+				if (ix == 8) py += 64 - 8;	/* Jump to next block if double block width */
+
+				/* Get color difference of the chroma sample */
+				r = Cr2R[pc[64]];
+				g = (Cb2G[pc[0]] + Cr2G[pc[64]]) >> 16;
+				b = Cb2B[pc[0]];
+				pc++;
+
+				/* Convert YCbCr to RGB for each Y sample sharing the chroma sample */
+				yy = py[0];
+				PUTRGB(op, BYTECLIP(yy + r), BYTECLIP(yy + g), BYTECLIP(yy + b));
+				if (hs) {
+					yy = py[1];
+					PUTRGB(op + PIXSZ, BYTECLIP(yy + r), BYTECLIP(yy + g), BYTECLIP(yy + b));
+				}
+				if (vs) {
+					yy = py[8];
+					PUTRGB(op + mx * PIXSZ, BYTECLIP(yy + r), BYTECLIP(yy + g), BYTECLIP(yy + b));
+					if (hs) {
+						yy = py[9];
+						PUTRGB(op + (mx + 1) * PIXSZ, BYTECLIP(yy + r), BYTECLIP(yy + g), BYTECLIP(yy + b));
+					}
 				}
+				py += 1 << hs; op += PIXSZ << hs;
+			}
+		}
+
+	} else if (jd->scale != 3) {	/* For 1/2 and 1/4 scaling */
+
+		/* Get averaged RGB value of each square correcponds to a pixel, converting YCbCr to RGB in the square */
+		UINT x, y, c, ar, ag, ab, s, w;
+
+		s = jd->scale * 2;	/* Bumber of shifts for averaging */
+		w = 1 << jd->scale;	/* Width of square (it never crosses the block boundary) */
+		op = (BYTE*)jd->workbuf;
+		for (iy = 0; iy < my; iy += w) {
+			for (ix = 0; ix < mx; ix += w) {
+				py = jd->mcubuf + ((iy / 8) * jd->msx + ix / 8) * 64 + (iy % 8) * 8 + ix % 8;	/* Top-left Y sample of the square */
+				ar = ag = ab = 0; r = g = b = 0;
+				for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
+					pc = jd->mcubuf + mx * my + ((iy + y) >> vs) * 8;
+					for (x = 0; x < w; x++) {
+						if (!(x & hs)) {	/* Get color difference when the chroma sample changes */
+							c = (ix + x) >> hs;
+							r = Cr2R[pc[64 + c]];
+							g = (Cb2G[pc[c]] + Cr2G[pc[64 + c]]) >> 16;
+							b = Cb2B[pc[c]];
+						}
+						yy = py[x];
+						ar += BYTECLIP(yy + r);
+						ag += BYTECLIP(yy + g);
+						ab += BYTECLIP(yy + b);
+					}
+					py += 8;
+				}							/* Put the averaged RGB value as a pixel */
+				PUTRGB(op, ar >> s, ag >> s, ab >> s);
+				op += PIXSZ;
 			}
 		}
 
 	} else {	/* For only 1/8 scaling (left-top pixel in each block are the DC value of the block) */
 
 		/* Build a 1/8 descaled RGB MCU from discrete comopnents */
-		rgb24 = (BYTE*)jd->workbuf;
+		op = (BYTE*)jd->workbuf;
 		pc = jd->mcubuf + mx * my;
-		cb = pc[0] - 128;		/* Get Cb/Cr component and restore right level */
-		cr = pc[64] - 128;
+		r = Cr2R[pc[64]];		/* Get color difference of the chroma sample */
+		g = (Cb2G[pc[0]] + Cr2G[pc[64]]) >> 16;
+		b = Cb2B[pc[0]];
 		for (iy = 0; iy < my; iy += 8) {
 			py = jd->mcubuf;
 			if (iy == 8) py += 64 * 2;
@@ -643,12 +1124,12 @@ JRESULT mcu_output (
 				py += 64;
 
 				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb / CVACC));
+				PUTRGB(op, BYTECLIP(yy + r), BYTECLIP(yy + g), BYTECLIP(yy + b));
+				op += PIXSZ;
 			}
 		}
 	}
+#endif
 
 	/* Squeeze up pixel table if a part of MCU is to be truncated */
 	mx >>= jd->scale;
@@ -658,29 +1139,13 @@ JRESULT mcu_output (
 
 		s = d = (BYTE*)jd->workbuf;
 		for (y = 0; y < ry; y++) {
-			for (x = 0; x < rx; x++) {	/* Copy effective pixels */
-				*d++ = *s++;
-				*d++ = *s++;
+			for (x = 0; x < rx * PIXSZ; x++) {	/* Copy effective pixels */
 				*d++ = *s++;
 			}
-			s += (mx - rx) * 3;	/* Skip truncated pixels */
+			s += (mx - rx) * PIXSZ;	/* Skip truncated pixels */
 		}
 	}
 
-	/* Convert RGB888 to RGB565 if needed */
-	if (JD_FORMAT == 1) {
-		BYTE *s = (BYTE*)jd->workbuf;
-		WORD w, *d = (WORD*)s;
-		UINT n = rx * ry;
-
-		do {
-			w = (*s++ & 0xF8) << 8;		/* RRRRR----------- */
-			w |= (*s++ & 0xFC) << 3;	/* -----GGGGGG----- */
-			w |= *s++ >> 3;				/* -----------BBBBB */
-			*d++ = w;
-		} while (--n);
-	}
-
 	/* Output the RGB rectangular */
 	return outfunc(jd, jd->workbuf, &rect) ? JDR_OK : JDR_INTR; 
 }
@@ -703,6 +1168,7 @@ JRESULT restart (
 	BYTE *dp;
 
 
+#if JD_FASTDECODE == 0
 	/* Discard padding bits and get two bytes from the input stream */
 	dp = jd->dptr; dc = jd->dctr;
 	d = 0;
@@ -718,6 +1184,26 @@ JRESULT restart (
 		d = (d << 8) | *dp;	/* Get a byte */
 	}
 	jd->dptr = dp; jd->dctr = dc; jd->dmsk = 0;
+#else
+	if (jd->marker) {	/* The marker has been detected by the bit register */
+		d = 0xFF00 | jd->marker;
+		jd->marker = 0;
+	} else {			/* Get two bytes from the input stream */
+		dp = jd->dptr; dc = jd->dctr;
+		d = 0;
+		for (i = 0; i < 2; i++) {
+			if (!dc) {	/* No input data is available, re-fill input buffer */
+				dp = jd->inbuf;
+				dc = jd->infunc(jd, dp, JD_SZBUF);
+				if (!dc) return JDR_INP;
+			}
+			d = (d << 8) | *dp++;	/* Get a byte */
+			dc--;
+		}
+		jd->dptr = dp; jd->dctr = dc;
+	}
+	jd->dbit = 0;		/* Discard padding bits */
+#endif
 
 	/* Check the marker */
 	if ((d & 0xFFD8) != 0xFFD0 || (d & 7) != (rstn & 7))
@@ -731,6 +1217,44 @@ JRESULT restart (
 
 
 
+#if JD_FASTDECODE != 0
+/*-----------------------------------------------------------------------*/
+/* Skip the rest of restart interval without decoding it                 */
+/*-----------------------------------------------------------------------*/
+
+static
+JRESULT skip_interval (
+	JDEC* jd	/* Pointer to the decompressor object */
+)
+{
+	UINT dc, f;
+	BYTE *dp, d;
+
+
+	if (!jd->marker) {	/* Search the input stream for the RSTn marker if not detected yet */
+		dp = jd->dptr; dc = jd->dctr;
+		f = 0;
+		for (;;) {
+			if (!dc) {	/* No input data is available, re-fill input buffer */
+				dp = jd->inbuf;
+				dc = jd->infunc(jd, dp, JD_SZBUF);
+				if (!dc) return JDR_INP;
+			}
+			d = *dp++; dc--;	/* Get a byte */
+			if (f && d != 0 && d != 0xFF) break;	/* Found a marker (not an escaped 0xFF nor a fill byte) */
+			f = (d == 0xFF);
+		}
+		jd->dptr = dp; jd->dctr = dc;
+		jd->marker = d;	/* restart() checks and consumes it */
+	}
+	jd->dbit = 0;		/* Discard the bits in the bit register */
+
+	return JDR_OK;
+}
+#endif
+
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Analyze the JPEG image and Initialize decompressor object             */
@@ -767,6 +1291,9 @@ JRESULT jd_prepare (
 			jd->huffbits[i][j] = 0;
 			jd->huffcode[i][j] = 0;
 			jd->huffdata[i][j] = 0;
+#if JD_FASTDECODE == 2
+			jd->hufflut[i][j] = 0;
+#endif
 		}
 	}
 	for (i = 0; i < 4; i++) jd->qttbl[i] = 0;
@@ -864,19 +1391,29 @@ JRESULT jd_prepare (
 			/* Allocate working buffer for MCU and RGB */
 			n = jd->msy * jd->msx;						/* Number of Y blocks in the MCU */
 			if (!n) return JDR_FMT1;					/* Err: SOF0 has not been loaded */
-			len = n * 64 * 2 + 64;						/* Allocate buffer for IDCT and RGB output */
+			len = n * 64 * 2;							/* Allocate buffer for IDCT and RGB output (RGB565 fits in it) */
+			if (JD_FORMAT == 0) len += 64;				/* RGB888 output needs more */
 			if (len < 256) len = 256;					/* but at least 256 byte is required for IDCT */
-			jd->workbuf = alloc_pool(jd, len);			/* and it may occupy a part of following MCU working buffer for RGB output */
+			jd->workbuf = alloc_pool(jd, len);			/* and RGB888 output may occupy a part of following MCU working buffer */
 			if (!jd->workbuf) return JDR_MEM1;			/* Err: not enough memory */
-			jd->mcubuf = alloc_pool(jd, (n + 2) * 64);	/* Allocate MCU working buffer */
+			jd->mcubuf = alloc_pool(jd, (n + (JD_FORMAT == 2 ? 0 : 2)) * 64);	/* Allocate MCU working buffer (C blocks are not kept for grayscale) */
 			if (!jd->mcubuf) return JDR_MEM1;			/* Err: not enough memory */
 
 			/* Pre-load the JPEG data to extract it from the bit stream */
+#if JD_FASTDECODE == 0
 			jd->dptr = seg; jd->dctr = 0; jd->dmsk = 0;	/* Prepare to read bit stream */
 			if (ofs %= JD_SZBUF) {						/* Align read offset to JD_SZBUF */
 				jd->dctr = jd->infunc(jd, seg + ofs, JD_SZBUF - (UINT)ofs);
 				jd->dptr = seg + ofs - 1;
 			}
+#else
+			jd->dptr = seg; jd->dctr = 0;				/* Prepare to read bit stream */
+			jd->dbit = 0; jd->marker = 0; jd->wreg = 0;	/* Empty the bit register */
+			if (ofs %= JD_SZBUF) {						/* Align read offset to JD_SZBUF */
+				jd->dctr = jd->infunc(jd, seg + ofs, JD_SZBUF - (UINT)ofs);
+				jd->dptr = seg + ofs;
+			}
+#endif
 
 			return JDR_OK;		/* Initialization succeeded. Ready to decompress the JPEG image. */
 
@@ -915,37 +1452,93 @@ JRESULT jd_decomp (
 	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
 	BYTE scale								/* Output de-scaling factor (0 to 3) */
 )
+{
+	return jd_decomp_roi(jd, outfunc, scale, 0);	/* Output whole picture */
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress only the MCUs overlapping a region of the JPEG picture     */
+/*-----------------------------------------------------------------------*/
+
+static
+int mcu_in_roi (	/* 0:Out of the region, 1:Overlaps the region */
+	const JRECT* roi,	/* Region (pixel) */
+	UINT x,				/* MCU position in the image (left of the MCU) */
+	UINT y,				/* MCU position in the image (top of the MCU) */
+	UINT mx,			/* MCU size (pixel) */
+	UINT my
+)
+{
+	return x <= roi->right && x + mx > roi->left && y <= roi->bottom && y + my > roi->top;
+}
+
+
+JRESULT jd_decomp_roi (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	const JRECT* roi						/* Region to output in the input picture (pixel), null for whole picture */
+)
 {
 	UINT x, y, mx, my;
 	WORD rst, rsc;
 	JRESULT rc;
+#if JD_FASTDECODE != 0
+	UINT ix, iy, n;
+#endif
 
 
 	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (roi && (roi->left > roi->right || roi->top > roi->bottom)) return JDR_PAR;
 	jd->scale = scale;
 
 	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
 
 	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;	/* Initialize DC values */
+	jd->nidct[2] = jd->nidct[1] = jd->nidct[0] = 0;	/* Clear IDCT statistics */
 	rst = rsc = 0;
 
 	rc = JDR_OK;
-	for (y = 0; y < jd->height; y += my) {		/* Vertical loop of MCUs */
-		for (x = 0; x < jd->width; x += mx) {	/* Horizontal loop of MCUs */
-			if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
-				rc = restart(jd, rsc++);
+	x = y = 0;
+	while (y < jd->height) {	/* Loop of MCUs in raster order */
+		if (roi && (y > roi->bottom || (y + my > roi->bottom && x > roi->right)))
+			break;				/* No more MCU overlaps the region: the rest of the stream is left unread */
+		if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
+			rc = restart(jd, rsc++);
+			if (rc != JDR_OK) return rc;
+			rst = 1;
+		}
+#if JD_FASTDECODE != 0
+		if (roi && rst == 1) {	/* Top of a restart interval? */
+			ix = x; iy = y;
+			for (n = jd->nrst; n && !mcu_in_roi(roi, ix, iy, mx, my); n--) {	/* Find an MCU overlapping the region in the interval */
+				ix += mx;
+				if (ix >= jd->width) { ix = 0; iy += my; }
+			}
+			if (!n) {			/* No MCU overlaps the region: jump to the next RSTn marker */
+				rc = skip_interval(jd);
 				if (rc != JDR_OK) return rc;
-				rst = 1;
+				x = ix; y = iy;
+				rst = jd->nrst;
+				continue;
 			}
+		}
+#endif
+		if (!roi || mcu_in_roi(roi, x, y, mx, my)) {
 			rc = mcu_load(jd);					/* Load an MCU (decompress huffman coded stream and IDCT) */
 			if (rc != JDR_OK) return rc;
 			rc = mcu_output(jd, outfunc, x, y);	/* Output the MCU (color space conversion, scaling and output) */
 			if (rc != JDR_OK) return rc;
+		} else {
+			rc = mcu_skip(jd);					/* Only keep track of the DC values */
+			if (rc != JDR_OK) return rc;
 		}
+		x += mx;								/* Next MCU */
+		if (x >= jd->width) { x = 0; y += my; }
 	}
 
 	return rc;
 }
-
-
-
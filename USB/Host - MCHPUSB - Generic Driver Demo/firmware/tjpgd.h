@@ -1,12 +1,18 @@
 /*----------------------------------------------------------------------------/
 / TJpgDec - Tiny JPEG Decompressor include file               (C)ChaN, 2011
 /----------------------------------------------------------------------------*/
+#ifndef _TJPGDEC
+#define _TJPGDEC
 
 /* System Configurations */
 
 #define	JD_SZBUF		1024	/* Size of stream input buffer (should be multiple of 512) */
-#define JD_FORMAT		1	/* Output RGB format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix) */
+#define JD_FORMAT		1	/* Output RGB format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix), 2:Grayscale (1 BYTE/pix) */
 #define	JD_USE_SCALE	1	/* Use descaling feature for output */
+#define	JD_FASTDECODE	2	/* Optimization level of the stream input */
+/*  0: Bit-serial input. Suitable for 8/16-bit MCUs.
+/   1: + 32-bit bit register refilled a byte at a time. Suitable for 32-bit MCUs.
+/   2: + Table driven huffman decoding (requires 1 KB/table of memory pool) */
 
 
 /*---------------------------------------------------------------------------*/
@@ -39,7 +45,13 @@ struct JDEC {
 	UINT dctr;				/* Number of bytes available in the input buffer */
 	BYTE* dptr;				/* Current data read ptr */
 	BYTE* inbuf;			/* Bit stream input buffer */
+#if JD_FASTDECODE == 0
 	BYTE dmsk;				/* Current bit in the current read byte */
+#else
+	BYTE dbit;				/* Number of bits available in the bit register */
+	BYTE marker;			/* Detected marker (0:None) */
+	DWORD wreg;				/* Bit register for the stream input */
+#endif
 	BYTE scale;				/* Output scaling ratio */
 	BYTE msx, msy;			/* MCU size in unit of block (width, height) */
 	BYTE qtid[3];			/* Quantization table ID of each component */
@@ -49,6 +61,10 @@ struct JDEC {
 	BYTE* huffbits[2][2];	/* Huffman bit distribution tables [id][dcac] */
 	WORD* huffcode[2][2];	/* Huffman code word tables [id][dcac] */
 	BYTE* huffdata[2][2];	/* Huffman decoded data tables [id][dcac] */
+#if JD_FASTDECODE == 2
+	WORD* hufflut[2][2];	/* Huffman fast lookup tables [id][dcac] */
+	BYTE longofs[2][2];		/* Offset to the code words longer than the lookup table [id][dcac] */
+#endif
 	LONG* qttbl[4];			/* Dequaitizer tables [id] */
 	void* workbuf;			/* Working buffer for IDCT and RGB output */
 	BYTE* mcubuf;			/* Working buffer for the MCU */
@@ -57,6 +73,7 @@ struct JDEC {
 	UINT (*infunc)(JDEC*, BYTE*, UINT);/* Pointer to jpeg stream input function */
 	UINT (*outfunc)(JDEC*, void*, JRECT*);	/* Pointer to RGB output function */
 	void* device;			/* Pointer to I/O device identifiler for the session */
+	UINT nidct[3];			/* Number of blocks processed by each IDCT path in the frame (0:DC only, 1:4x4, 2:Full) */
 };
 
 
@@ -67,4 +84,7 @@ struct JDEC {
 /* TJpgDec API functions */
 JRESULT jd_prepare (JDEC*, UINT(*)(JDEC*,BYTE*,UINT), void*, UINT, void*);
 JRESULT jd_decomp (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE);
+JRESULT jd_decomp_roi (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, const JRECT*);
+
+#endif /* _TJPGDEC */
 
@@ -51,6 +51,13 @@ DEFENSE THEREOF), OR OTHER SIMILAR COSTS.
 #define USB_ENABLE_ISOC_TRANSFER_EVENT
 
 #define USB_SUPPORT_ISOCHRONOUS_TRANSFERS//add naka
+#define USB_MAX_ISOCHRONOUS_DATA_BUFFERS 8//AC\NiX̃O̐[(1ms1obt@)
+#define USB_HOST_MEASURE_ISR_TIME//USB荞݂̍ő又Ԃ𑪂
+#define USB_HOST_COUNT_SCHEDULING//1t[̃Gh|Cg񐔂𐔂
+#define USB_HOST_ARENA_SIZE 6144//fBXNv^ƃC^[tF[Xmallocɂ̃A[i
+#define USB_HOST_DESCRIPTOR_CACHE//J}AÕfBXNv^Ɖ͌ʂg
+#define USB_HOST_MEASURE_ENUMERATION_TIME//ڑ\܂ł̎Ԃ𑪂
+#define USB_HOST_CONTROL_QUEUE_DEPTH 4//EP0̃NGXgL[ɓāA玟𑱂đ
 
 
 #define USB_MAX_GENERIC_DEVICES 1
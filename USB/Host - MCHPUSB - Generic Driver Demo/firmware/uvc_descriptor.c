@@ -0,0 +1,527 @@
+/******************************************************************************
+            UVC descriptor table
+
+This file provides the parser for the class-specific descriptors of the
+video streaming interface.  The configuration descriptor is walked once, and
+the formats, frames, frame intervals and isochronous alternate settings are
+kept in a compact table that the probe and commit controls are built from.
+
+******************************************************************************/
+
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "uvc_descriptor.h"
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define UVC_DESCRIPTOR_INTERFACE    0x04    // Standard interface descriptor
+#define UVC_DESCRIPTOR_ENDPOINT     0x05    // Standard endpoint descriptor
+
+#define UVC_FRAME_INTERVAL_OFFSET   26      // First interval of a frame descriptor
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static WORD _UVCDescriptorGetWord( BYTE *data )
+
+  Description:
+    This function reads a little endian WORD from a byte buffer that may
+    not be aligned.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *data  - Pointer to the first byte
+
+  Returns:
+    The value read
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static WORD _UVCDescriptorGetWord( BYTE *data )
+{
+    return (WORD)data[0] | ((WORD)data[1] << 8);
+}
+
+
+/****************************************************************************
+  Function:
+    static DWORD _UVCDescriptorGetDWord( BYTE *data )
+
+  Description:
+    This function reads a little endian DWORD from a byte buffer that may
+    not be aligned.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *data  - Pointer to the first byte
+
+  Returns:
+    The value read
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static DWORD _UVCDescriptorGetDWord( BYTE *data )
+{
+    return (DWORD)data[0] | ((DWORD)data[1] << 8) | ((DWORD)data[2] << 16) | ((DWORD)data[3] << 24);
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL _UVCDescriptorAddFormat( UVC_DESCRIPTOR_TABLE *table,
+                BYTE *descriptor )
+
+  Description:
+    This function adds a VS_FORMAT_MJPEG or VS_FORMAT_UNCOMPRESSED
+    descriptor to the table.  The frame descriptors that follow it are added
+    to this format.
+
+  Precondition:
+    None
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table - Descriptor table
+    BYTE *descriptor            - Format descriptor
+
+  Return Values:
+    TRUE    - The format was added
+    FALSE   - The table is full
+
+  Remarks:
+    Other formats are not supported by the decoder, and are skipped.
+  ***************************************************************************/
+
+static BOOL _UVCDescriptorAddFormat( UVC_DESCRIPTOR_TABLE *table, BYTE *descriptor )
+{
+    UVC_FORMAT_ENTRY    *format;
+
+    if (table->bNumFormats >= UVC_MAX_FORMATS)
+    {
+        table->bfTruncated = 1;
+        return FALSE;
+    }
+
+    format = &table->formats[table->bNumFormats++];
+    format->bFormatType  = descriptor[2];
+    format->bFormatIndex = descriptor[3];
+    format->bFirstFrame  = table->bNumFrames;
+    format->bNumFrames   = 0;
+    if (descriptor[2] == UVC_VS_FORMAT_MJPEG)
+    {
+        format->bDefaultFrameIndex = descriptor[6];
+    }
+    else
+    {
+        format->bDefaultFrameIndex = descriptor[22];
+    }
+    return TRUE;
+}
+
+
+/****************************************************************************
+  Function:
+    static void _UVCDescriptorAddFrame( UVC_DESCRIPTOR_TABLE *table,
+                BYTE *descriptor )
+
+  Description:
+    This function adds a VS_FRAME_MJPEG or VS_FRAME_UNCOMPRESSED descriptor
+    to the last format of the table, and its frame intervals to the interval
+    table.
+
+  Precondition:
+    The format of the frame has been added by _UVCDescriptorAddFormat().
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table - Descriptor table
+    BYTE *descriptor            - Frame descriptor
+
+  Returns:
+    None
+
+  Remarks:
+    A frame whose intervals do not fit is skipped.
+  ***************************************************************************/
+
+static void _UVCDescriptorAddFrame( UVC_DESCRIPTOR_TABLE *table, BYTE *descriptor )
+{
+    UVC_FORMAT_ENTRY    *format;
+    UVC_FRAME_ENTRY     *frame;
+    BYTE                count;
+    BYTE                i;
+
+    format = &table->formats[table->bNumFormats - 1];
+    count = descriptor[25];
+    if (count == 0)
+    {
+        count = 3;
+    }
+    if ((descriptor[0] < UVC_FRAME_INTERVAL_OFFSET + count * 4) ||
+        (table->bNumFrames >= UVC_MAX_FRAMES) ||
+        (table->bNumIntervals + count > UVC_MAX_FRAME_INTERVALS))
+    {
+        table->bfTruncated = 1;
+        return;
+    }
+
+    frame = &table->frames[table->bNumFrames++];
+    format->bNumFrames++;
+
+    frame->bFormatIndex              = format->bFormatIndex;
+    frame->bFrameIndex               = descriptor[3];
+    frame->wWidth                    = _UVCDescriptorGetWord( &descriptor[5] );
+    frame->wHeight                   = _UVCDescriptorGetWord( &descriptor[7] );
+    frame->dwMaxVideoFrameBufferSize = _UVCDescriptorGetDWord( &descriptor[17] );
+    frame->dwDefaultFrameInterval    = _UVCDescriptorGetDWord( &descriptor[21] );
+    frame->bFrameIntervalType        = descriptor[25];
+    frame->bFirstInterval            = table->bNumIntervals;
+    frame->bNumIntervals             = count;
+
+    for (i = 0; i < count; i++)
+    {
+        table->intervals[table->bNumIntervals++] =
+                _UVCDescriptorGetDWord( &descriptor[UVC_FRAME_INTERVAL_OFFSET + i * 4] );
+    }
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    BOOL UVCDescriptorParse( UVC_DESCRIPTOR_TABLE *table,
+                BYTE *pConfiguration )
+
+  Description:
+    This function walks the configuration descriptor, and builds the table
+    of the first video streaming interface: its formats, frames and frame
+    intervals, and the isochronous endpoint of each alternate setting.
+
+  Precondition:
+    None
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table - Descriptor table to fill
+    BYTE *pConfiguration        - Configuration descriptor, including all of
+                                    the interface, endpoint and
+                                    class-specific descriptors
+
+  Return Values:
+    TRUE    - A video streaming interface with at least one format, frame
+                and isochronous alternate setting was found
+    FALSE   - The device cannot be streamed from
+
+  Remarks:
+    Entries that do not fit in the table are skipped, and bfTruncated is
+    set.  The table is still usable.
+  ***************************************************************************/
+
+BOOL UVCDescriptorParse( UVC_DESCRIPTOR_TABLE *table, BYTE *pConfiguration )
+{
+    BYTE    *descriptor;
+    BYTE    *end;
+    BYTE    bAlternateSetting;
+    BYTE    bFrameType;
+    BOOL    inStreaming;
+
+    memset( table, 0, sizeof(UVC_DESCRIPTOR_TABLE) );
+    table->bControlInterface   = UVC_NO_INTERFACE;
+    table->bStreamingInterface = UVC_NO_INTERFACE;
+
+    if (pConfiguration == NULL)
+    {
+        return FALSE;
+    }
+
+    descriptor        = pConfiguration;
+    end               = pConfiguration + _UVCDescriptorGetWord( &pConfiguration[2] );
+    bAlternateSetting = 0;
+    bFrameType        = 0;
+    inStreaming       = FALSE;
+
+    while ((descriptor + 2 <= end) && (descriptor[0] >= 2) && (descriptor + descriptor[0] <= end))
+    {
+        switch (descriptor[1])
+        {
+            case UVC_DESCRIPTOR_INTERFACE:
+                inStreaming = FALSE;
+                if ((descriptor[0] < 9) || (descriptor[5] != UVC_CC_VIDEO))
+                {
+                    break;
+                }
+                if (descriptor[6] == UVC_SC_VIDEOCONTROL)
+                {
+                    if (table->bControlInterface == UVC_NO_INTERFACE)
+                    {
+                        table->bControlInterface = descriptor[2];
+                    }
+                }
+                else if (descriptor[6] == UVC_SC_VIDEOSTREAMING)
+                {
+                    if (table->bStreamingInterface == UVC_NO_INTERFACE)
+                    {
+                        table->bStreamingInterface = descriptor[2];
+                    }
+                    inStreaming       = (descriptor[2] == table->bStreamingInterface);
+                    bAlternateSetting = descriptor[3];
+                }
+                break;
+
+            case UVC_CS_INTERFACE:
+                if (!inStreaming || (bAlternateSetting != 0) || (descriptor[0] < 3))
+                {
+                    break;
+                }
+                switch (descriptor[2])
+                {
+                    case UVC_VS_INPUT_HEADER:
+                        if (descriptor[0] >= 7)
+                        {
+                            table->bEndpointAddress = descriptor[6];
+                        }
+                        break;
+
+                    case UVC_VS_FORMAT_MJPEG:
+                        bFrameType = 0;
+                        if ((descriptor[0] >= 11) && _UVCDescriptorAddFormat( table, descriptor ))
+                        {
+                            bFrameType = UVC_VS_FRAME_MJPEG;
+                        }
+                        break;
+
+                    case UVC_VS_FORMAT_UNCOMPRESSED:
+                        bFrameType = 0;
+                        if ((descriptor[0] >= 27) && _UVCDescriptorAddFormat( table, descriptor ))
+                        {
+                            bFrameType = UVC_VS_FRAME_UNCOMPRESSED;
+                        }
+                        break;
+
+                    default:
+                        // Frames are only kept for the format just added.
+                        // The frames of other formats have other subtypes.
+                        // bFrameType is 0 until a format has been added, and
+                        // a subtype of 0 must not match it.
+                        if ((bFrameType != 0) && (descriptor[2] == bFrameType) &&
+                            (descriptor[0] >= UVC_FRAME_INTERVAL_OFFSET))
+                        {
+                            _UVCDescriptorAddFrame( table, descriptor );
+                        }
+                        break;
+                }
+                break;
+
+            case UVC_DESCRIPTOR_ENDPOINT:
+                if (!inStreaming || (bAlternateSetting == 0) || (descriptor[0] < 7) ||
+                    ((descriptor[3] & 0x03) != 0x01))
+                {
+                    break;
+                }
+                if (table->bNumAltSettings >= UVC_MAX_ALT_SETTINGS)
+                {
+                    table->bfTruncated = 1;
+                    break;
+                }
+                {
+                    UVC_ALT_SETTING_ENTRY   *alt = &table->altSettings[table->bNumAltSettings++];
+                    WORD                    wMaxPacketSize = _UVCDescriptorGetWord( &descriptor[4] );
+
+                    alt->bAlternateSetting = bAlternateSetting;
+                    alt->bEndpointAddress  = descriptor[2];
+                    alt->wMaxPacketSize    = (wMaxPacketSize & 0x07FF) * (1 + ((wMaxPacketSize >> 11) & 0x03));
+                }
+                break;
+        }
+        descriptor += descriptor[0];
+    }
+
+    return (table->bStreamingInterface != UVC_NO_INTERFACE) &&
+           (table->bNumFrames != 0) && (table->bNumAltSettings != 0);
+}
+
+
+/****************************************************************************
+  Function:
+    UVC_FRAME_ENTRY * UVCDescriptorFindFrame( UVC_DESCRIPTOR_TABLE *table,
+                BYTE bFormatType, WORD wWidth, WORD wHeight )
+
+  Description:
+    This function finds the frame of the given format type and size.
+
+  Precondition:
+    UVCDescriptorParse() has returned TRUE.
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table - Descriptor table
+    BYTE bFormatType            - UVC_VS_FORMAT_MJPEG or
+                                    UVC_VS_FORMAT_UNCOMPRESSED
+    WORD wWidth                 - Width of the frame
+    WORD wHeight                - Height of the frame
+
+  Returns:
+    The frame entry, or NULL if the camera does not support the size.
+
+  Remarks:
+    If more than one format of the type has the size, the first one is
+    used.
+  ***************************************************************************/
+
+UVC_FRAME_ENTRY * UVCDescriptorFindFrame( UVC_DESCRIPTOR_TABLE *table, BYTE bFormatType, WORD wWidth, WORD wHeight )
+{
+    UVC_FORMAT_ENTRY    *format;
+    UVC_FRAME_ENTRY     *frame;
+    BYTE                i;
+    BYTE                j;
+
+    for (i = 0; i < table->bNumFormats; i++)
+    {
+        format = &table->formats[i];
+        if (format->bFormatType != bFormatType)
+        {
+            continue;
+        }
+        for (j = 0; j < format->bNumFrames; j++)
+        {
+            frame = &table->frames[format->bFirstFrame + j];
+            if ((frame->wWidth == wWidth) && (frame->wHeight == wHeight))
+            {
+                return frame;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/****************************************************************************
+  Function:
+    DWORD UVCDescriptorFindInterval( UVC_DESCRIPTOR_TABLE *table,
+                UVC_FRAME_ENTRY *frame, DWORD dwFrameInterval )
+
+  Description:
+    This function finds the frame interval of the frame that is nearest to
+    the requested one.
+
+  Precondition:
+    frame is an entry of the table.
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table - Descriptor table
+    UVC_FRAME_ENTRY *frame      - Frame entry
+    DWORD dwFrameInterval       - Requested interval, in 100ns units
+
+  Returns:
+    The frame interval to use in the probe and commit controls.
+
+  Remarks:
+    For a continuous range, the interval is clamped to the range and
+    rounded to the nearest step.
+  ***************************************************************************/
+
+DWORD UVCDescriptorFindInterval( UVC_DESCRIPTOR_TABLE *table, UVC_FRAME_ENTRY *frame, DWORD dwFrameInterval )
+{
+    DWORD   *intervals = &table->intervals[frame->bFirstInterval];
+    DWORD   best;
+    DWORD   bestDistance;
+    DWORD   distance;
+    BYTE    i;
+
+    if (frame->bFrameIntervalType == 0)
+    {
+        // intervals[0] is the minimum, [1] the maximum and [2] the step.
+        if (dwFrameInterval <= intervals[0])
+        {
+            return intervals[0];
+        }
+        if (dwFrameInterval >= intervals[1])
+        {
+            return intervals[1];
+        }
+        if (intervals[2] == 0)
+        {
+            return dwFrameInterval;
+        }
+        best = intervals[0] + (dwFrameInterval - intervals[0] + intervals[2] / 2) / intervals[2] * intervals[2];
+        return (best > intervals[1]) ? intervals[1] : best;
+    }
+
+    best         = frame->dwDefaultFrameInterval;
+    bestDistance = 0xFFFFFFFF;
+    for (i = 0; i < frame->bNumIntervals; i++)
+    {
+        distance = (intervals[i] > dwFrameInterval) ? (intervals[i] - dwFrameInterval) : (dwFrameInterval - intervals[i]);
+        if (distance < bestDistance)
+        {
+            best         = intervals[i];
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+
+/****************************************************************************
+  Function:
+    UVC_ALT_SETTING_ENTRY * UVCDescriptorSelectAltSetting(
+                UVC_DESCRIPTOR_TABLE *table, DWORD dwMaxPayloadTransferSize )
+
+  Description:
+    This function selects the alternate setting with the smallest
+    isochronous packet size that can still carry the payload size the
+    camera returned in the probe control.
+
+  Precondition:
+    UVCDescriptorParse() has returned TRUE.
+
+  Parameters:
+    UVC_DESCRIPTOR_TABLE *table     - Descriptor table
+    DWORD dwMaxPayloadTransferSize  - dwMaxPayloadTransferSize from the
+                                        probe control
+
+  Returns:
+    The alternate setting entry, or NULL if no alternate setting is large
+    enough.
+
+  Remarks:
+    Using the smallest alternate setting keeps the bus time reserved for
+    the stream as small as possible.
+  ***************************************************************************/
+
+UVC_ALT_SETTING_ENTRY * UVCDescriptorSelectAltSetting( UVC_DESCRIPTOR_TABLE *table, DWORD dwMaxPayloadTransferSize )
+{
+    UVC_ALT_SETTING_ENTRY   *best;
+    BYTE                    i;
+
+    best = NULL;
+    for (i = 0; i < table->bNumAltSettings; i++)
+    {
+        if ((table->altSettings[i].wMaxPacketSize >= dwMaxPayloadTransferSize) &&
+            ((best == NULL) || (table->altSettings[i].wMaxPacketSize < best->wMaxPacketSize)))
+        {
+            best = &table->altSettings[i];
+        }
+    }
+    return best;
+}
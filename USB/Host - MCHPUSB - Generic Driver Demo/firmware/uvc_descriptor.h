@@ -0,0 +1,150 @@
+/******************************************************************************
+            UVC descriptor table
+
+This file provides the parser for the class-specific descriptors of the
+video streaming interface.  It builds a compact table of the formats, frame
+sizes and frame intervals that the camera supports, and of the isochronous
+packet size of each alternate setting, so the streaming parameters and the
+alternate setting can be chosen from the descriptors instead of being fixed.
+
+******************************************************************************/
+
+#ifndef _UVC_DESCRIPTOR_H
+#define _UVC_DESCRIPTOR_H
+
+#include "GenericTypeDefs.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+// Sizes of the table.  Descriptors that do not fit are skipped.
+#ifndef UVC_MAX_FORMATS
+    #define UVC_MAX_FORMATS         4       // Format descriptors
+#endif
+#ifndef UVC_MAX_FRAMES
+    #define UVC_MAX_FRAMES          48      // Frame descriptors of all the formats
+#endif
+#ifndef UVC_MAX_FRAME_INTERVALS
+    #define UVC_MAX_FRAME_INTERVALS 192     // Frame intervals of all the frames
+#endif
+#ifndef UVC_MAX_ALT_SETTINGS
+    #define UVC_MAX_ALT_SETTINGS    16      // Alternate settings with an isochronous endpoint
+#endif
+
+// Interface class codes
+#define UVC_CC_VIDEO                0x0E
+#define UVC_SC_VIDEOCONTROL         0x01
+#define UVC_SC_VIDEOSTREAMING       0x02
+
+// Class-specific descriptor type
+#define UVC_CS_INTERFACE            0x24
+
+// Video streaming interface descriptor subtypes
+#define UVC_VS_INPUT_HEADER         0x01
+#define UVC_VS_FORMAT_UNCOMPRESSED  0x04
+#define UVC_VS_FRAME_UNCOMPRESSED   0x05
+#define UVC_VS_FORMAT_MJPEG         0x06
+#define UVC_VS_FRAME_MJPEG          0x07
+
+#define UVC_NO_INTERFACE            0xFF    // The interface was not found.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// *****************************************************************************
+/* UVC Format Entry
+
+This structure describes one format descriptor.  Its frames are the entries
+bFirstFrame to bFirstFrame + bNumFrames - 1 of the frame table.
+*/
+
+typedef struct _UVC_FORMAT_ENTRY
+{
+    BYTE        bFormatType;                // UVC_VS_FORMAT_MJPEG or UVC_VS_FORMAT_UNCOMPRESSED.
+    BYTE        bFormatIndex;               // Index to use in the probe and commit controls.
+    BYTE        bDefaultFrameIndex;         // Frame the camera uses by default.
+    BYTE        bFirstFrame;                // First entry of the frame table.
+    BYTE        bNumFrames;                 // Number of entries in the frame table.
+} UVC_FORMAT_ENTRY;
+
+
+// *****************************************************************************
+/* UVC Frame Entry
+
+This structure describes one frame descriptor.  If bFrameIntervalType is 0
+the frame interval is continuous, and the interval table holds the minimum,
+maximum and step.  Otherwise it holds the bNumIntervals discrete intervals.
+Frame intervals are in 100ns units.
+*/
+
+typedef struct _UVC_FRAME_ENTRY
+{
+    BYTE        bFormatIndex;               // Format of the frame.
+    BYTE        bFrameIndex;                // Index to use in the probe and commit controls.
+    BYTE        bFrameIntervalType;         // 0 for continuous, or the number of discrete intervals.
+    BYTE        bNumIntervals;              // Number of entries in the interval table.
+    WORD        wWidth;                     // Width of the frame, in pixels.
+    WORD        wHeight;                    // Height of the frame, in pixels.
+    DWORD       dwMaxVideoFrameBufferSize;  // Largest frame, in bytes.
+    DWORD       dwDefaultFrameInterval;     // Interval the camera uses by default.
+    BYTE        bFirstInterval;             // First entry of the interval table.
+} UVC_FRAME_ENTRY;
+
+
+// *****************************************************************************
+/* UVC Alternate Setting Entry
+
+This structure describes one alternate setting of the video streaming
+interface that has an isochronous endpoint.
+*/
+
+typedef struct _UVC_ALT_SETTING_ENTRY
+{
+    BYTE        bAlternateSetting;          // Value for SET_INTERFACE.
+    BYTE        bEndpointAddress;           // Isochronous endpoint of the setting.
+    WORD        wMaxPacketSize;             // Bytes the endpoint can move in each (micro)frame.
+} UVC_ALT_SETTING_ENTRY;
+
+
+// *****************************************************************************
+/* UVC Descriptor Table
+
+This structure holds everything UVCDescriptorParse() found for the first
+video streaming interface of the configuration.
+*/
+
+typedef struct _UVC_DESCRIPTOR_TABLE
+{
+    BYTE                    bControlInterface;                      // Video control interface.
+    BYTE                    bStreamingInterface;                    // Video streaming interface.
+    BYTE                    bEndpointAddress;                       // Endpoint from the input header.
+    BYTE                    bNumFormats;
+    BYTE                    bNumFrames;
+    BYTE                    bNumIntervals;
+    BYTE                    bNumAltSettings;
+    BYTE                    bfTruncated : 1;                        // Some descriptors did not fit in the table.
+    UVC_FORMAT_ENTRY        formats[UVC_MAX_FORMATS];
+    UVC_FRAME_ENTRY         frames[UVC_MAX_FRAMES];
+    DWORD                   intervals[UVC_MAX_FRAME_INTERVALS];
+    UVC_ALT_SETTING_ENTRY   altSettings[UVC_MAX_ALT_SETTINGS];
+} UVC_DESCRIPTOR_TABLE;
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+BOOL UVCDescriptorParse( UVC_DESCRIPTOR_TABLE *table, BYTE *pConfiguration );
+UVC_FRAME_ENTRY * UVCDescriptorFindFrame( UVC_DESCRIPTOR_TABLE *table, BYTE bFormatType, WORD wWidth, WORD wHeight );
+DWORD UVCDescriptorFindInterval( UVC_DESCRIPTOR_TABLE *table, UVC_FRAME_ENTRY *frame, DWORD dwFrameInterval );
+UVC_ALT_SETTING_ENTRY * UVCDescriptorSelectAltSetting( UVC_DESCRIPTOR_TABLE *table, DWORD dwMaxPayloadTransferSize );
+
+#endif
@@ -0,0 +1,353 @@
+/******************************************************************************
+            UVC payload stream
+
+This file provides the parser for the UVC payload header that starts each
+isochronous packet of the video streaming interface, and the frame assembler
+that finds the frame boundaries from the FID and EOF bits of the headers.
+The payload data itself is never scanned.
+
+******************************************************************************/
+
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "uvc_stream.h"
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define UVC_STREAM_NO_FRAME_ID      0xFF    // No payload has been seen yet.
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static DWORD _UVCStreamGetDWord( BYTE *data )
+
+  Description:
+    This function reads a little endian DWORD from a byte buffer that may
+    not be aligned.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *data  - Pointer to the first byte
+
+  Returns:
+    The value read
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static DWORD _UVCStreamGetDWord( BYTE *data )
+{
+    return (DWORD)data[0] | ((DWORD)data[1] << 8) | ((DWORD)data[2] << 16) | ((DWORD)data[3] << 24);
+}
+
+
+/****************************************************************************
+  Function:
+    static void _UVCStreamEndFrame( UVC_STREAM *stream )
+
+  Description:
+    This function completes the frame being assembled, and copies its
+    information to lastFrame.
+
+  Precondition:
+    A frame is being assembled.
+
+  Parameters:
+    UVC_STREAM *stream  - Stream information
+
+  Returns:
+    None
+
+  Remarks:
+    None
+  ***************************************************************************/
+
+static void _UVCStreamEndFrame( UVC_STREAM *stream )
+{
+    stream->lastFrame = stream->frame;
+    stream->frameCount++;
+    if (stream->frame.bfError)
+    {
+        stream->errorFrameCount++;
+    }
+    stream->bfInFrame    = 0;
+    stream->bfEndPending = 0;
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    BOOL UVCStreamParseHeader( BYTE *data, WORD length,
+                UVC_PAYLOAD_HEADER *header )
+
+  Description:
+    This function parses the UVC payload header at the start of an
+    isochronous packet.
+
+  Precondition:
+    None
+
+  Parameters:
+    BYTE *data                  - Received packet
+    WORD length                 - Length of the received packet
+    UVC_PAYLOAD_HEADER *header  - Parsed header
+
+  Return Values:
+    TRUE    - The header is valid.  The payload data starts at
+                data + header->bHeaderLength.
+    FALSE   - The packet is too short for its header.
+
+  Remarks:
+    The fields that are not present in the header are set to 0.  A
+    zero-length packet has no header, so FALSE is returned for it too.
+  ***************************************************************************/
+
+BOOL UVCStreamParseHeader( BYTE *data, WORD length, UVC_PAYLOAD_HEADER *header )
+{
+    BYTE    minLength;
+    BYTE    *field;
+
+    if (length < UVC_HEADER_MIN_LENGTH)
+    {
+        return FALSE;
+    }
+
+    header->bHeaderLength       = data[0];
+    header->bmHeaderInfo        = data[1];
+    header->dwPresentationTime  = 0;
+    header->dwSourceClock       = 0;
+    header->wSofCounter         = 0;
+
+    minLength = UVC_HEADER_MIN_LENGTH;
+    if (header->bmHeaderInfo & UVC_HEADER_PTS)
+    {
+        minLength += UVC_HEADER_PTS_LENGTH;
+    }
+    if (header->bmHeaderInfo & UVC_HEADER_SCR)
+    {
+        minLength += UVC_HEADER_SCR_LENGTH;
+    }
+    if ((header->bHeaderLength < minLength) || (header->bHeaderLength > length))
+    {
+        return FALSE;
+    }
+
+    field = data + UVC_HEADER_MIN_LENGTH;
+    if (header->bmHeaderInfo & UVC_HEADER_PTS)
+    {
+        header->dwPresentationTime = _UVCStreamGetDWord( field );
+        field += UVC_HEADER_PTS_LENGTH;
+    }
+    if (header->bmHeaderInfo & UVC_HEADER_SCR)
+    {
+        header->dwSourceClock = _UVCStreamGetDWord( field );
+        header->wSofCounter   = (WORD)field[4] | ((WORD)field[5] << 8);
+    }
+
+    return TRUE;
+}
+
+
+/****************************************************************************
+  Function:
+    void UVCStreamInit( UVC_STREAM *stream )
+
+  Description:
+    This function initializes the frame assembler.
+
+  Precondition:
+    None
+
+  Parameters:
+    UVC_STREAM *stream  - Stream information
+
+  Returns:
+    None
+
+  Remarks:
+    The first frame boundary after this call is used to synchronize, so the
+    frame that is arriving when streaming starts is not reported.
+  ***************************************************************************/
+
+void UVCStreamInit( UVC_STREAM *stream )
+{
+    memset( stream, 0, sizeof(UVC_STREAM) );
+    stream->bLastFrameID = UVC_STREAM_NO_FRAME_ID;
+}
+
+
+/****************************************************************************
+  Function:
+    BYTE UVCStreamPayload( UVC_STREAM *stream, BYTE *data, WORD length,
+                BYTE **payload, WORD *payloadLength )
+
+  Description:
+    This function passes one isochronous packet to the frame assembler.  It
+    parses the payload header, and finds the frame boundaries from the FID
+    and EOF bits.
+
+  Precondition:
+    UVCStreamInit() has been called.
+
+  Parameters:
+    UVC_STREAM *stream  - Stream information
+    BYTE *data          - Received packet
+    WORD length         - Length of the received packet
+    BYTE **payload      - Payload data of the current frame
+    WORD *payloadLength - Length of the payload data
+
+  Returns:
+    UVC_STREAM_xxx bits:
+    UVC_STREAM_FRAME_END    - A frame has been completed.  Its information is
+                                in stream->lastFrame.  If FRAME_START is also
+                                set, the frame was completed before this
+                                payload.
+    UVC_STREAM_FRAME_START  - This payload is the first of a new frame.
+    UVC_STREAM_FRAME_DATA   - *payload and *payloadLength give the data of
+                                the current frame.
+    UVC_STREAM_HEADER_ERROR - The header is broken, and the packet has been
+                                dropped.
+
+  Remarks:
+    Payloads that do not belong to a frame, such as header only packets sent
+    after the EOF bit, are dropped and 0 is returned.  Zero-length packets,
+    which the device sends when it has no data for a USB frame, are not
+    payloads.  They are ignored and do not count as header errors.
+
+    If the first payload of a frame also has the EOF bit set, the frame is
+    reported as completed on the next call, so FRAME_END together with
+    FRAME_START always means the previous frame.
+  ***************************************************************************/
+
+BYTE UVCStreamPayload( UVC_STREAM *stream, BYTE *data, WORD length, BYTE **payload, WORD *payloadLength )
+{
+    UVC_PAYLOAD_HEADER  header;
+    BYTE                frameID;
+    BYTE                result;
+    WORD                dataLength;
+
+    *payload       = NULL;
+    *payloadLength = 0;
+    result         = 0;
+
+    if (stream->bfEndPending)
+    {
+        _UVCStreamEndFrame( stream );
+        result |= UVC_STREAM_FRAME_END;
+    }
+
+    if (length == 0)
+    {
+        return result;
+    }
+
+    if (!UVCStreamParseHeader( data, length, &header ))
+    {
+        stream->headerErrorCount++;
+        if (stream->bfInFrame)
+        {
+            stream->frame.bfError = 1;
+        }
+        return result | UVC_STREAM_HEADER_ERROR;
+    }
+    frameID = header.bmHeaderInfo & UVC_HEADER_FID;
+
+    // Until a frame boundary is seen, the payloads may belong to a frame
+    // whose start has been missed.
+    if (!stream->bfSynchronized)
+    {
+        if ((stream->bLastFrameID == UVC_STREAM_NO_FRAME_ID) || (frameID == stream->bLastFrameID))
+        {
+            stream->bLastFrameID = frameID;
+            if (header.bmHeaderInfo & UVC_HEADER_EOF)
+            {
+                stream->bfSynchronized = 1;
+            }
+            return result;
+        }
+        stream->bfSynchronized = 1;
+    }
+
+    // An FID toggle completes the frame, even if its EOF payload was lost.
+    if (stream->bfInFrame && (frameID != stream->frame.bFrameID))
+    {
+        _UVCStreamEndFrame( stream );
+        result |= UVC_STREAM_FRAME_END;
+    }
+
+    if (!stream->bfInFrame)
+    {
+        if (frameID == stream->bLastFrameID)
+        {
+            // Left over from the frame that ended with the EOF bit.
+            return result;
+        }
+        memset( &stream->frame, 0, sizeof(UVC_FRAME_INFO) );
+        stream->frame.bFrameID = frameID;
+        stream->bLastFrameID   = frameID;
+        stream->bfInFrame      = 1;
+        result |= UVC_STREAM_FRAME_START;
+    }
+
+    stream->frame.payloadCount++;
+    if ((header.bmHeaderInfo & UVC_HEADER_PTS) && !stream->frame.bfPTS)
+    {
+        stream->frame.dwPresentationTime = header.dwPresentationTime;
+        stream->frame.bfPTS              = 1;
+    }
+    if (header.bmHeaderInfo & UVC_HEADER_SCR)
+    {
+        stream->frame.dwSourceClock = header.dwSourceClock;
+        stream->frame.wSofCounter   = header.wSofCounter;
+        stream->frame.bfSCR         = 1;
+    }
+    if (header.bmHeaderInfo & UVC_HEADER_ERR)
+    {
+        stream->frame.bfError = 1;
+    }
+
+    dataLength = length - header.bHeaderLength;
+    if (dataLength != 0)
+    {
+        stream->frame.frameSize += dataLength;
+        *payload       = data + header.bHeaderLength;
+        *payloadLength = dataLength;
+        result |= UVC_STREAM_FRAME_DATA;
+    }
+
+    if (header.bmHeaderInfo & UVC_HEADER_EOF)
+    {
+        stream->frame.bfEndOfFrame = 1;
+        if (result & UVC_STREAM_FRAME_START)
+        {
+            stream->bfEndPending = 1;
+        }
+        else
+        {
+            _UVCStreamEndFrame( stream );
+            result |= UVC_STREAM_FRAME_END;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,116 @@
+/******************************************************************************
+            UVC payload stream
+
+This file provides the parser for the UVC payload header that starts each
+isochronous packet of the video streaming interface, and the frame assembler
+that finds the frame boundaries from the FID and EOF bits of the headers.
+
+******************************************************************************/
+
+#ifndef _UVC_STREAM_H
+#define _UVC_STREAM_H
+
+#include "GenericTypeDefs.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+// bmHeaderInfo bits of the UVC payload header
+#define UVC_HEADER_FID              0x01    // Frame ID, toggles on each new frame
+#define UVC_HEADER_EOF              0x02    // End of frame
+#define UVC_HEADER_PTS              0x04    // dwPresentationTime is present
+#define UVC_HEADER_SCR              0x08    // dwSourceClock is present
+#define UVC_HEADER_RES              0x10    // Reserved
+#define UVC_HEADER_STI              0x20    // Still image
+#define UVC_HEADER_ERR              0x40    // Error in the device streaming
+#define UVC_HEADER_EOH              0x80    // End of header
+
+#define UVC_HEADER_MIN_LENGTH       2       // bHeaderLength and bmHeaderInfo
+#define UVC_HEADER_PTS_LENGTH       4       // dwPresentationTime
+#define UVC_HEADER_SCR_LENGTH       6       // dwSourceClock (STC and SOF counter)
+
+// Results of UVCStreamPayload().  More than one may be set.
+#define UVC_STREAM_FRAME_START      0x01    // The payload is the first of a frame.
+#define UVC_STREAM_FRAME_END        0x02    // A frame has been completed.  See lastFrame.
+#define UVC_STREAM_FRAME_DATA       0x04    // The payload holds data of the current frame.
+#define UVC_STREAM_HEADER_ERROR     0x80    // The payload header is broken.  The payload is dropped.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// *****************************************************************************
+/* UVC Payload Header
+
+This structure holds the fields of a UVC payload header.  The fields that are
+not present in the header are set to 0.
+*/
+
+typedef struct _UVC_PAYLOAD_HEADER
+{
+    BYTE        bHeaderLength;          // Length of the header, in bytes.
+    BYTE        bmHeaderInfo;           // UVC_HEADER_xxx bits.
+    DWORD       dwPresentationTime;     // Presentation time stamp (PTS).
+    DWORD       dwSourceClock;          // Source time clock (STC) of the SCR.
+    WORD        wSofCounter;            // 1 KHz SOF counter of the SCR.
+} UVC_PAYLOAD_HEADER;
+
+
+// *****************************************************************************
+/* UVC Frame Information
+
+This structure describes a frame found by the frame assembler.
+*/
+
+typedef struct _UVC_FRAME_INFO
+{
+    DWORD       frameSize;              // Payload bytes of the frame, without the headers.
+    DWORD       dwPresentationTime;     // PTS of the frame.
+    DWORD       dwSourceClock;          // STC of the last SCR in the frame.
+    WORD        wSofCounter;            // SOF counter of the last SCR in the frame.
+    WORD        payloadCount;           // Number of payloads in the frame.
+    BYTE        bFrameID;               // FID bit of the frame.
+    BYTE        bfEndOfFrame : 1;       // The frame ended with the EOF bit, not with an FID toggle.
+    BYTE        bfError      : 1;       // The ERR bit was set, or a header was broken.
+    BYTE        bfPTS        : 1;       // dwPresentationTime is valid.
+    BYTE        bfSCR        : 1;       // dwSourceClock and wSofCounter are valid.
+} UVC_FRAME_INFO;
+
+
+// *****************************************************************************
+/* UVC Stream
+
+This structure holds the state of the frame assembler for one video
+streaming endpoint.
+*/
+
+typedef struct _UVC_STREAM
+{
+    UVC_FRAME_INFO  frame;              // Frame being assembled.
+    UVC_FRAME_INFO  lastFrame;          // Last completed frame.
+    DWORD           frameCount;         // Number of completed frames.
+    DWORD           errorFrameCount;    // Number of completed frames with bfError set.
+    DWORD           headerErrorCount;   // Number of payloads with a broken header.
+    BYTE            bLastFrameID;       // FID bit of the last payload.
+    BYTE            bfSynchronized : 1; // A frame boundary has been seen since UVCStreamInit().
+    BYTE            bfInFrame      : 1; // A frame is being assembled.
+    BYTE            bfEndPending   : 1; // The frame ended with its first payload.
+} UVC_STREAM;
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+BOOL UVCStreamParseHeader( BYTE *data, WORD length, UVC_PAYLOAD_HEADER *header );
+void UVCStreamInit( UVC_STREAM *stream );
+BYTE UVCStreamPayload( UVC_STREAM *stream, BYTE *data, WORD length, BYTE **payload, WORD *payloadLength );
+
+#endif
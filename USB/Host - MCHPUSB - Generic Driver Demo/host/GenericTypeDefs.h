@@ -0,0 +1,68 @@
+/******************************************************************************
+            Generic type definitions for the host build
+
+This file replaces Microchip/Include/GenericTypeDefs.h when the firmware
+modules are built on a PC.  The Microchip header defines DWORD and LONG as
+long, which is 64 bits on a 64-bit host, so the types are taken from
+<stdint.h> here instead.  Only the types used by the modules in the host
+build are defined, with BYTE_VAL and WORD_VAL for the USB host stack.
+
+The include guard is the same as the Microchip header, so integer.h uses
+these types for TJpgDec too.
+
+******************************************************************************/
+
+#ifndef __GENERIC_TYPE_DEFS_H_
+#define __GENERIC_TYPE_DEFS_H_
+
+#include <stdint.h>
+
+typedef enum _BOOL { FALSE = 0, TRUE } BOOL;
+
+typedef int                 INT;
+typedef unsigned int        UINT;
+typedef int8_t              INT8;
+typedef int16_t             INT16;
+typedef int32_t             INT32;
+typedef uint8_t             UINT8;
+typedef uint16_t            UINT16;
+typedef uint32_t            UINT32;
+
+typedef void                VOID;
+typedef uint8_t             BYTE;       /* 8-bit unsigned  */
+typedef uint16_t            WORD;       /* 16-bit unsigned */
+typedef uint32_t            DWORD;      /* 32-bit unsigned */
+typedef uint64_t            QWORD;      /* 64-bit unsigned */
+typedef int8_t              CHAR;       /* 8-bit signed    */
+typedef int16_t             SHORT;      /* 16-bit signed   */
+typedef int32_t             LONG;       /* 32-bit signed   */
+typedef int64_t             LONGLONG;   /* 64-bit signed   */
+
+typedef union
+{
+    BYTE Val;
+    struct __attribute__((packed))
+    {
+        BYTE b0:1;
+        BYTE b1:1;
+        BYTE b2:1;
+        BYTE b3:1;
+        BYTE b4:1;
+        BYTE b5:1;
+        BYTE b6:1;
+        BYTE b7:1;
+    } bits;
+} BYTE_VAL, BYTE_BITS;
+
+typedef union
+{
+    WORD Val;
+    BYTE v[2];
+    struct __attribute__((packed))
+    {
+        BYTE LB;
+        BYTE HB;
+    } byte;
+} WORD_VAL, WORD_BITS;
+
+#endif
@@ -0,0 +1,225 @@
+/******************************************************************************
+            UVC packet trace generator
+
+This is a PC tool that writes a packet trace for replay.c.  The JPEG files
+given on the command line are cut into isochronous packets with the UVC
+payload header that the C270 sends: bHeaderLength 12, PTS and SCR present,
+the FID bit toggling on each frame and the EOF bit on the last packet of a
+frame.  Between the frames, the idle packets that the camera sends while
+it has no data are inserted: zero-length packets and header only packets.
+Zero-length packets can also be put between the packets of a frame, as the
+camera sends them when it is slower than the bandwidth it reserved.
+
+Trace file format:
+    Each record is one isochronous packet, as passed to the data event
+    handler: a 2 byte little endian length followed by the packet bytes.
+    A length of 0 is a zero-length packet.
+
+Usage:
+    mktrace [-p packet size] [-n frames] [-g idle packets] [-z interval]
+            output jpeg...
+
+    The packet size defaults to 960 bytes.  The JPEG files are repeated
+    until the number of frames given with -n has been written.  The number
+    of idle packets between the frames defaults to 4.  With -z, a
+    zero-length packet follows every given number of data packets.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+// These must match firmware/uvc_stream.h.
+#define UVC_HEADER_FID              0x01
+#define UVC_HEADER_EOF              0x02
+#define UVC_HEADER_PTS              0x04
+#define UVC_HEADER_SCR              0x08
+#define UVC_HEADER_EOH              0x80
+
+#define HEADER_LENGTH               12          // bHeaderLength, bmHeaderInfo, PTS and SCR
+#define MAX_PACKET_SIZE             1023        // Largest full speed isochronous packet.
+#define PTS_PER_FRAME               (48000000 / 5)  // 5 fps at a 48 MHz clock.
+#define SOF_PER_PACKET              1           // One packet per 1 ms frame.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+static void PutDWord( unsigned char *data, unsigned long value )
+{
+    data[0] = (unsigned char)value;
+    data[1] = (unsigned char)(value >> 8);
+    data[2] = (unsigned char)(value >> 16);
+    data[3] = (unsigned char)(value >> 24);
+}
+
+
+static void WritePacket( FILE *fp, const unsigned char *packet, unsigned int length )
+{
+    fputc( length & 0xFF, fp );
+    fputc( length >> 8, fp );
+    fwrite( packet, 1, length, fp );
+}
+
+
+static void MakeHeader( unsigned char *packet, unsigned char info, unsigned long pts, unsigned long sof )
+{
+    packet[0] = HEADER_LENGTH;
+    packet[1] = UVC_HEADER_EOH | UVC_HEADER_PTS | UVC_HEADER_SCR | info;
+    PutDWord( packet + 2, pts );
+    PutDWord( packet + 6, sof * 48000 );        // STC at 48 MHz
+    packet[10] = (unsigned char)(sof & 0xFF);
+    packet[11] = (unsigned char)((sof >> 8) & 0x07);
+}
+
+
+static unsigned char * ReadFile( const char *name, unsigned long *length )
+{
+    unsigned char   *data;
+    FILE            *fp;
+    long            size;
+
+    fp = fopen( name, "rb" );
+    if (fp == NULL)
+    {
+        perror( name );
+        return NULL;
+    }
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+
+    data = malloc( size > 0 ? size : 1 );
+    if ((data == NULL) || (fread( data, 1, size, fp ) != (size_t)size))
+    {
+        fprintf( stderr, "%s: read error\n", name );
+        free( data );
+        fclose( fp );
+        return NULL;
+    }
+    fclose( fp );
+    *length = size;
+    return data;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    unsigned char   packet[MAX_PACKET_SIZE];
+    unsigned char   *jpeg;
+    unsigned long   jpegLength;
+    unsigned long   offset;
+    unsigned long   sof = 0;
+    unsigned int    packetSize = 960;
+    unsigned int    chunk;
+    unsigned int    frames = 0;
+    unsigned int    idle = 4;
+    unsigned int    interval = 0;
+    unsigned int    dataPackets = 0;
+    unsigned int    frame;
+    unsigned int    i;
+    unsigned char   fid = 0;
+    unsigned char   info;
+    FILE            *fp;
+    int             opt;
+
+    while ((opt = getopt( argc, argv, "p:n:g:z:" )) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            packetSize = atoi( optarg );
+            break;
+        case 'n':
+            frames = atoi( optarg );
+            break;
+        case 'g':
+            idle = atoi( optarg );
+            break;
+        case 'z':
+            interval = atoi( optarg );
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if ((argc - optind < 2) || (packetSize <= HEADER_LENGTH) || (packetSize > MAX_PACKET_SIZE))
+    {
+        fprintf( stderr, "Usage: %s [-p packet size] [-n frames] [-g idle packets] [-z interval] output jpeg...\n", argv[0] );
+        return 1;
+    }
+    if (frames == 0)
+    {
+        frames = argc - optind - 1;
+    }
+
+    fp = fopen( argv[optind], "wb" );
+    if (fp == NULL)
+    {
+        perror( argv[optind] );
+        return 1;
+    }
+
+    for (frame = 0; frame < frames; frame++)
+    {
+        jpeg = ReadFile( argv[optind + 1 + frame % (argc - optind - 1)], &jpegLength );
+        if (jpeg == NULL)
+        {
+            fclose( fp );
+            return 1;
+        }
+
+        for (offset = 0; offset < jpegLength; offset += chunk)
+        {
+            chunk = packetSize - HEADER_LENGTH;
+            info  = fid;
+            if (offset + chunk >= jpegLength)
+            {
+                chunk = jpegLength - offset;
+                info |= UVC_HEADER_EOF;
+            }
+            MakeHeader( packet, info, frame * PTS_PER_FRAME, sof );
+            memcpy( packet + HEADER_LENGTH, jpeg + offset, chunk );
+            WritePacket( fp, packet, HEADER_LENGTH + chunk );
+            sof += SOF_PER_PACKET;
+
+            dataPackets++;
+            if ((interval != 0) && (dataPackets % interval == 0))
+            {
+                WritePacket( fp, packet, 0 );
+                sof += SOF_PER_PACKET;
+            }
+        }
+        free( jpeg );
+
+        // Idle packets until the next frame starts.
+        for (i = 0; i < idle; i++)
+        {
+            if (i & 1)
+            {
+                MakeHeader( packet, fid | UVC_HEADER_EOF, frame * PTS_PER_FRAME, sof );
+                WritePacket( fp, packet, HEADER_LENGTH );
+            }
+            else
+            {
+                WritePacket( fp, packet, 0 );
+            }
+            sof += SOF_PER_PACKET;
+        }
+        fid ^= UVC_HEADER_FID;
+    }
+
+    fclose( fp );
+    return 0;
+}
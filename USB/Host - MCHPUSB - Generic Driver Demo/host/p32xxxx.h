@@ -0,0 +1,15 @@
+/******************************************************************************
+            p32xxxx.h stand-in for the PC build
+
+Compiler.h includes <p32xxxx.h> when __PIC32MX__ is defined.  On the PC,
+only the USB module and its interrupt are needed; they are in
+usb_hal_pic32.h.
+
+******************************************************************************/
+
+#ifndef _HOST_P32XXXX_H
+#define _HOST_P32XXXX_H
+
+#include "usb_hal_pic32.h"
+
+#endif
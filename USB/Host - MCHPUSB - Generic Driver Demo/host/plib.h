@@ -0,0 +1,17 @@
+/******************************************************************************
+            plib.h stand-in for the PC build
+
+Compiler.h includes <plib.h> when __PIC32MX__ is defined.  Only the core
+timer is used by the USB host stack.  It counts at half of the system
+clock, as on the PIC32, and is kept by sim_usb.c.
+
+******************************************************************************/
+
+#ifndef _HOST_PLIB_H
+#define _HOST_PLIB_H
+
+#include "GenericTypeDefs.h"
+
+DWORD ReadCoreTimer( void );
+
+#endif
@@ -0,0 +1,251 @@
+/******************************************************************************
+            UVC packet trace replay
+
+This is a PC tool that runs the capture and decode path of the demo on a
+packet trace.  Each packet of the trace is passed to FramePoolPayload() as
+the USB interrupt does, and each frame that becomes ready is decoded with
+jd_decomp() as jpeg_decode() in main.c does.  It reports the frame pool
+counters, the decode rate in MCUs per second and the frame rate.
+
+The trace file format is described in mktrace.c.
+
+Usage:
+    replay [-s scale] [-n loops] trace
+
+    The scale is the jd_decomp() scale, 0 to 3.  The trace is replayed the
+    given number of times, and the rates are taken over all of them.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "GenericTypeDefs.h"
+#include "frame_pool.h"
+#include "tjpgd.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define JPEG_WORK_SIZE              (8 * 1024)  // Same as main.c
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+typedef struct
+{
+    const BYTE      *data;                  // Frame being decoded.
+    DWORD           length;                 // Length of the frame.
+    DWORD           offset;                 // Bytes read by TJpgDec.
+    DWORD           checksum;               // Sum of the output pixels.
+} JPEG_SOURCE;
+
+typedef struct
+{
+    unsigned long   frames;                 // Frames decoded.
+    unsigned long   decodeErrors;           // Frames jd_prepare() or jd_decomp() failed on.
+    unsigned long long mcus;                // MCUs decoded.
+    double          decodeTime;             // Seconds spent in TJpgDec.
+    double          totalTime;              // Seconds of the whole replay.
+    DWORD           checksum;               // Sum of the output pixels of all frames.
+} STATS;
+
+static FRAME_POOL   framePool;
+static BYTE         jpegWork[JPEG_WORK_SIZE];
+static STATS        stats;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+static double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static UINT JpegInput( JDEC *jd, BYTE *buff, UINT nbyte )
+{
+    JPEG_SOURCE     *source = (JPEG_SOURCE *)jd->device;
+
+    if (nbyte > source->length - source->offset)
+    {
+        nbyte = source->length - source->offset;
+    }
+    if (buff != NULL)
+    {
+        memcpy( buff, source->data + source->offset, nbyte );
+    }
+    source->offset += nbyte;
+    return nbyte;
+}
+
+
+static UINT JpegOutput( JDEC *jd, void *bitmap, JRECT *rect )
+{
+    JPEG_SOURCE     *source = (JPEG_SOURCE *)jd->device;
+
+    // Only the first pixel of each block is summed, so that the output
+    // function costs about as little as the LCD write of the demo.
+    source->checksum += *(BYTE *)bitmap + rect->left + rect->top;
+    return 1;
+}
+
+
+static void DecodeFrame( FRAME_BUFFER *frame, BYTE scale )
+{
+    JPEG_SOURCE     source;
+    JDEC            jdec;
+    JRESULT         rc;
+    double          start;
+
+    source.data     = frame->data;
+    source.length   = frame->length;
+    source.offset   = 0;
+    source.checksum = 0;
+
+    start = Now();
+    rc = jd_prepare( &jdec, JpegInput, jpegWork, sizeof(jpegWork), &source );
+    if (rc == JDR_OK)
+    {
+        rc = jd_decomp( &jdec, JpegOutput, scale );
+    }
+    stats.decodeTime += Now() - start;
+
+    if (rc != JDR_OK)
+    {
+        stats.decodeErrors++;
+        return;
+    }
+    stats.frames++;
+    stats.mcus += (unsigned long long)((jdec.width + jdec.msx * 8 - 1) / (jdec.msx * 8)) *
+                  ((jdec.height + jdec.msy * 8 - 1) / (jdec.msy * 8));
+    stats.checksum += source.checksum;
+}
+
+
+static BYTE * ReadTrace( const char *name, unsigned long *length )
+{
+    BYTE            *data;
+    FILE            *fp;
+    long            size;
+
+    fp = fopen( name, "rb" );
+    if (fp == NULL)
+    {
+        perror( name );
+        return NULL;
+    }
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+
+    data = malloc( size > 0 ? size : 1 );
+    if ((data == NULL) || (fread( data, 1, size, fp ) != (size_t)size))
+    {
+        fprintf( stderr, "%s: read error\n", name );
+        free( data );
+        fclose( fp );
+        return NULL;
+    }
+    fclose( fp );
+    *length = size;
+    return data;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    FRAME_BUFFER    *frame;
+    BYTE            *trace;
+    unsigned long   traceLength;
+    unsigned long   offset;
+    unsigned long   packets = 0;
+    unsigned int    loops = 1;
+    unsigned int    loop;
+    WORD            length;
+    BYTE            scale = 0;
+    double          start;
+    int             opt;
+
+    while ((opt = getopt( argc, argv, "s:n:" )) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            scale = atoi( optarg );
+            break;
+        case 'n':
+            loops = atoi( optarg );
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if ((argc - optind != 1) || (scale > 3) || (loops == 0))
+    {
+        fprintf( stderr, "Usage: %s [-s scale] [-n loops] trace\n", argv[0] );
+        return 1;
+    }
+
+    trace = ReadTrace( argv[optind], &traceLength );
+    if (trace == NULL)
+    {
+        return 1;
+    }
+
+    FramePoolInit( &framePool );
+    start = Now();
+    for (loop = 0; loop < loops; loop++)
+    {
+        for (offset = 0; offset + 2 <= traceLength; offset += 2 + length)
+        {
+            length = trace[offset] | (trace[offset + 1] << 8);
+            if (offset + 2 + length > traceLength)
+            {
+                fprintf( stderr, "%s: truncated packet at %lu\n", argv[optind], offset );
+                break;
+            }
+            FramePoolPayload( &framePool, trace + offset + 2, length );
+            packets++;
+
+            // The demo decodes each frame as soon as it is ready.
+            while ((frame = FramePoolGetReady( &framePool )) != NULL)
+            {
+                DecodeFrame( frame, scale );
+                FramePoolRelease( &framePool, frame );
+            }
+        }
+    }
+    stats.totalTime = Now() - start;
+
+    printf( "packets %lu, header errors %lu\n", packets, (unsigned long)framePool.uvc.headerErrorCount );
+    printf( "frames ready %lu, dropped %lu, overflow %lu, error %lu\n",
+            (unsigned long)framePool.readyFrames, (unsigned long)framePool.droppedFrames,
+            (unsigned long)framePool.overflowFrames, (unsigned long)framePool.errorFrames );
+    printf( "frames decoded %lu, decode errors %lu, checksum %08lX\n",
+            stats.frames, stats.decodeErrors, (unsigned long)stats.checksum );
+    if ((stats.decodeTime > 0) && (stats.totalTime > 0))
+    {
+        printf( "scale 1/%u: %.0f MCUs/s, %.1f frames/s decoded, %.1f frames/s overall\n",
+                1 << scale, stats.mcus / stats.decodeTime, stats.frames / stats.decodeTime,
+                stats.frames / stats.totalTime );
+    }
+
+    free( trace );
+    return (stats.frames == 0) || (stats.decodeErrors != 0);
+}
@@ -0,0 +1,622 @@
+/******************************************************************************
+            Simulated C270 camera for the PC build
+
+This file is the device side of the bus for sim_usb.c, as described in
+sim_c270.h.
+
+EP0 follows the three stages of a control transfer.  A request with IN
+data is answered when its SETUP arrives, and the data stage ends with the
+OUT status packet.  A request with OUT data or no data is carried out at
+its IN status packet, and is stalled there if the camera does not support
+it.  SET_ADDRESS takes effect after its status stage, as on a real device.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "USB/usb.h"
+#include "sim_c270.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define LE16(x)                     (BYTE)(x), (BYTE)((x) >> 8)
+#define LE32(x)                     (BYTE)(x), (BYTE)((x) >> 8), (BYTE)((x) >> 16), (BYTE)((x) >> 24)
+
+#define EP0_MAX_PACKET_SIZE         64
+#define CONTROL_BUFFER_SIZE         512
+
+// UVC requests and controls
+#define UVC_SET_CUR                 0x01
+#define UVC_GET_CUR                 0x81
+#define UVC_GET_MIN                 0x82
+#define UVC_GET_MAX                 0x83
+#define UVC_GET_RES                 0x84
+#define UVC_GET_LEN                 0x85
+#define UVC_GET_INFO                0x86
+#define UVC_GET_DEF                 0x87
+#define UVC_VS_PROBE_CONTROL        0x01
+#define UVC_VS_COMMIT_CONTROL       0x02
+
+// Frame sizes and intervals of the MJPEG format
+#define FRAME_INTERVALS             5
+#define FRAME_DESCRIPTOR_LENGTH     (26 + FRAME_INTERVALS * 4)
+#define FRAME_INTERVAL_LIST         LE32(333333), LE32(500000), LE32(666666), LE32(1000000), LE32(2000000)
+#define FRAME_DESCRIPTOR(index,width,height)                                    \
+        FRAME_DESCRIPTOR_LENGTH, 0x24, 0x07, index, 0x00, LE16(width), LE16(height), \
+        LE32((width) * (height) * 16 * 5), LE32((width) * (height) * 16 * 30),  \
+        LE32((width) * (height) * 2), LE32(333333), FRAME_INTERVALS, FRAME_INTERVAL_LIST
+
+// Alternate settings of the video streaming interface
+#define ALT_SETTINGS                7
+#define ALT_SETTING(alt,size)                                                   \
+        0x09, USB_DESCRIPTOR_INTERFACE, SIM_C270_STREAMING_INTERFACE, alt, 0x01, 0x0E, 0x02, 0x00, 0x00, \
+        0x07, USB_DESCRIPTOR_ENDPOINT, SIM_C270_ENDPOINT, 0x05, LE16(size), 0x01
+
+#define VC_TOTAL_LENGTH             (13 + 18 + 9)
+#define VS_TOTAL_LENGTH             (14 + 11 + FRAME_DESCRIPTOR_LENGTH * 2 + 6)
+#define CONFIGURATION_LENGTH        (9 + 8 + 9 + VC_TOTAL_LENGTH + 7 + 5 + 9 + VS_TOTAL_LENGTH + ALT_SETTINGS * 16)
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Descriptors
+// *****************************************************************************
+// *****************************************************************************
+
+static const BYTE deviceDescriptor[] =
+{
+    0x12, USB_DESCRIPTOR_DEVICE, LE16(0x0200), 0xEF, 0x02, 0x01, EP0_MAX_PACKET_SIZE,
+    LE16(SIM_C270_VID), LE16(SIM_C270_PID), LE16(0x0010), 0x00, 0x00, 0x00, 0x01
+};
+
+static const BYTE configurationDescriptor[] =
+{
+    // Configuration
+    0x09, USB_DESCRIPTOR_CONFIGURATION, LE16(CONFIGURATION_LENGTH), 0x02, 0x01, 0x00, 0x80, 0xFA,
+
+    // Interface association of the video function
+    0x08, 0x0B, 0x00, 0x02, 0x0E, 0x03, 0x00, 0x00,
+
+    // Video control interface: header, camera terminal, output terminal
+    0x09, USB_DESCRIPTOR_INTERFACE, 0x00, 0x00, 0x01, 0x0E, 0x01, 0x00, 0x00,
+    0x0D, 0x24, 0x01, LE16(0x0100), LE16(VC_TOTAL_LENGTH), LE32(30000000), 0x01, SIM_C270_STREAMING_INTERFACE,
+    0x12, 0x24, 0x02, 0x01, LE16(0x0201), 0x00, 0x00, LE16(0), LE16(0), LE16(0), 0x03, 0x00, 0x00, 0x00,
+    0x09, 0x24, 0x03, 0x03, LE16(0x0101), 0x00, 0x01, 0x00,
+
+    // Status interrupt endpoint
+    0x07, USB_DESCRIPTOR_ENDPOINT, 0x87, 0x03, LE16(16), 0x08,
+    0x05, 0x25, 0x03, LE16(16),
+
+    // Video streaming interface: input header, MJPEG format, frames, color matching
+    0x09, USB_DESCRIPTOR_INTERFACE, SIM_C270_STREAMING_INTERFACE, 0x00, 0x00, 0x0E, 0x02, 0x00, 0x00,
+    0x0E, 0x24, 0x01, 0x01, LE16(VS_TOTAL_LENGTH), SIM_C270_ENDPOINT, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x0B, 0x24, 0x06, 0x01, 0x02, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00,
+    FRAME_DESCRIPTOR( 1, 640, 480 ),
+    FRAME_DESCRIPTOR( 2, 160, 120 ),
+    0x06, 0x24, 0x0D, 0x01, 0x01, 0x04,
+
+    // Alternate settings with the isochronous endpoint
+    ALT_SETTING( 1, 128 ),
+    ALT_SETTING( 2, 256 ),
+    ALT_SETTING( 3, 512 ),
+    ALT_SETTING( 4, 640 ),
+    ALT_SETTING( 5, 800 ),
+    ALT_SETTING( 6, 960 ),
+    ALT_SETTING( 7, 1023 ),
+};
+
+static const WORD altSettingPacketSize[ALT_SETTINGS + 1] = { 0, 128, 256, 512, 640, 800, 960, 1023 };
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data
+// *****************************************************************************
+// *****************************************************************************
+
+typedef enum
+{
+    CONTROL_IDLE = 0,
+    CONTROL_DATA_IN,                        // Sending IN data, waiting for the OUT status.
+    CONTROL_DATA_OUT,                       // Receiving OUT data.
+    CONTROL_STATUS_IN                       // Waiting for the IN status.
+} CONTROL_STAGE;
+
+static SIM_C270_STATUS  camera;
+static CONTROL_STAGE    controlStage;
+static BOOL             controlStall;       // The request of the data stage is not supported.
+static BYTE             controlSetup[8];
+static BYTE             controlBuffer[CONTROL_BUFFER_SIZE];
+static WORD             controlLength;      // Bytes of IN data, or OUT data received.
+static WORD             controlOffset;      // IN data sent.
+static BYTE             controlToggle;      // DATA0/DATA1 of the next IN data packet.
+static BYTE             probe[SIM_C270_PROBE_LENGTH];
+static const BYTE       *tracePackets;
+static DWORD            traceLength;
+static DWORD            traceOffset;
+static WORD             payloadSize;        // dwMaxPayloadTransferSize of the probe.
+static BOOL             packetSent;         // An isochronous packet was sent in this frame.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Requests
+// *****************************************************************************
+// *****************************************************************************
+
+static void PutDWord( BYTE *data, DWORD value )
+{
+    data[0] = (BYTE)value;
+    data[1] = (BYTE)(value >> 8);
+    data[2] = (BYTE)(value >> 16);
+    data[3] = (BYTE)(value >> 24);
+}
+
+
+static DWORD GetDWord( const BYTE *data )
+{
+    return (DWORD)data[0] | ((DWORD)data[1] << 8) | ((DWORD)data[2] << 16) | ((DWORD)data[3] << 24);
+}
+
+
+/****************************************************************************
+  Function:
+    static void NegotiateProbe( BYTE *parameters )
+
+  Description:
+    This function fills in the fields of the probe parameters that the
+    camera chooses, as after a SET_CUR of the probe control.  Unknown
+    formats and frames are replaced by the defaults, and the frame interval
+    by the nearest one the frame supports.
+  ***************************************************************************/
+
+static void NegotiateProbe( BYTE *parameters )
+{
+    static const DWORD  intervals[FRAME_INTERVALS] = { 333333, 500000, 666666, 1000000, 2000000 };
+    DWORD               interval;
+    DWORD               best;
+    BYTE                i;
+
+    if (parameters[2] != 1)
+    {
+        parameters[2] = 1;
+    }
+    if ((parameters[3] < 1) || (parameters[3] > 2))
+    {
+        parameters[3] = 1;
+    }
+
+    interval    = GetDWord( &parameters[4] );
+    best        = intervals[0];
+    for (i = 1; i < FRAME_INTERVALS; i++)
+    {
+        if (intervals[i] <= interval)
+        {
+            best = intervals[i];
+        }
+    }
+    PutDWord( &parameters[4], best );
+
+    PutDWord( &parameters[18], (parameters[3] == 1) ? 640 * 480 * 2 : 160 * 120 * 2 );
+    PutDWord( &parameters[22], payloadSize );
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL GetRequest( void )
+
+  Description:
+    This function puts the IN data of the request in controlSetup into
+    controlBuffer and controlLength.
+
+  Returns:
+    FALSE if the camera does not support the request.
+  ***************************************************************************/
+
+static BOOL GetRequest( void )
+{
+    BYTE    bmRequestType   = controlSetup[0];
+    BYTE    bRequest        = controlSetup[1];
+    BYTE    descriptorType  = controlSetup[3];
+    BYTE    wIndex          = controlSetup[4];
+    BYTE    control         = controlSetup[3];
+
+    controlLength = 0;
+    if (bmRequestType == 0x80)
+    {
+        switch (bRequest)
+        {
+            case USB_REQUEST_GET_DESCRIPTOR:
+                if (descriptorType == USB_DESCRIPTOR_DEVICE)
+                {
+                    memcpy( controlBuffer, deviceDescriptor, sizeof(deviceDescriptor) );
+                    controlLength = sizeof(deviceDescriptor);
+                    return TRUE;
+                }
+                if (descriptorType == USB_DESCRIPTOR_CONFIGURATION)
+                {
+                    memcpy( controlBuffer, configurationDescriptor, sizeof(configurationDescriptor) );
+                    controlLength = sizeof(configurationDescriptor);
+                    return TRUE;
+                }
+                return FALSE;
+
+            case USB_REQUEST_GET_CONFIGURATION:
+                controlBuffer[0]    = camera.configuration;
+                controlLength       = 1;
+                return TRUE;
+
+            case USB_REQUEST_GET_STATUS:
+                controlBuffer[0]    = 0;
+                controlBuffer[1]    = 0;
+                controlLength       = 2;
+                return TRUE;
+        }
+        return FALSE;
+    }
+
+    if ((bmRequestType == 0x81) && (bRequest == USB_REQUEST_GET_INTERFACE))
+    {
+        controlBuffer[0]    = (wIndex == SIM_C270_STREAMING_INTERFACE) ? camera.alternateSetting : 0;
+        controlLength       = 1;
+        return TRUE;
+    }
+
+    if ((bmRequestType == 0xA1) && (wIndex == SIM_C270_STREAMING_INTERFACE) &&
+        ((control == UVC_VS_PROBE_CONTROL) || (control == UVC_VS_COMMIT_CONTROL)))
+    {
+        switch (bRequest)
+        {
+            case UVC_GET_INFO:
+                controlBuffer[0]    = 0x03;     // GET and SET supported
+                controlLength       = 1;
+                return TRUE;
+
+            case UVC_GET_LEN:
+                controlBuffer[0]    = SIM_C270_PROBE_LENGTH;
+                controlBuffer[1]    = 0;
+                controlLength       = 2;
+                return TRUE;
+
+            case UVC_GET_CUR:
+                memcpy( controlBuffer, (control == UVC_VS_PROBE_CONTROL) ? probe : camera.commit, SIM_C270_PROBE_LENGTH );
+                controlLength = SIM_C270_PROBE_LENGTH;
+                return TRUE;
+
+            case UVC_GET_MIN:
+            case UVC_GET_MAX:
+            case UVC_GET_DEF:
+                memset( controlBuffer, 0, SIM_C270_PROBE_LENGTH );
+                PutDWord( &controlBuffer[4], (bRequest == UVC_GET_MAX) ? 2000000 : 333333 );
+                NegotiateProbe( controlBuffer );
+                controlLength = SIM_C270_PROBE_LENGTH;
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL SetRequest( void )
+
+  Description:
+    This function carries out the request in controlSetup, with the OUT
+    data in controlBuffer.
+
+  Returns:
+    FALSE if the camera does not support the request.
+  ***************************************************************************/
+
+static BOOL SetRequest( void )
+{
+    BYTE    bmRequestType   = controlSetup[0];
+    BYTE    bRequest        = controlSetup[1];
+    BYTE    wValue          = controlSetup[2];
+    BYTE    wIndex          = controlSetup[4];
+    BYTE    control         = controlSetup[3];
+
+    if (bmRequestType == 0x00)
+    {
+        switch (bRequest)
+        {
+            case USB_REQUEST_SET_ADDRESS:
+                // Taken at the end of the status stage.
+                return TRUE;
+
+            case USB_REQUEST_SET_CONFIGURATION:
+                if (wValue > 1)
+                {
+                    return FALSE;
+                }
+                camera.configuration    = wValue;
+                camera.alternateSetting = 0;
+                camera.committed        = 0;
+                return TRUE;
+        }
+        return FALSE;
+    }
+
+    if ((bmRequestType == 0x01) && (bRequest == USB_REQUEST_SET_INTERFACE) && (camera.configuration != 0))
+    {
+        if (wIndex == 0)
+        {
+            return (wValue == 0);
+        }
+        if ((wIndex == SIM_C270_STREAMING_INTERFACE) && (wValue <= ALT_SETTINGS))
+        {
+            camera.alternateSetting = wValue;
+            packetSent              = FALSE;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    if ((bmRequestType == 0x02) && (bRequest == USB_REQUEST_CLEAR_FEATURE))
+    {
+        return TRUE;
+    }
+
+    if ((bmRequestType == 0x21) && (bRequest == UVC_SET_CUR) && (wIndex == SIM_C270_STREAMING_INTERFACE) &&
+        (controlLength >= SIM_C270_PROBE_LENGTH))
+    {
+        if (control == UVC_VS_PROBE_CONTROL)
+        {
+            memcpy( probe, controlBuffer, SIM_C270_PROBE_LENGTH );
+            NegotiateProbe( probe );
+            return TRUE;
+        }
+        if (control == UVC_VS_COMMIT_CONTROL)
+        {
+            memcpy( camera.commit, controlBuffer, SIM_C270_PROBE_LENGTH );
+            NegotiateProbe( camera.commit );
+            camera.committed = 1;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Transactions
+// *****************************************************************************
+// *****************************************************************************
+
+static void C270BusReset( void )
+{
+    camera.address          = 0;
+    camera.configuration    = 0;
+    camera.alternateSetting = 0;
+    camera.committed        = 0;
+    controlStage            = CONTROL_IDLE;
+}
+
+
+static BYTE C270Address( void )
+{
+    return camera.address;
+}
+
+
+static void C270StartOfFrame( void )
+{
+    packetSent = FALSE;
+}
+
+
+static BYTE C270Setup( const BYTE *data, WORD length )
+{
+    WORD    wLength;
+
+    camera.setupPackets++;
+    if (length != sizeof(controlSetup))
+    {
+        controlStage = CONTROL_IDLE;
+        return PID_ACK;
+    }
+
+    memcpy( controlSetup, data, sizeof(controlSetup) );
+    wLength         = controlSetup[6] | (controlSetup[7] << 8);
+    controlStall    = FALSE;
+    controlOffset   = 0;
+    controlToggle   = 1;
+
+    if (controlSetup[0] & 0x80)
+    {
+        controlStall = !GetRequest();
+        if (controlLength > wLength)
+        {
+            controlLength = wLength;
+        }
+        controlStage = CONTROL_DATA_IN;
+    }
+    else if (wLength != 0)
+    {
+        controlLength   = 0;
+        controlStage    = CONTROL_DATA_OUT;
+    }
+    else
+    {
+        controlLength   = 0;
+        controlStage    = CONTROL_STATUS_IN;
+    }
+    return PID_ACK;
+}
+
+
+static BYTE C270Out( BYTE endpoint, const BYTE *data, WORD length )
+{
+    if (endpoint != 0)
+    {
+        return 0;
+    }
+
+    switch (controlStage)
+    {
+        case CONTROL_DATA_OUT:
+            if (controlLength + length > CONTROL_BUFFER_SIZE)
+            {
+                camera.stalls++;
+                controlStage = CONTROL_IDLE;
+                return PID_STALL;
+            }
+            memcpy( controlBuffer + controlLength, data, length );
+            controlLength += length;
+            if ((length < EP0_MAX_PACKET_SIZE) || (controlLength >= (controlSetup[6] | (controlSetup[7] << 8))))
+            {
+                controlStage = CONTROL_STATUS_IN;
+            }
+            return PID_ACK;
+
+        case CONTROL_DATA_IN:
+            // Status stage of a request with IN data.
+            controlStage = CONTROL_IDLE;
+            return PID_ACK;
+
+        default:
+            camera.stalls++;
+            return PID_STALL;
+    }
+}
+
+
+static BYTE C270In( BYTE endpoint, BYTE *data, WORD maxLength, WORD *length )
+{
+    WORD    packetLength;
+    BYTE    pid;
+
+    *length = 0;
+    if (endpoint == (SIM_C270_ENDPOINT & 0x0F))
+    {
+        // The endpoint only exists in the alternate settings other than 0.
+        if ((camera.configuration == 0) || (camera.alternateSetting == 0))
+        {
+            return 0;
+        }
+        if (!camera.committed || packetSent || (traceLength < 2))
+        {
+            return PID_DATA0;
+        }
+
+        packetSent      = TRUE;
+        packetLength    = tracePackets[traceOffset] | (tracePackets[traceOffset + 1] << 8);
+        if (traceOffset + 2 + packetLength > traceLength)
+        {
+            packetLength = 0;
+            traceOffset  = traceLength;
+        }
+        else
+        {
+            *length = packetLength;
+            if (*length > altSettingPacketSize[camera.alternateSetting])
+            {
+                *length = altSettingPacketSize[camera.alternateSetting];
+            }
+            if (*length > maxLength)
+            {
+                *length = maxLength;
+            }
+            if (*length != packetLength)
+            {
+                camera.truncatedPackets++;
+            }
+            memcpy( data, tracePackets + traceOffset + 2, *length );
+            traceOffset += 2 + packetLength;
+            camera.packets++;
+        }
+
+        if (traceOffset + 2 > traceLength)
+        {
+            traceOffset = 0;
+            camera.tracePasses++;
+        }
+        return PID_DATA0;
+    }
+
+    if (endpoint != 0)
+    {
+        return 0;
+    }
+
+    switch (controlStage)
+    {
+        case CONTROL_DATA_IN:
+            if (controlStall)
+            {
+                camera.stalls++;
+                controlStage = CONTROL_IDLE;
+                return PID_STALL;
+            }
+            *length = controlLength - controlOffset;
+            if (*length > EP0_MAX_PACKET_SIZE)
+            {
+                *length = EP0_MAX_PACKET_SIZE;
+            }
+            if (*length > maxLength)
+            {
+                *length = maxLength;
+            }
+            memcpy( data, controlBuffer + controlOffset, *length );
+            controlOffset   += *length;
+            pid             = controlToggle ? PID_DATA1 : PID_DATA0;
+            controlToggle   ^= 1;
+            return pid;
+
+        case CONTROL_STATUS_IN:
+            controlStage = CONTROL_IDLE;
+            if (!SetRequest())
+            {
+                camera.stalls++;
+                return PID_STALL;
+            }
+            if ((controlSetup[0] == 0x00) && (controlSetup[1] == USB_REQUEST_SET_ADDRESS))
+            {
+                camera.address = controlSetup[2] & 0x7F;
+            }
+            return PID_DATA1;
+
+        default:
+            camera.stalls++;
+            return PID_STALL;
+    }
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Interface Functions
+// *****************************************************************************
+// *****************************************************************************
+
+const SIM_USB_DEVICE simC270Device =
+{
+    C270BusReset,
+    C270Address,
+    C270StartOfFrame,
+    C270Setup,
+    C270Out,
+    C270In
+};
+
+
+void SimC270Init( const BYTE *trace, DWORD length, WORD maxPayloadTransferSize )
+{
+    memset( &camera, 0, sizeof(camera) );
+    memset( probe, 0, sizeof(probe) );
+    tracePackets    = trace;
+    traceLength     = length;
+    traceOffset     = 0;
+    payloadSize     = maxPayloadTransferSize;
+    C270BusReset();
+}
+
+
+void SimC270GetStatus( SIM_C270_STATUS *status )
+{
+    *status = camera;
+}
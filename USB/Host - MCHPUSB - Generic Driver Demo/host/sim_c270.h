@@ -0,0 +1,66 @@
+/******************************************************************************
+            Simulated C270 camera for the PC build
+
+sim_c270.c is a scripted USB device for sim_usb.c, with the VID and PID of
+the Logitech C270 that the demo is written for.  It answers enumeration,
+the probe and commit controls of the video streaming interface and
+SET_INTERFACE, and once an alternate setting other than 0 is selected
+after a commit, it sends the packets of a trace from mktrace on its
+isochronous IN endpoint, one packet in each frame.
+
+Only the descriptors that the demo uses are given: a video control
+interface, and a video streaming interface with one MJPEG format of two
+frame sizes and seven alternate settings.
+
+******************************************************************************/
+
+#ifndef _SIM_C270_H
+#define _SIM_C270_H
+
+#include "GenericTypeDefs.h"
+#include "sim_usb.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define SIM_C270_VID                0x046D
+#define SIM_C270_PID                0x0825
+#define SIM_C270_STREAMING_INTERFACE 1
+#define SIM_C270_ENDPOINT           0x81    // Isochronous IN endpoint of the video.
+#define SIM_C270_PROBE_LENGTH       26      // Probe and commit parameters of UVC 1.0.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+typedef struct
+{
+    BYTE    address;
+    BYTE    configuration;
+    BYTE    alternateSetting;               // Of the video streaming interface.
+    BYTE    committed : 1;                  // The commit control has been set.
+    BYTE    commit[SIM_C270_PROBE_LENGTH];  // Parameters of the last commit.
+    DWORD   setupPackets;                   // SETUP transactions.
+    DWORD   stalls;                         // Requests the camera did not support.
+    DWORD   packets;                        // Isochronous packets sent from the trace.
+    DWORD   truncatedPackets;               // Trace packets cut to the packet size of the setting.
+    DWORD   tracePasses;                    // Times the whole trace has been sent.
+} SIM_C270_STATUS;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Functions
+// *****************************************************************************
+// *****************************************************************************
+
+extern const SIM_USB_DEVICE simC270Device;
+
+void SimC270Init( const BYTE *trace, DWORD traceLength, WORD maxPayloadTransferSize );
+void SimC270GetStatus( SIM_C270_STATUS *status );
+
+#endif
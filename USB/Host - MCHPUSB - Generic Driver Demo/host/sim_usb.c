@@ -0,0 +1,408 @@
+/******************************************************************************
+            Simulated PIC32 USB module for the PC build
+
+This file keeps the U1* registers of usb_hal_pic32.h and runs the bus for
+usb_host.c, as described in sim_usb.h.  It also keeps the core timer.
+
+Only the host mode of the module is modeled, with the full ping-pong BDT
+of EP0 that usb_host.c uses for all endpoints:
+    BDT[0]  IN even     BDT[2]  OUT and SETUP even
+    BDT[1]  IN odd      BDT[3]  OUT and SETUP odd
+Each token takes the BDT of its direction that the ping-pong pointer of
+the module points at, and moves the pointer to the other one.
+
+The interrupts do not preempt the program.  _USB1Interrupt() is only called
+from SimUsbFrame(), so USBHostTasks() always sees the registers as they
+were when it started.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "GenericTypeDefs.h"
+#include "HardwareProfile.h"
+#include "USB/usb.h"
+#include "sim_usb.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+// These match usb_host_local.h.
+#define U1CON_SOFEN                 0x01
+#define U1CON_PPBRST                0x02
+#define U1CON_HOSTEN                0x08
+#define U1CON_USBRST                0x10
+#define U1CON_SE0                   0x40
+#define U1CON_JSTATE                0x80
+
+#define U1IR_DETACHIF               0x01
+#define U1IR_UERRIF                 0x02
+#define U1IR_SOFIF                  0x04
+#define U1IR_TRNIF                  0x08
+#define U1IR_ATTACHIF               0x40
+
+#define U1OTGIR_T1MSECIF            0x40
+#define U1EIR_BTOEF                 0x10
+#define U1PWRC_USBPWR               0x01
+
+#define U1STAT_DIR                  0x08
+#define U1STAT_PPBI                 0x04
+
+#define PID_DATA_ERROR              0x0F    // BDT PID of IN data with the wrong DATA0/DATA1.
+#define PID_BUS_TIMEOUT             0x00    // BDT PID of a transaction the device did not answer.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data
+// *****************************************************************************
+// *****************************************************************************
+
+void _USB1Interrupt( void );
+
+static volatile DWORD           registers[SIM_USB_REGISTERS] = { [SIM_U1TOK] = SIM_U1TOK_DONE };
+static const SIM_USB_DEVICE     *simDevice;
+static BOOL                     simLowSpeed;
+static BOOL                     simResetting;       // The host is driving a reset.
+static BOOL                     simTokenPending;    // U1TOK holds a token that has not been run.
+static BYTE                     simPingPongIn;      // Next IN BDT, 0 even or 1 odd.
+static BYTE                     simPingPongOut;     // Next OUT and SETUP BDT.
+static WORD                     simFrameBytes;      // Bus time used in this frame.
+static WORD                     simFrameNumber;
+static SIM_USB_STATISTICS       simStatistics;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+/****************************************************************************
+  Function:
+    static void SimUsbUpdate( void )
+
+  Description:
+    This function applies the effect of the previous register access: it
+    clears the flags written to the clear ports, applies the SET and CLR
+    ports of the interrupt controller, takes a new token from U1TOK, and
+    updates the bits that the module drives.
+  ***************************************************************************/
+
+static void SimUsbUpdate( void )
+{
+    DWORD   con;
+
+    registers[SIM_U1IR]     &= ~registers[SIM_U1IR_CLEAR];
+    registers[SIM_U1IR_CLEAR]   = 0;
+    registers[SIM_U1OTGIR]  &= ~registers[SIM_U1OTGIR_CLEAR];
+    registers[SIM_U1OTGIR_CLEAR] = 0;
+    registers[SIM_U1EIR]    &= ~registers[SIM_U1EIR_CLEAR];
+    registers[SIM_U1EIR_CLEAR]  = 0;
+
+    registers[SIM_IFS1]     = (registers[SIM_IFS1] | registers[SIM_IFS1SET]) & ~registers[SIM_IFS1CLR];
+    registers[SIM_IFS1SET]  = 0;
+    registers[SIM_IFS1CLR]  = 0;
+    registers[SIM_IEC1]     = (registers[SIM_IEC1] | registers[SIM_IEC1SET]) & ~registers[SIM_IEC1CLR];
+    registers[SIM_IEC1SET]  = 0;
+    registers[SIM_IEC1CLR]  = 0;
+    registers[SIM_IPC11]    = (registers[SIM_IPC11] | registers[SIM_IPC11SET]) & ~registers[SIM_IPC11CLR];
+    registers[SIM_IPC11SET] = 0;
+    registers[SIM_IPC11CLR] = 0;
+
+    if (!(registers[SIM_U1TOK] & SIM_U1TOK_DONE))
+    {
+        if (simTokenPending)
+        {
+            simStatistics.tokenOverruns++;
+        }
+        simTokenPending         = TRUE;
+        registers[SIM_U1TOK]    |= SIM_U1TOK_DONE;
+    }
+
+    con = registers[SIM_U1CON];
+    if (con & U1CON_PPBRST)
+    {
+        simPingPongIn   = 0;
+        simPingPongOut  = 0;
+    }
+
+    // The device sees the reset when the host stops driving it.
+    if (con & U1CON_USBRST)
+    {
+        simResetting = TRUE;
+    }
+    else if (simResetting)
+    {
+        simResetting = FALSE;
+        if (simDevice != NULL)
+        {
+            simDevice->BusReset();
+        }
+    }
+
+    con &= ~(U1CON_SE0 | U1CON_JSTATE);
+    if (simDevice == NULL)
+    {
+        con |= U1CON_SE0;
+    }
+    else if (!simLowSpeed)
+    {
+        con |= U1CON_JSTATE;
+    }
+    registers[SIM_U1CON] = con;
+
+    // The attach flag is level triggered in host mode.
+    if ((simDevice != NULL) && (con & U1CON_HOSTEN))
+    {
+        registers[SIM_U1IR] |= U1IR_ATTACHIF;
+    }
+}
+
+
+/****************************************************************************
+  Function:
+    static void SimUsbInterrupts( void )
+
+  Description:
+    This function calls _USB1Interrupt() while the USB interrupt is enabled
+    and an enabled flag is set.
+  ***************************************************************************/
+
+static void SimUsbInterrupts( void )
+{
+    BYTE    count;
+
+    for (count = 0; count < SIM_USB_MAX_INTERRUPTS; count++)
+    {
+        SimUsbUpdate();
+        if (!(registers[SIM_IEC1] & _IEC1_USBIE_MASK) ||
+            (!(registers[SIM_U1IR] & registers[SIM_U1IE] & 0xFF) &&
+             !(registers[SIM_U1OTGIR] & registers[SIM_U1OTGIE] & 0xFF)))
+        {
+            return;
+        }
+
+        registers[SIM_IFS1] |= _IFS1_USBIF_MASK;
+        simStatistics.interrupts++;
+        _USB1Interrupt();
+    }
+    simStatistics.stuckInterrupts++;
+}
+
+
+/****************************************************************************
+  Function:
+    static BOOL SimUsbTransaction( void )
+
+  Description:
+    This function runs the token in U1TOK on the next BDT of its direction,
+    and sets TRNIF, and UERRIF if the device did not answer.
+
+  Returns:
+    TRUE    - The transaction was run.
+    FALSE   - The transaction does not fit in the rest of the frame.
+  ***************************************************************************/
+
+static BOOL SimUsbTransaction( void )
+{
+    BDT_ENTRY   *pBDT;
+    BYTE        *data;
+    BYTE        token;
+    BYTE        endpoint;
+    BYTE        pid;
+    BYTE        pingPong;
+    BOOL        isochronous;
+    WORD        length;
+    WORD        bytes;
+
+    token       = (registers[SIM_U1TOK] >> 4) & 0x0F;
+    endpoint    = registers[SIM_U1TOK] & 0x0F;
+    pingPong    = (token == USB_TOKEN_IN) ? simPingPongIn : simPingPongOut;
+    pBDT        = (BDT_ENTRY *)PA_TO_KVA1( (registers[SIM_U1BDTP3] << 24) |
+                                           (registers[SIM_U1BDTP2] << 16) |
+                                           (registers[SIM_U1BDTP1] << 8) );
+    pBDT        += ((token == USB_TOKEN_IN) ? 0 : 2) + pingPong;
+
+    // The handshake is turned off for isochronous endpoints.
+    isochronous = !(registers[SIM_U1EP0] & 0x01);
+    bytes       = pBDT->count + (isochronous ? SIM_USB_ISOCHRONOUS_OVERHEAD : SIM_USB_TRANSACTION_OVERHEAD);
+    if ((simFrameBytes + bytes > SIM_USB_FRAME_BYTES) ||
+        (SIM_USB_FRAME_BYTES - simFrameBytes < (registers[SIM_U1SOF] & 0xFF)))
+    {
+        return FALSE;
+    }
+    simTokenPending = FALSE;
+
+    if (!pBDT->STAT.UOWN)
+    {
+        // The real module would wait for the BDT; the stack must never do this.
+        simStatistics.bdtErrors++;
+        return TRUE;
+    }
+    simStatistics.tokens++;
+
+    data    = (BYTE *)PA_TO_KVA1( pBDT->ADR );
+    length  = pBDT->count;
+    pid     = PID_BUS_TIMEOUT;
+    if ((simDevice != NULL) && !simResetting &&
+        ((registers[SIM_U1ADDR] & 0x7F) == simDevice->Address()))
+    {
+        switch (token)
+        {
+            case USB_TOKEN_SETUP:
+                pid = simDevice->Setup( data, length );
+                break;
+
+            case USB_TOKEN_OUT:
+                pid = simDevice->Out( endpoint, data, length );
+                break;
+
+            case USB_TOKEN_IN:
+                pid = simDevice->In( endpoint, data, pBDT->count, &length );
+                if ((pid == PID_DATA0) || (pid == PID_DATA1))
+                {
+                    bytes = length + (isochronous ? SIM_USB_ISOCHRONOUS_OVERHEAD : SIM_USB_TRANSACTION_OVERHEAD);
+                    if (pBDT->STAT.DTSEN && (pBDT->STAT.DTS != (pid == PID_DATA1)))
+                    {
+                        simStatistics.toggleErrors++;
+                        pid = PID_DATA_ERROR;
+                    }
+                }
+                break;
+        }
+    }
+    simFrameBytes += bytes;
+
+    if (pid == PID_NAK)
+    {
+        simStatistics.naks++;
+    }
+
+    // Give the BDT back to the CPU with the PID of the answer.
+    pBDT->STAT.Val  = pid << 2;
+    pBDT->count     = length;
+
+    registers[SIM_U1STAT] = ((token == USB_TOKEN_IN) ? 0 : U1STAT_DIR) | (pingPong ? U1STAT_PPBI : 0);
+    if (token == USB_TOKEN_IN)
+    {
+        simPingPongIn ^= 1;
+    }
+    else
+    {
+        simPingPongOut ^= 1;
+    }
+
+    registers[SIM_U1IR] |= U1IR_TRNIF;
+    if (pid == PID_BUS_TIMEOUT)
+    {
+        simStatistics.timeouts++;
+        registers[SIM_U1EIR]    |= U1EIR_BTOEF;
+        registers[SIM_U1IR]     |= U1IR_UERRIF;
+    }
+    return TRUE;
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Registers
+// *****************************************************************************
+// *****************************************************************************
+
+volatile DWORD * SimUsbRegister( SIM_USB_REGISTER reg )
+{
+    SimUsbUpdate();
+    return &registers[reg];
+}
+
+
+DWORD SimUsbPhysicalAddress( uintptr_t address )
+{
+    if (address > 0xFFFFFFFFul)
+    {
+        fprintf( stderr, "sim_usb: buffer at %p is above 4 GB, link with -no-pie\n", (void *)address );
+        abort();
+    }
+    return (DWORD)address;
+}
+
+
+DWORD ReadCoreTimer( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (DWORD)((unsigned long long)ts.tv_sec * (GetSystemClock() / 2) +
+                   (unsigned long long)ts.tv_nsec * (GetSystemClock() / 2) / 1000000000ull);
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Bus
+// *****************************************************************************
+// *****************************************************************************
+
+void SimUsbAttach( const SIM_USB_DEVICE *device, BOOL lowSpeed )
+{
+    simDevice   = device;
+    simLowSpeed = lowSpeed;
+    simDevice->BusReset();
+}
+
+
+void SimUsbDetach( void )
+{
+    simDevice = NULL;
+    registers[SIM_U1IR] = (registers[SIM_U1IR] & ~U1IR_ATTACHIF) | U1IR_DETACHIF;
+}
+
+
+void SimUsbFrame( void )
+{
+    SimUsbUpdate();
+
+    simStatistics.frames++;
+    simFrameNumber          = (simFrameNumber + 1) & 0x07FF;
+    registers[SIM_U1FRML]   = simFrameNumber & 0xFF;
+    registers[SIM_U1FRMH]   = simFrameNumber >> 8;
+    simFrameBytes           = 0;
+
+    if (registers[SIM_U1PWRC] & U1PWRC_USBPWR)
+    {
+        registers[SIM_U1OTGIR] |= U1OTGIR_T1MSECIF;
+    }
+    if ((registers[SIM_U1CON] & (U1CON_HOSTEN | U1CON_SOFEN)) == (U1CON_HOSTEN | U1CON_SOFEN))
+    {
+        registers[SIM_U1IR]     |= U1IR_SOFIF;
+        simFrameBytes           = SIM_USB_SOF_BYTES;
+        if (simDevice != NULL)
+        {
+            simDevice->StartOfFrame();
+        }
+    }
+
+    SimUsbInterrupts();
+    while (simTokenPending)
+    {
+        if (!SimUsbTransaction())
+        {
+            simStatistics.deferredTokens++;
+            break;
+        }
+        SimUsbInterrupts();
+    }
+
+    if (simFrameBytes > simStatistics.frameBytesPeak)
+    {
+        simStatistics.frameBytesPeak = simFrameBytes;
+    }
+}
+
+
+void SimUsbGetStatistics( SIM_USB_STATISTICS *statistics )
+{
+    *statistics = simStatistics;
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+            Simulated PIC32 USB module for the PC build
+
+sim_usb.c plays the part of the USB module behind the registers of
+usb_hal_pic32.h.  The program moves the bus forward one 1 ms frame at a
+time with SimUsbFrame(), between calls to USBHostTasks().  In each frame,
+the module raises the 1 ms timer and start-of-frame flags, calls
+_USB1Interrupt() while an enabled flag is set, and runs the tokens that
+the stack writes to U1TOK, until the frame has no more bus time for them.
+
+The device on the bus is a set of functions that answer the transactions.
+The answers are PIDs from usb_ch9.h: PID_ACK, PID_NAK or PID_STALL for
+SETUP and OUT, PID_DATA0, PID_DATA1, PID_NAK or PID_STALL for IN, and 0
+when the device does not answer at all, which the module reports as a bus
+timeout.
+
+******************************************************************************/
+
+#ifndef _SIM_USB_H
+#define _SIM_USB_H
+
+#include "GenericTypeDefs.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define SIM_USB_FRAME_BYTES         1500    // Byte times in a full-speed frame.
+#define SIM_USB_SOF_BYTES           6       // Bus time of the SOF packet.
+#define SIM_USB_ISOCHRONOUS_OVERHEAD 9      // Protocol overhead of an isochronous transaction.
+#define SIM_USB_TRANSACTION_OVERHEAD 13     // Protocol overhead of other transactions.
+#define SIM_USB_MAX_INTERRUPTS      8       // Calls of the ISR in a row before the module gives up.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+typedef struct
+{
+    void    (*BusReset)( void );        // The host has reset the bus.
+    BYTE    (*Address)( void );         // Current address of the device.
+    void    (*StartOfFrame)( void );    // A new frame has started.
+
+    // SETUP and OUT data from the host.
+    BYTE    (*Setup)( const BYTE *data, WORD length );
+    BYTE    (*Out)( BYTE endpoint, const BYTE *data, WORD length );
+
+    // IN data to the host.  At most maxLength bytes may be written to data.
+    BYTE    (*In)( BYTE endpoint, BYTE *data, WORD maxLength, WORD *length );
+} SIM_USB_DEVICE;
+
+typedef struct
+{
+    DWORD   frames;                     // Frames run.
+    DWORD   interrupts;                 // Calls of _USB1Interrupt().
+    DWORD   tokens;                     // Transactions run.
+    DWORD   naks;                       // Transactions the device NAK'd.
+    DWORD   timeouts;                   // Transactions the device did not answer.
+    DWORD   toggleErrors;               // IN data with the wrong DATA0/DATA1.
+    DWORD   deferredTokens;             // Tokens moved to the next frame for lack of bus time.
+    DWORD   tokenOverruns;              // A token was written before the previous one was run.
+    DWORD   bdtErrors;                  // A token was written for a BDT the CPU owned.
+    DWORD   stuckInterrupts;            // The ISR left an enabled flag set SIM_USB_MAX_INTERRUPTS times.
+    WORD    frameBytesPeak;             // Most bus time used in one frame.
+} SIM_USB_STATISTICS;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Functions
+// *****************************************************************************
+// *****************************************************************************
+
+void SimUsbAttach( const SIM_USB_DEVICE *device, BOOL lowSpeed );
+void SimUsbDetach( void );
+void SimUsbFrame( void );
+void SimUsbGetStatistics( SIM_USB_STATISTICS *statistics );
+
+#endif
@@ -0,0 +1,143 @@
+/******************************************************************************
+            Frame pool test
+
+This is a PC test of the buffer handling in firmware/frame_pool.c.  Each
+frame is sent as one packet that ends with the EOF bit, followed by a
+zero-length packet that completes it, and the first data byte of the
+frame is its number, so the test can tell which frame a buffer holds.
+
+Usage:
+    test_frame_pool
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "frame_pool.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define FRAME_LENGTH                100     // Packet length of each frame.
+
+#if FRAME_POOL_COUNT != 2
+    #error The test expects two frame buffers.
+#endif
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+static FRAME_POOL   framePool;
+static int          failures;
+
+static void Check( const char *name, const char *what, unsigned long value, unsigned long expected )
+{
+    if (value != expected)
+    {
+        printf( "FAIL %s: %s is %lu, expected %lu\n", name, what, value, expected );
+        failures++;
+    }
+}
+
+
+// Starts the pool with the header only packet the stream synchronizes on.
+static void Start( void )
+{
+    BYTE    packet[2] = { 2, UVC_HEADER_EOH | UVC_HEADER_EOF };
+
+    FramePoolInit( &framePool );
+    FramePoolPayload( &framePool, packet, sizeof(packet) );
+}
+
+
+static void SendFrame( BYTE number )
+{
+    BYTE    packet[FRAME_LENGTH];
+
+    memset( packet, number, sizeof(packet) );
+    packet[0] = 2;
+    packet[1] = UVC_HEADER_EOH | UVC_HEADER_EOF | ((number & 1) ? UVC_HEADER_FID : 0);
+    FramePoolPayload( &framePool, packet, sizeof(packet) );
+    FramePoolPayload( &framePool, packet, 0 );
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Test Cases
+// *****************************************************************************
+// *****************************************************************************
+
+// While the application holds a frame, each new frame replaces the ready one,
+// so the next frame it takes is the latest.
+static void LatestFrameWins( void )
+{
+    const char      *name = "latestFrameWins";
+    FRAME_BUFFER    *held;
+    FRAME_BUFFER    *frame;
+    int             before = failures;
+
+    Start();
+    SendFrame( 1 );
+    held = FramePoolGetReady( &framePool );
+    Check( name, "held frame", (held != NULL) ? held->data[0] : 0, 1 );
+    SendFrame( 2 );
+    SendFrame( 3 );
+    SendFrame( 4 );
+
+    frame = FramePoolGetReady( &framePool );
+    Check( name, "next frame", (frame != NULL) ? frame->data[0] : 0, 4 );
+    Check( name, "length", (frame != NULL) ? frame->length : 0, FRAME_LENGTH - 2 );
+    Check( name, "readyFrames", framePool.readyFrames, 4 );
+    Check( name, "droppedFrames", framePool.droppedFrames, 2 );
+    Check( name, "frame after the last", (FramePoolGetReady( &framePool ) != NULL), 0 );
+
+    printf( "%s %s\n", (failures == before) ? "ok  " : "FAIL", name );
+}
+
+
+// The ready frame that FramePoolGetReady() is taking is not reused, so the
+// new frame is dropped instead.
+static void TakingNotReused( void )
+{
+    const char      *name = "takingNotReused";
+    FRAME_BUFFER    *held;
+    FRAME_BUFFER    *frame;
+    int             before = failures;
+
+    Start();
+    SendFrame( 1 );
+    held = FramePoolGetReady( &framePool );
+    SendFrame( 2 );
+    framePool.pTaking = (held == &framePool.frames[0]) ? &framePool.frames[1] : &framePool.frames[0];
+    SendFrame( 3 );
+    Check( name, "taking state", framePool.pTaking->state, FRAME_BUFFER_READY );
+    framePool.pTaking = NULL;
+
+    frame = FramePoolGetReady( &framePool );
+    Check( name, "next frame", (frame != NULL) ? frame->data[0] : 0, 2 );
+    Check( name, "readyFrames", framePool.readyFrames, 2 );
+    Check( name, "droppedFrames", framePool.droppedFrames, 1 );
+
+    printf( "%s %s\n", (failures == before) ? "ok  " : "FAIL", name );
+}
+
+
+int main( void )
+{
+    LatestFrameWins();
+    TakingNotReused();
+
+    if (failures != 0)
+    {
+        printf( "%d failures\n", failures );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,584 @@
+/******************************************************************************
+            Test of the USB host stack with a simulated C270
+
+This is a PC test of usb_host.c and the generic client driver, built for
+the PIC32 against the registers of usb_hal_pic32.h.  The USB module is
+simulated by sim_usb.c, and the camera on the bus by sim_c270.c, which
+sends the packets of a trace from mktrace.
+
+The test does what main.c does with a camera: it waits for the generic
+driver to take the device, picks the MJPEG 640x480 frame from the
+configuration descriptor, sets the probe control, selects the alternate
+setting from the dwMaxPayloadTransferSize the camera returns, sets the
+commit control, issues SET_INTERFACE and reads the isochronous endpoint.
+Unlike main.c, it starts the read only after SET_INTERFACE has completed.
+Before that the camera has no isochronous endpoint, so the first IN would
+time out, and an isochronous error is not what this test is about.
+The packets go to the frame pool, from the main loop as with
+USE_DEFERRED_PAYLOAD, or from the interrupt handler with -i, and each
+frame that becomes ready is decoded with TJpgDec.
+
+It passes if the given number of frames are decoded without errors, with
+no packet lost to a full buffer ring and no fault of the simulated bus.
+The longest time in _USB1Interrupt() is printed as ISR= in microseconds,
+as main.c prints it.  It is the time on the PC, not on the PIC32.
+
+Usage:
+    test_usb_host [-i] [-v] [-n frames] trace
+
+    -i  Pass the packets to the frame pool from the interrupt handler.
+    -v  Print the debug messages of the stack.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "GenericTypeDefs.h"
+#include "HardwareProfile.h"
+#include "usb_config.h"
+#include "USB/usb.h"
+#include "USB/usb_host_generic.h"
+#include "uvc_descriptor.h"
+#include "frame_pool.h"
+#include "tjpgd.h"
+#include "sim_usb.h"
+#include "sim_c270.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define VIDEO_FORMAT                UVC_VS_FORMAT_MJPEG     // Same as main.c
+#define VIDEO_WIDTH                 640
+#define VIDEO_HEIGHT                480
+#define VIDEO_FRAME_INTERVAL        2000000
+
+#define PAYLOAD_TRANSFER_SIZE       960     // dwMaxPayloadTransferSize of the camera
+#define EXPECTED_ALT_SETTING        6       // Smallest setting with 960 byte packets
+#define JPEG_WORK_SIZE              (8 * 1024)
+#define PARAM_LEN                   26      // Probe and commit parameters of UVC 1.0.
+#define MAX_BUS_FRAMES              10000   // 10 seconds of bus time
+#define TASKS_PER_FRAME             4       // Passes of the main loop in each frame.
+
+#define SET_CUR                     0x01
+#define GET_CUR                     0x81
+#define VS_PROBE_CONTROL            0x01
+#define VS_COMMIT_CONTROL           0x02
+
+typedef enum
+{
+    TEST_WAIT_ATTACH = 0,
+    TEST_NEGOTIATE,                     // Issue the next probe/commit request
+    TEST_WAIT_NEGOTIATE,                // Requests are chained from the completion callbacks
+    TEST_SET_INTERFACE,
+    TEST_WAIT_SET_INTERFACE,
+    TEST_READ_ISOCHRONOUS,
+    TEST_DECODE,
+    TEST_ERROR
+} TEST_STATE;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+typedef struct
+{
+    BYTE    req;
+    BYTE    cs;
+    BYTE    fill : 1;                   // Fill in the selected parameters before the request.
+    BYTE    selectAlt : 1;              // Select the alternate setting from the answer.
+} NEGOTIATE_STEP;
+
+typedef struct
+{
+    unsigned long   frames;             // Frames decoded.
+    unsigned long   decodeErrors;       // Frames jd_prepare() or jd_decomp() failed on.
+    unsigned long   sizeErrors;         // Frames of another size than VIDEO_WIDTH x VIDEO_HEIGHT.
+    unsigned long   payloads;           // Packets passed to the frame pool.
+    DWORD           attachFrame;        // Bus frame the generic driver took the device.
+    DWORD           streamFrame;        // Bus frame the isochronous read started.
+} STATS;
+
+typedef struct
+{
+    FRAME_BUFFER    *frame;             // Frame being decoded.
+    DWORD           offset;             // Bytes read by TJpgDec.
+} JPEG_SOURCE;
+
+static const NEGOTIATE_STEP negotiateSteps[] = {
+    { SET_CUR, VS_PROBE_CONTROL,  1, 0 },
+    { GET_CUR, VS_PROBE_CONTROL,  0, 1 },
+    { SET_CUR, VS_COMMIT_CONTROL, 1, 0 },
+};
+#define NEGOTIATE_STEPS (sizeof(negotiateSteps) / sizeof(negotiateSteps[0]))
+
+static TEST_STATE               testState;
+static BYTE                     deviceAddress;
+static BYTE                     negotiateStep;
+static BYTE                     probe[PARAM_LEN];
+static UVC_DESCRIPTOR_TABLE     uvcTable;
+static UVC_FRAME_ENTRY          *uvcFrame;
+static DWORD                    uvcFrameInterval;
+static UVC_ALT_SETTING_ENTRY    *uvcAltSetting;
+static ISOCHRONOUS_DATA         isocData;
+static FRAME_POOL               framePool;
+static BYTE                     jpegWork[JPEG_WORK_SIZE];
+static BOOL                     isrDelivery;
+static DWORD                    busFrame;
+static STATS                    stats;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Negotiation
+// *****************************************************************************
+// *****************************************************************************
+
+static void NegotiateDone( BYTE address, BYTE errorCode, BYTE *data, DWORD byteCount, void *context );
+
+static BYTE NegotiateIssue( void )
+{
+    const NEGOTIATE_STEP    *step = &negotiateSteps[negotiateStep];
+    BYTE                    bmRequestType = USB_SETUP_TYPE_CLASS | USB_SETUP_RECIPIENT_INTERFACE;
+
+    if (step->fill)
+    {
+        memset( probe, 0, sizeof(probe) );
+        probe[2] = uvcFrame->bFormatIndex;
+        probe[3] = uvcFrame->bFrameIndex;
+        probe[4] = uvcFrameInterval;
+        probe[5] = uvcFrameInterval >> 8;
+        probe[6] = uvcFrameInterval >> 16;
+        probe[7] = uvcFrameInterval >> 24;
+    }
+    if (step->req == SET_CUR)
+    {
+        return USBHostQueueDeviceRequest( deviceAddress, bmRequestType | USB_SETUP_HOST_TO_DEVICE,
+                    step->req, step->cs << 8, uvcTable.bStreamingInterface, PARAM_LEN, probe,
+                    USB_DEVICE_REQUEST_SET, NegotiateDone, NULL );
+    }
+    return USBHostQueueDeviceRequest( deviceAddress, bmRequestType | USB_SETUP_DEVICE_TO_HOST,
+                step->req, step->cs << 8, uvcTable.bStreamingInterface, PARAM_LEN, probe,
+                USB_DEVICE_REQUEST_GET, NegotiateDone, NULL );
+}
+
+
+static void NegotiateDone( BYTE address, BYTE errorCode, BYTE *data, DWORD byteCount, void *context )
+{
+    const NEGOTIATE_STEP    *step = &negotiateSteps[negotiateStep];
+
+    if (testState != TEST_WAIT_NEGOTIATE)
+    {
+        return;
+    }
+    if (errorCode != USB_SUCCESS)
+    {
+        fprintf( stderr, "negotiation step %u: error %02X\n", negotiateStep, errorCode );
+        testState = TEST_ERROR;
+        return;
+    }
+    if (step->selectAlt)
+    {
+        uvcAltSetting = UVCDescriptorSelectAltSetting( &uvcTable,
+            (DWORD)probe[22] | ((DWORD)probe[23] << 8) | ((DWORD)probe[24] << 16) | ((DWORD)probe[25] << 24) );
+        if (uvcAltSetting == NULL)
+        {
+            fprintf( stderr, "alternate setting not found\n" );
+            testState = TEST_ERROR;
+            return;
+        }
+    }
+    negotiateStep++;
+    if (negotiateStep >= NEGOTIATE_STEPS)
+    {
+        testState = TEST_SET_INTERFACE;
+    }
+    else if (NegotiateIssue() == USB_SUCCESS)
+    {
+        testState = TEST_WAIT_NEGOTIATE;
+    }
+    else
+    {
+        testState = TEST_NEGOTIATE;
+    }
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Decoding
+// *****************************************************************************
+// *****************************************************************************
+
+static void PayloadTasks( void )
+{
+    ISOCHRONOUS_DATA_BUFFER *buffer;
+
+    while (1)
+    {
+        buffer = &isocData.buffers[isocData.currentBufferUser];
+        if (!buffer->bfDataLengthValid)
+        {
+            break;
+        }
+        FramePoolPayload( &framePool, buffer->pBuffer, buffer->dataLength );
+        stats.payloads++;
+        buffer->bfDataLengthValid = 0;
+        isocData.currentBufferUser++;
+        if (isocData.currentBufferUser >= isocData.totalBuffers)
+        {
+            isocData.currentBufferUser = 0;
+        }
+    }
+}
+
+
+static UINT JpegInput( JDEC *jd, BYTE *buff, UINT nbyte )
+{
+    JPEG_SOURCE     *source = (JPEG_SOURCE *)jd->device;
+
+    if (nbyte > source->frame->length - source->offset)
+    {
+        nbyte = source->frame->length - source->offset;
+    }
+    if (buff != NULL)
+    {
+        memcpy( buff, source->frame->data + source->offset, nbyte );
+    }
+    source->offset += nbyte;
+    return nbyte;
+}
+
+
+static UINT JpegOutput( JDEC *jd, void *bitmap, JRECT *rect )
+{
+    // Packets keep coming while the frame is decoded, as in jpeg_output().
+    USBHostTasks();
+    if (!isrDelivery)
+    {
+        PayloadTasks();
+    }
+    return 1;
+}
+
+
+static void DecodeTasks( void )
+{
+    JPEG_SOURCE     source;
+    JDEC            jdec;
+    JRESULT         rc;
+
+    if (!isrDelivery)
+    {
+        PayloadTasks();
+    }
+    source.frame = FramePoolGetReady( &framePool );
+    if (source.frame == NULL)
+    {
+        return;
+    }
+    source.offset = 0;
+    rc = jd_prepare( &jdec, JpegInput, jpegWork, sizeof(jpegWork), &source );
+    if (rc == JDR_OK)
+    {
+        rc = jd_decomp( &jdec, JpegOutput, 0 );
+    }
+    if (rc != JDR_OK)
+    {
+        fprintf( stderr, "frame %lu: decode error %d\n", stats.frames + stats.decodeErrors, rc );
+        stats.decodeErrors++;
+    }
+    else if ((jdec.width != VIDEO_WIDTH) || (jdec.height != VIDEO_HEIGHT))
+    {
+        fprintf( stderr, "frame %lu: %ux%u\n", stats.frames + stats.sizeErrors, jdec.width, jdec.height );
+        stats.sizeErrors++;
+    }
+    else
+    {
+        stats.frames++;
+    }
+    FramePoolRelease( &framePool, source.frame );
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Application
+// *****************************************************************************
+// *****************************************************************************
+
+static void TestTasks( void )
+{
+    GENERIC_DEVICE_ID   DevID;
+    DWORD               byteCount;
+    BYTE                errorCode;
+    BYTE                RetVal;
+
+    switch (testState)
+    {
+    case TEST_WAIT_ATTACH:
+        DevID.vid   = gc_DevData.ID.vid;
+        DevID.pid   = gc_DevData.ID.pid;
+        if (!USBHostGenericGetDeviceAddress( &DevID ))
+        {
+            break;
+        }
+        deviceAddress       = DevID.deviceAddress;
+        stats.attachFrame   = busFrame;
+        uvcFrame            = NULL;
+        if (UVCDescriptorParse( &uvcTable, USBHostGetCurrentConfigurationDescriptor( deviceAddress ) ))
+        {
+            uvcFrame = UVCDescriptorFindFrame( &uvcTable, VIDEO_FORMAT, VIDEO_WIDTH, VIDEO_HEIGHT );
+        }
+        if (uvcFrame == NULL)
+        {
+            fprintf( stderr, "video format not found\n" );
+            testState = TEST_ERROR;
+            break;
+        }
+        uvcFrameInterval    = UVCDescriptorFindInterval( &uvcTable, uvcFrame, VIDEO_FRAME_INTERVAL );
+        negotiateStep       = 0;
+        testState           = TEST_NEGOTIATE;
+        break;
+
+    case TEST_NEGOTIATE:
+        if (NegotiateIssue() == USB_SUCCESS)
+        {
+            testState = TEST_WAIT_NEGOTIATE;
+        }
+        break;
+
+    case TEST_WAIT_NEGOTIATE:
+        break;
+
+    case TEST_SET_INTERFACE:
+        USBHostIsochronousBuffersReset( &isocData, isocData.totalBuffers );
+        isocData.deliveryMode = isrDelivery ? USB_ISOC_DELIVERY_ISR : USB_ISOC_DELIVERY_NONE;
+        FramePoolInit( &framePool );
+        RetVal = USBHostIssueDeviceRequest( deviceAddress, USB_SETUP_RECIPIENT_INTERFACE, USB_REQUEST_SET_INTERFACE,
+                    uvcAltSetting->bAlternateSetting, uvcTable.bStreamingInterface, 0, NULL,
+                    USB_DEVICE_REQUEST_SET, 0x00 );
+        if (RetVal == USB_SUCCESS)
+        {
+            testState = TEST_WAIT_SET_INTERFACE;
+        }
+        else if (RetVal != USB_ENDPOINT_BUSY)
+        {
+            fprintf( stderr, "SET_INTERFACE: error %02X\n", RetVal );
+            testState = TEST_ERROR;
+        }
+        break;
+
+    case TEST_WAIT_SET_INTERFACE:
+        if (!USBHostTransferIsComplete( deviceAddress, 0, &errorCode, &byteCount ))
+        {
+            break;
+        }
+        if (errorCode != USB_SUCCESS)
+        {
+            fprintf( stderr, "SET_INTERFACE: error %02X\n", errorCode );
+            testState = TEST_ERROR;
+            break;
+        }
+        testState = TEST_READ_ISOCHRONOUS;
+        break;
+
+    case TEST_READ_ISOCHRONOUS:
+        if (USBHostReadIsochronous( deviceAddress, uvcAltSetting->bEndpointAddress, &isocData ) == USB_SUCCESS)
+        {
+            stats.streamFrame = busFrame;
+            USBHostGetMaxISRTime( TRUE );
+            testState = TEST_DECODE;
+        }
+        break;
+
+    case TEST_DECODE:
+        DecodeTasks();
+        break;
+
+    case TEST_ERROR:
+        break;
+    }
+}
+
+
+BOOL USB_ApplicationEventHandler( BYTE address, USB_EVENT event, void *data, DWORD size )
+{
+    switch ((INT)event)
+    {
+    case EVENT_DATA_ISOC_READ:
+        // Only sent with USB_ISOC_DELIVERY_ISR, from the interrupt handler.
+        FramePoolPayload( &framePool, data, size );
+        stats.payloads++;
+        return TRUE;
+
+    case EVENT_GENERIC_DETACH:
+        deviceAddress   = 0;
+        testState       = TEST_WAIT_ATTACH;
+        return TRUE;
+
+    case EVENT_TRANSFER:
+    case EVENT_GENERIC_ATTACH:
+    case EVENT_GENERIC_TX_DONE:
+    case EVENT_GENERIC_RX_DONE:
+    case EVENT_VBUS_REQUEST_POWER:
+    case EVENT_VBUS_RELEASE_POWER:
+        return TRUE;
+
+    case EVENT_HUB_ATTACH:
+    case EVENT_UNSUPPORTED_DEVICE:
+    case EVENT_CANNOT_ENUMERATE:
+    case EVENT_CLIENT_INIT_ERROR:
+    case EVENT_OUT_OF_MEMORY:
+    case EVENT_UNSPECIFIED_ERROR:
+        fprintf( stderr, "USB error event %d\n", (int)event );
+        testState = TEST_ERROR;
+        return TRUE;
+
+    default:
+        break;
+    }
+    return FALSE;
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Main
+// *****************************************************************************
+// *****************************************************************************
+
+static BYTE * ReadTrace( const char *name, unsigned long *length )
+{
+    BYTE            *data;
+    FILE            *fp;
+    long            size;
+
+    fp = fopen( name, "rb" );
+    if (fp == NULL)
+    {
+        perror( name );
+        return NULL;
+    }
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+
+    data = malloc( size > 0 ? size : 1 );
+    if ((data == NULL) || (fread( data, 1, size, fp ) != (size_t)size))
+    {
+        fprintf( stderr, "%s: read error\n", name );
+        free( data );
+        fclose( fp );
+        return NULL;
+    }
+    fclose( fp );
+    *length = size;
+    return data;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    SIM_USB_STATISTICS  bus;
+    SIM_C270_STATUS     camera;
+    BYTE                *trace;
+    unsigned long       traceLength;
+    unsigned long       frames = 3;
+    DWORD               isrTicks;
+    BOOL                passed;
+    int                 task;
+    int                 opt;
+
+    while ((opt = getopt( argc, argv, "ivn:" )) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            isrDelivery = TRUE;
+            break;
+        case 'v':
+            UART2Init();
+            break;
+        case 'n':
+            frames = atol( optarg );
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if ((argc - optind != 1) || (frames == 0))
+    {
+        fprintf( stderr, "Usage: %s [-i] [-v] [-n frames] trace\n", argv[0] );
+        return 1;
+    }
+
+    trace = ReadTrace( argv[optind], &traceLength );
+    if (trace == NULL)
+    {
+        return 1;
+    }
+
+    // The buffers are made once at start, as InitializeSystem() does.
+    if (!USBHostIsochronousBuffersCreate( &isocData, USB_MAX_ISOCHRONOUS_DATA_BUFFERS, 1024 ) ||
+        !USBHostInit( 0 ))
+    {
+        fprintf( stderr, "initialization failed\n" );
+        return 1;
+    }
+    SimC270Init( trace, traceLength, PAYLOAD_TRANSFER_SIZE );
+    SimUsbAttach( &simC270Device, FALSE );
+
+    // The main loop runs a few times in each 1 ms frame of the bus.
+    for (busFrame = 0; busFrame < MAX_BUS_FRAMES; busFrame++)
+    {
+        if ((testState == TEST_ERROR) || (stats.frames + stats.decodeErrors + stats.sizeErrors >= frames))
+        {
+            break;
+        }
+        SimUsbFrame();
+        for (task = 0; task < TASKS_PER_FRAME; task++)
+        {
+            USBHostTasks();
+            TestTasks();
+        }
+    }
+    isrTicks = USBHostGetMaxISRTime( TRUE );
+
+    SimUsbGetStatistics( &bus );
+    SimC270GetStatus( &camera );
+    printf( "delivery %s, attached at %lu ms, streaming at %lu ms, %lu ms run\n",
+            isrDelivery ? "ISR" : "main loop", (unsigned long)stats.attachFrame,
+            (unsigned long)stats.streamFrame, (unsigned long)busFrame );
+    printf( "camera address %u, alternate setting %u, committed %u, setup %lu, stalls %lu, packets %lu\n",
+            camera.address, camera.alternateSetting, camera.committed,
+            (unsigned long)camera.setupPackets, (unsigned long)camera.stalls, (unsigned long)camera.packets );
+    printf( "bus tokens %lu, naks %lu, timeouts %lu, toggle errors %lu, bdt errors %lu, "
+            "token overruns %lu, stuck interrupts %lu, peak %u bytes/frame\n",
+            (unsigned long)bus.tokens, (unsigned long)bus.naks, (unsigned long)bus.timeouts,
+            (unsigned long)bus.toggleErrors, (unsigned long)bus.bdtErrors,
+            (unsigned long)bus.tokenOverruns, (unsigned long)bus.stuckInterrupts, bus.frameBytesPeak );
+    printf( "isochronous packets %lu, delivered %lu, overruns %lu, payloads %lu, header errors %lu\n",
+            (unsigned long)isocData.packetCount, (unsigned long)isocData.deliveredCount,
+            (unsigned long)isocData.overrunCount, stats.payloads,
+            (unsigned long)framePool.uvc.headerErrorCount );
+    printf( "frames ready %lu, dropped %lu, overflow %lu, error %lu, decoded %lu, decode errors %lu, size errors %lu\n",
+            (unsigned long)framePool.readyFrames, (unsigned long)framePool.droppedFrames,
+            (unsigned long)framePool.overflowFrames, (unsigned long)framePool.errorFrames,
+            stats.frames, stats.decodeErrors, stats.sizeErrors );
+    printf( "ISR=%lu us (%lu core timer ticks)\n",
+            (unsigned long)(isrTicks / (GetSystemClock() / 2000000)), (unsigned long)isrTicks );
+
+    passed = (stats.frames >= frames) && (stats.decodeErrors == 0) && (stats.sizeErrors == 0) &&
+             (uvcFrame != NULL) && camera.committed && (camera.alternateSetting == EXPECTED_ALT_SETTING) &&
+             (camera.commit[2] == uvcFrame->bFormatIndex) && (camera.commit[3] == uvcFrame->bFrameIndex) &&
+             (bus.timeouts == 0) && (bus.toggleErrors == 0) && (bus.bdtErrors == 0) && (bus.tokenOverruns == 0) &&
+             (bus.stuckInterrupts == 0) && (isocData.overrunCount == 0);
+    printf( "%s\n", passed ? "PASS" : "FAIL" );
+
+    free( trace );
+    return !passed;
+}
@@ -0,0 +1,331 @@
+/******************************************************************************
+            UVC payload stream test
+
+This is a PC test of the payload header parser and the frame assembler in
+firmware/uvc_stream.c.  Each case is a short packet trace, given as the
+header bytes and the payload length of each packet, and the test checks
+the result of UVCStreamPayload() for every packet and the counters at the
+end.
+
+If a trace file written by mktrace is given, it is also passed to the
+frame assembler, and the number of complete frames is checked.
+
+Usage:
+    test_uvc_stream [trace frames]
+
+    frames is the number of frames that the trace must give.  The first
+    frame of a trace is used to synchronize, so it is not counted.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "GenericTypeDefs.h"
+#include "uvc_stream.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+#define MAX_PACKET_SIZE             1023
+
+// Header bytes of the test packets
+#define EOH                         UVC_HEADER_EOH
+#define FID                         UVC_HEADER_FID
+#define EOF_                        UVC_HEADER_EOF
+#define PTS                         UVC_HEADER_PTS
+#define ERR                         UVC_HEADER_ERR
+
+#define START                       UVC_STREAM_FRAME_START
+#define END                         UVC_STREAM_FRAME_END
+#define DATA                        UVC_STREAM_FRAME_DATA
+#define BAD                         UVC_STREAM_HEADER_ERROR
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+// One packet of a test trace.  length is the length of the whole packet.
+// The header is bHeaderLength and bmHeaderInfo, followed by a 4 byte PTS if
+// the PTS bit is set.  The rest of the packet is filled with payload bytes.
+typedef struct
+{
+    WORD    length;                 // Packet length, 0 for a zero-length packet.
+    BYTE    bHeaderLength;          // bHeaderLength of the packet.
+    BYTE    bmHeaderInfo;           // bmHeaderInfo of the packet.
+    BYTE    result;                 // Expected result of UVCStreamPayload().
+    WORD    payloadLength;          // Expected payload length.
+} TEST_PACKET;
+
+typedef struct
+{
+    const char          *name;
+    const TEST_PACKET   *packets;
+    int                 count;
+    DWORD               frameCount;         // Expected counters at the end.
+    DWORD               errorFrameCount;
+    DWORD               headerErrorCount;
+    BYTE                bfEndOfFrame;       // Expected bfEndOfFrame of the last frame.
+    DWORD               frameSize;          // Expected frameSize of the last frame.
+} TEST_CASE;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Test Traces
+// *****************************************************************************
+// *****************************************************************************
+
+// Frames delimited by the FID toggle only.  The first frame synchronizes.
+static const TEST_PACKET fidToggle[] =
+{
+    { 102, 2, EOH,             0,                 0   },
+    { 102, 2, EOH | FID,       START | DATA,      100 },
+    { 102, 2, EOH | FID,       DATA,              100 },
+    {  52, 2, EOH,             END | START | DATA, 50 },
+    {  12, 2, EOH | FID,       END | START | DATA, 10 },
+};
+
+// Frames ended with the EOF bit, with header only packets after the EOF.
+static const TEST_PACKET endOfFrame[] =
+{
+    {  12, 2, EOH | EOF_,             0,                 0  },
+    { 106, 6, EOH | PTS | FID,        START | DATA,      100 },
+    {  56, 6, EOH | PTS | FID | EOF_, DATA | END,        50  },
+    {   6, 6, EOH | PTS | FID | EOF_, 0,                 0   },
+    {   2, 2, EOH | FID,              0,                 0   },
+    {  22, 2, EOH,                    START | DATA,      20  },
+    {  32, 2, EOH | EOF_,             DATA | END,        30  },
+};
+
+// The EOF packet of a frame is lost, and the FID toggle ends it.
+static const TEST_PACKET missedEndOfFrame[] =
+{
+    {   2, 2, EOH | EOF_,        0,                  0   },
+    { 102, 2, EOH | FID,         START | DATA,       100 },
+    { 102, 2, EOH | FID,         DATA,               100 },
+    // { 52, 2, EOH | FID | EOF_ } is lost here.
+    {  42, 2, EOH,               END | START | DATA, 40  },
+    {  42, 2, EOH | EOF_,        DATA | END,         40  },
+};
+
+// Zero-length packets inside and between the frames are ignored.  A frame
+// that ends with its first payload is still completed by the next call.
+static const TEST_PACKET zeroLength[] =
+{
+    {   0, 0, 0,                 0,                  0   },
+    {   2, 2, EOH | EOF_,        0,                  0   },
+    {   0, 0, 0,                 0,                  0   },
+    { 102, 2, EOH | FID,         START | DATA,       100 },
+    {   0, 0, 0,                 0,                  0   },
+    {   0, 0, 0,                 0,                  0   },
+    { 102, 2, EOH | FID,         DATA,               100 },
+    {   0, 0, 0,                 0,                  0   },
+    {  32, 2, EOH | FID | EOF_,  DATA | END,         30  },
+    {   0, 0, 0,                 0,                  0   },
+    {  22, 2, EOH | EOF_,        START | DATA,       20  },
+    {   0, 0, 0,                 END,                0   },
+    {   2, 2, EOH | FID,         START,              0   },
+};
+
+// Broken headers: bHeaderLength longer than the packet, bHeaderLength too
+// short for the PTS, and a packet shorter than the minimum header.  The
+// frame they are in is completed with bfError set.
+static const TEST_PACKET badHeaderLength[] =
+{
+    {   2, 2, EOH | EOF_,        0,                  0   },
+    { 102, 2, EOH | FID,         START | DATA,       100 },
+    {  10, 12, EOH | FID,        BAD,                0   },
+    { 102, 2, EOH | FID | PTS,   BAD,                0   },
+    {   1, 1, 0,                 BAD,                0   },
+    {  52, 2, EOH | FID | EOF_,  DATA | END,         50  },
+    { 102, 2, EOH,               START | DATA,       100 },
+    {  52, 2, EOH | EOF_,        DATA | END,         50  },
+};
+
+// The ERR bit marks the frame as broken.
+static const TEST_PACKET errorBit[] =
+{
+    {   2, 2, EOH | EOF_,        0,                  0   },
+    { 102, 2, EOH | FID | ERR,   START | DATA,       100 },
+    {  52, 2, EOH | FID | EOF_,  DATA | END,         50  },
+};
+
+#define CASE(t)     #t, t, sizeof(t) / sizeof(t[0])
+
+static const TEST_CASE testCases[] =
+{
+    //                         frames errors headers EOF size
+    { CASE(fidToggle),         2,     0,     0,      0,  50  },
+    { CASE(endOfFrame),        2,     0,     0,      1,  50  },
+    { CASE(missedEndOfFrame),  2,     0,     0,      1,  80  },
+    { CASE(zeroLength),        2,     0,     0,      1,  20  },
+    { CASE(badHeaderLength),   2,     1,     3,      1,  150 },
+    { CASE(errorBit),          1,     1,     0,      1,  150 },
+};
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+static int failures;
+
+static void Fail( const char *name, int packet, const char *what, unsigned long value, unsigned long expected )
+{
+    printf( "FAIL %s packet %d: %s is %lu, expected %lu\n", name, packet, what, value, expected );
+    failures++;
+}
+
+
+static void RunCase( const TEST_CASE *test )
+{
+    UVC_STREAM          stream;
+    BYTE                packet[MAX_PACKET_SIZE];
+    BYTE                *payload;
+    WORD                payloadLength;
+    BYTE                result;
+    const TEST_PACKET   *p;
+    int                 i;
+    int                 before = failures;
+
+    UVCStreamInit( &stream );
+    for (i = 0; i < test->count; i++)
+    {
+        p = &test->packets[i];
+        memset( packet, 0xAA, sizeof(packet) );
+        if (p->length >= 1)
+        {
+            packet[0] = p->bHeaderLength;
+        }
+        if (p->length >= 2)
+        {
+            packet[1] = p->bmHeaderInfo;
+        }
+
+        result = UVCStreamPayload( &stream, packet, p->length, &payload, &payloadLength );
+        if (result != p->result)
+        {
+            Fail( test->name, i, "result", result, p->result );
+        }
+        if (payloadLength != p->payloadLength)
+        {
+            Fail( test->name, i, "payload length", payloadLength, p->payloadLength );
+        }
+        if ((payloadLength != 0) && (payload != packet + p->bHeaderLength))
+        {
+            Fail( test->name, i, "payload offset", payload - packet, p->bHeaderLength );
+        }
+    }
+
+    if (stream.frameCount != test->frameCount)
+    {
+        Fail( test->name, i, "frameCount", stream.frameCount, test->frameCount );
+    }
+    if (stream.errorFrameCount != test->errorFrameCount)
+    {
+        Fail( test->name, i, "errorFrameCount", stream.errorFrameCount, test->errorFrameCount );
+    }
+    if (stream.headerErrorCount != test->headerErrorCount)
+    {
+        Fail( test->name, i, "headerErrorCount", stream.headerErrorCount, test->headerErrorCount );
+    }
+    if (stream.lastFrame.bfEndOfFrame != test->bfEndOfFrame)
+    {
+        Fail( test->name, i, "bfEndOfFrame", stream.lastFrame.bfEndOfFrame, test->bfEndOfFrame );
+    }
+    if (stream.lastFrame.frameSize != test->frameSize)
+    {
+        Fail( test->name, i, "frameSize", stream.lastFrame.frameSize, test->frameSize );
+    }
+
+    printf( "%s %s\n", (failures == before) ? "ok  " : "FAIL", test->name );
+}
+
+
+static void RunTrace( const char *name, unsigned long frames )
+{
+    UVC_STREAM      stream;
+    BYTE            packet[MAX_PACKET_SIZE];
+    BYTE            *payload;
+    WORD            payloadLength;
+    WORD            length;
+    unsigned long   completed = 0;
+    int             before = failures;
+    int             lo;
+    int             hi;
+    FILE            *fp;
+
+    fp = fopen( name, "rb" );
+    if (fp == NULL)
+    {
+        perror( name );
+        failures++;
+        return;
+    }
+
+    UVCStreamInit( &stream );
+    while (((lo = fgetc( fp )) != EOF) && ((hi = fgetc( fp )) != EOF))
+    {
+        length = lo | (hi << 8);
+        if ((length > sizeof(packet)) || (fread( packet, 1, length, fp ) != length))
+        {
+            Fail( name, completed, "packet length", length, sizeof(packet) );
+            break;
+        }
+        if (UVCStreamPayload( &stream, packet, length, &payload, &payloadLength ) & UVC_STREAM_FRAME_END)
+        {
+            completed++;
+        }
+    }
+    fclose( fp );
+
+    // The last frame ends with the EOF bit, so it is complete too.
+    if (completed != frames)
+    {
+        Fail( name, -1, "frames", completed, frames );
+    }
+    if (stream.headerErrorCount != 0)
+    {
+        Fail( name, -1, "headerErrorCount", stream.headerErrorCount, 0 );
+    }
+    if (stream.errorFrameCount != 0)
+    {
+        Fail( name, -1, "errorFrameCount", stream.errorFrameCount, 0 );
+    }
+
+    printf( "%s %s\n", (failures == before) ? "ok  " : "FAIL", name );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    unsigned int    i;
+
+    if ((argc != 1) && (argc != 3))
+    {
+        fprintf( stderr, "Usage: %s [trace frames]\n", argv[0] );
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(testCases) / sizeof(testCases[0]); i++)
+    {
+        RunCase( &testCases[i] );
+    }
+    if (argc == 3)
+    {
+        RunTrace( argv[1], strtoul( argv[2], NULL, 0 ) );
+    }
+
+    if (failures != 0)
+    {
+        printf( "%d failures\n", failures );
+        return 1;
+    }
+    return 0;
+}
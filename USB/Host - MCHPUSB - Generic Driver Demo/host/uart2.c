@@ -0,0 +1,74 @@
+/******************************************************************************
+            UART2 stand-in for the PC build
+
+The USB host stack prints some debug messages with the UART2 functions of
+uart2.h.  On the PC they go to stderr, but only after UART2Init() has been
+called, so that a test can turn them on with an option.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include "GenericTypeDefs.h"
+#include "uart2.h"
+
+static BOOL uart2Enabled;
+
+
+void UART2Init( void )
+{
+    uart2Enabled = TRUE;
+}
+
+
+void UART2PutChar( char ch )
+{
+    if (uart2Enabled)
+    {
+        fputc( ch, stderr );
+    }
+}
+
+
+void UART2PrintString( char *str )
+{
+    if (uart2Enabled)
+    {
+        fputs( str, stderr );
+    }
+}
+
+
+void UART2PutDec( unsigned char dec )
+{
+    if (uart2Enabled)
+    {
+        fprintf( stderr, "%u", dec );
+    }
+}
+
+
+void UART2PutHex( int toPrint )
+{
+    if (uart2Enabled)
+    {
+        fprintf( stderr, "%02X", toPrint & 0xFF );
+    }
+}
+
+
+void UART2PutHexWord( unsigned int toPrint )
+{
+    if (uart2Enabled)
+    {
+        fprintf( stderr, "%04X", toPrint & 0xFFFF );
+    }
+}
+
+
+void UART2PutHexDWord( unsigned long int toPrint )
+{
+    if (uart2Enabled)
+    {
+        fprintf( stderr, "%08lX", toPrint & 0xFFFFFFFFul );
+    }
+}
@@ -0,0 +1,376 @@
+/******************************************************************************
+            PIC32 USB module stand-in for the PC build
+
+This header takes the place of the USB part of p32xxxx.h when usb_host.c
+is built on a PC.  The U1* registers are kept by sim_usb.c, which plays
+the part of the USB module: it runs the tokens written to U1TOK on the
+buffer descriptors of the BDT, passes them to a simulated device, writes
+the results back to the BDT and U1STAT, and calls _USB1Interrupt() for the
+interrupt flags that are set and enabled.
+
+Every access to a register goes through SimUsbRegister(), so that the
+module can apply the effect of the previous access first:
+    - U1IR, U1OTGIR and U1EIR are cleared by writing a '1' to a flag.  A
+      write to the whole register goes to a separate clear port, and the
+      ...bits names read the flags.
+    - A write to U1TOK starts a token.  Bit 8 of U1TOK, which does not exist
+      on the PIC32, is set by the module once it has taken the token.
+    - U1CONbits.JSTATE follows the speed of the attached device, and
+      U1CONbits.PPBRST resets the ping-pong pointers of the BDT.
+
+Addresses are given to the module as 32-bit physical addresses, as on the
+PIC32, so the program must be linked to run below 4 GB (-no-pie).
+KVA_TO_PA() stops the program if a buffer is above that.
+
+******************************************************************************/
+
+#ifndef _HOST_USB_HAL_PIC32_H
+#define _HOST_USB_HAL_PIC32_H
+
+#include <stdint.h>
+#include "GenericTypeDefs.h"
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Registers
+// *****************************************************************************
+// *****************************************************************************
+
+typedef enum
+{
+    SIM_U1OTGIR = 0,
+    SIM_U1OTGIR_CLEAR,
+    SIM_U1OTGIE,
+    SIM_U1OTGSTAT,
+    SIM_U1OTGCON,
+    SIM_U1PWRC,
+    SIM_U1IR,
+    SIM_U1IR_CLEAR,
+    SIM_U1IE,
+    SIM_U1EIR,
+    SIM_U1EIR_CLEAR,
+    SIM_U1EIE,
+    SIM_U1STAT,
+    SIM_U1CON,
+    SIM_U1ADDR,
+    SIM_U1BDTP1,
+    SIM_U1FRML,
+    SIM_U1FRMH,
+    SIM_U1TOK,
+    SIM_U1SOF,
+    SIM_U1BDTP2,
+    SIM_U1BDTP3,
+    SIM_U1CNFG1,
+    SIM_U1CNFG2,
+    SIM_U1EP0,
+    SIM_U1EP15 = SIM_U1EP0 + 15,
+
+    // Interrupt controller.  The SET and CLR ports are applied to the
+    // register on the next access.
+    SIM_IFS1,
+    SIM_IFS1SET,
+    SIM_IFS1CLR,
+    SIM_IEC1,
+    SIM_IEC1SET,
+    SIM_IEC1CLR,
+    SIM_IPC11,
+    SIM_IPC11SET,
+    SIM_IPC11CLR,
+
+    SIM_USB_REGISTERS
+} SIM_USB_REGISTER;
+
+#define SIM_U1TOK_DONE              0x100       // The module has taken the token in U1TOK.
+
+volatile DWORD * SimUsbRegister( SIM_USB_REGISTER reg );
+DWORD SimUsbPhysicalAddress( uintptr_t address );
+
+#define SIM_REGISTER(reg)           (*SimUsbRegister( reg ))
+#define SIM_REGISTER_BITS(reg,type) (*(volatile type *)SimUsbRegister( reg ))
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Register Bits
+// *****************************************************************************
+// *****************************************************************************
+
+// The layouts are those of the PIC32MX family data sheet.
+
+typedef union
+{
+    struct
+    {
+        unsigned    VBUSVDIF    :1;
+        unsigned                :1;
+        unsigned    SESENDIF    :1;
+        unsigned    SESVDIF     :1;
+        unsigned    ACTVIF      :1;
+        unsigned    LSTATEIF    :1;
+        unsigned    T1MSECIF    :1;
+        unsigned    IDIF        :1;
+    };
+    DWORD   w;
+} __U1OTGIRbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    VBUSVDIE    :1;
+        unsigned                :1;
+        unsigned    SESENDIE    :1;
+        unsigned    SESVDIE     :1;
+        unsigned    ACTVIE      :1;
+        unsigned    LSTATEIE    :1;
+        unsigned    T1MSECIE    :1;
+        unsigned    IDIE        :1;
+    };
+    DWORD   w;
+} __U1OTGIEbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    VBUSVD      :1;
+        unsigned                :1;
+        unsigned    SESEND      :1;
+        unsigned    SESVD       :1;
+        unsigned                :1;
+        unsigned    LSTATE      :1;
+        unsigned                :1;
+        unsigned    ID          :1;
+    };
+    DWORD   w;
+} __U1OTGSTATbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    USBPWR      :1;
+        unsigned    USUSPEND    :1;
+        unsigned                :2;
+        unsigned    USBBUSY     :1;
+        unsigned                :2;
+        unsigned    UACTPND     :1;
+    };
+    DWORD   w;
+} __U1PWRCbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    URSTIF      :1;
+        unsigned    UERRIF      :1;
+        unsigned    SOFIF       :1;
+        unsigned    TRNIF       :1;
+        unsigned    IDLEIF      :1;
+        unsigned    RESUMEIF    :1;
+        unsigned    ATTACHIF    :1;
+        unsigned    STALLIF     :1;
+    };
+    struct
+    {
+        unsigned    DETACHIF    :1;
+    };
+    DWORD   w;
+} __U1IRbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    URSTIE      :1;
+        unsigned    UERRIE      :1;
+        unsigned    SOFIE       :1;
+        unsigned    TRNIE       :1;
+        unsigned    IDLEIE      :1;
+        unsigned    RESUMEIE    :1;
+        unsigned    ATTACHIE    :1;
+        unsigned    STALLIE     :1;
+    };
+    struct
+    {
+        unsigned    DETACHIE    :1;
+    };
+    DWORD   w;
+} __U1IEbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    PIDEF       :1;
+        unsigned    CRC5EF      :1;
+        unsigned    CRC16EF     :1;
+        unsigned    DFN8EF      :1;
+        unsigned    BTOEF       :1;
+        unsigned    DMAEF       :1;
+        unsigned    BMXEF       :1;
+        unsigned    BTSEF       :1;
+    };
+    struct
+    {
+        unsigned                :1;
+        unsigned    EOFEF       :1;
+    };
+    DWORD   w;
+} __U1EIRbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned                :2;
+        unsigned    PPBI        :1;
+        unsigned    DIR         :1;
+        unsigned    ENDPT       :4;
+    };
+    DWORD   w;
+} __U1STATbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    SOFEN       :1;
+        unsigned    PPBRST      :1;
+        unsigned    RESUME      :1;
+        unsigned    HOSTEN      :1;
+        unsigned    USBRST      :1;
+        unsigned    TOKBUSY     :1;
+        unsigned    SE0         :1;
+        unsigned    JSTATE      :1;
+    };
+    struct
+    {
+        unsigned    USBEN       :1;
+        unsigned                :4;
+        unsigned    PKTDIS      :1;
+    };
+    DWORD   w;
+} __U1CONbits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned    EPHSHK      :1;
+        unsigned    EPSTALL     :1;
+        unsigned    EPTXEN      :1;
+        unsigned    EPRXEN      :1;
+        unsigned    EPCONDIS    :1;
+        unsigned                :1;
+        unsigned    RETRYDIS    :1;
+        unsigned    LSPD        :1;
+    };
+    DWORD   w;
+} __U1EP0bits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned                :25;
+        unsigned    USBIF       :1;
+    };
+    DWORD   w;
+} __IFS1bits_t;
+
+typedef union
+{
+    struct
+    {
+        unsigned                :25;
+        unsigned    USBIE       :1;
+    };
+    DWORD   w;
+} __IEC1bits_t;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Register Names
+// *****************************************************************************
+// *****************************************************************************
+
+#define U1OTGIR         SIM_REGISTER( SIM_U1OTGIR_CLEAR )
+#define U1OTGIRbits     SIM_REGISTER_BITS( SIM_U1OTGIR, __U1OTGIRbits_t )
+#define U1OTGIE         SIM_REGISTER( SIM_U1OTGIE )
+#define U1OTGIEbits     SIM_REGISTER_BITS( SIM_U1OTGIE, __U1OTGIEbits_t )
+#define U1OTGSTAT       SIM_REGISTER( SIM_U1OTGSTAT )
+#define U1OTGSTATbits   SIM_REGISTER_BITS( SIM_U1OTGSTAT, __U1OTGSTATbits_t )
+#define U1OTGCON        SIM_REGISTER( SIM_U1OTGCON )
+#define U1PWRC          SIM_REGISTER( SIM_U1PWRC )
+#define U1PWRCbits      SIM_REGISTER_BITS( SIM_U1PWRC, __U1PWRCbits_t )
+#define U1IR            SIM_REGISTER( SIM_U1IR_CLEAR )
+#define U1IRbits        SIM_REGISTER_BITS( SIM_U1IR, __U1IRbits_t )
+#define U1IE            SIM_REGISTER( SIM_U1IE )
+#define U1IEbits        SIM_REGISTER_BITS( SIM_U1IE, __U1IEbits_t )
+#define U1EIR           SIM_REGISTER( SIM_U1EIR_CLEAR )
+#define U1EIRbits       SIM_REGISTER_BITS( SIM_U1EIR, __U1EIRbits_t )
+#define U1EIE           SIM_REGISTER( SIM_U1EIE )
+#define U1STAT          SIM_REGISTER( SIM_U1STAT )
+#define U1STATbits      SIM_REGISTER_BITS( SIM_U1STAT, __U1STATbits_t )
+#define U1CON           SIM_REGISTER( SIM_U1CON )
+#define U1CONbits       SIM_REGISTER_BITS( SIM_U1CON, __U1CONbits_t )
+#define U1ADDR          SIM_REGISTER( SIM_U1ADDR )
+#define U1BDTP1         SIM_REGISTER( SIM_U1BDTP1 )
+#define U1FRML          SIM_REGISTER( SIM_U1FRML )
+#define U1FRMH          SIM_REGISTER( SIM_U1FRMH )
+#define U1TOK           SIM_REGISTER( SIM_U1TOK )
+#define U1SOF           SIM_REGISTER( SIM_U1SOF )
+#define U1BDTP2         SIM_REGISTER( SIM_U1BDTP2 )
+#define U1BDTP3         SIM_REGISTER( SIM_U1BDTP3 )
+#define U1CNFG1         SIM_REGISTER( SIM_U1CNFG1 )
+#define U1CNFG2         SIM_REGISTER( SIM_U1CNFG2 )
+#define U1EP0           SIM_REGISTER( SIM_U1EP0 )
+#define U1EP0bits       SIM_REGISTER_BITS( SIM_U1EP0, __U1EP0bits_t )
+#define U1EP1           SIM_REGISTER( SIM_U1EP0 + 1 )
+#define U1EP2           SIM_REGISTER( SIM_U1EP0 + 2 )
+#define U1EP3           SIM_REGISTER( SIM_U1EP0 + 3 )
+#define U1EP4           SIM_REGISTER( SIM_U1EP0 + 4 )
+#define U1EP5           SIM_REGISTER( SIM_U1EP0 + 5 )
+#define U1EP6           SIM_REGISTER( SIM_U1EP0 + 6 )
+#define U1EP7           SIM_REGISTER( SIM_U1EP0 + 7 )
+#define U1EP8           SIM_REGISTER( SIM_U1EP0 + 8 )
+#define U1EP9           SIM_REGISTER( SIM_U1EP0 + 9 )
+#define U1EP10          SIM_REGISTER( SIM_U1EP0 + 10 )
+#define U1EP11          SIM_REGISTER( SIM_U1EP0 + 11 )
+#define U1EP12          SIM_REGISTER( SIM_U1EP0 + 12 )
+#define U1EP13          SIM_REGISTER( SIM_U1EP0 + 13 )
+#define U1EP14          SIM_REGISTER( SIM_U1EP0 + 14 )
+#define U1EP15          SIM_REGISTER( SIM_U1EP15 )
+
+#define IFS1            SIM_REGISTER( SIM_IFS1 )
+#define IFS1bits        SIM_REGISTER_BITS( SIM_IFS1, __IFS1bits_t )
+#define IFS1SET         SIM_REGISTER( SIM_IFS1SET )
+#define IFS1CLR         SIM_REGISTER( SIM_IFS1CLR )
+#define IEC1            SIM_REGISTER( SIM_IEC1 )
+#define IEC1bits        SIM_REGISTER_BITS( SIM_IEC1, __IEC1bits_t )
+#define IEC1SET         SIM_REGISTER( SIM_IEC1SET )
+#define IEC1CLR         SIM_REGISTER( SIM_IEC1CLR )
+#define IPC11           SIM_REGISTER( SIM_IPC11 )
+#define IPC11SET        SIM_REGISTER( SIM_IPC11SET )
+#define IPC11CLR        SIM_REGISTER( SIM_IPC11CLR )
+
+#define _IFS1_USBIF_MASK            0x02000000
+#define _IEC1_USBIE_MASK            0x02000000
+#define _IPC11_USBIP_POSITION       10
+#define _IPC11_USBIP_MASK           0x00001C00
+#define _IPC11_USBIS_MASK           0x00000300
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Addresses and Interrupt Vectors
+// *****************************************************************************
+// *****************************************************************************
+
+#define KVA_TO_PA(v)                SimUsbPhysicalAddress( (uintptr_t)(v) )
+#define PA_TO_KVA1(pa)              ((void *)(uintptr_t)(pa))
+
+#define _USB_1_VECTOR               45
+#define __ISR(vector,ipl)
+
+#endif
@@ -0,0 +1,460 @@
+/******************************************************************************
+            JPEG frame receiver
+
+This is a Linux tool that receives the JPEG frames sent by the demo with
+the binary protocol in firmware/frame_upload.h.  It reassembles the frames,
+optionally saves them as JPEG files, and reports the frame rate and the
+throughput.  Bytes that are not part of a packet, such as the text log of
+the demo, are passed through to stdout.
+
+Build:
+    cc -O2 -o frame_receiver frame_receiver.c
+
+Usage:
+    frame_receiver <serial device> [baud rate] [output directory]
+
+    The baud rate defaults to 57600, the BAUDRATE2 value of the demo.
+
+******************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Constants
+// *****************************************************************************
+// *****************************************************************************
+
+// These must match firmware/frame_upload.h.
+#define FRAME_UPLOAD_SYNC0          0xA5
+#define FRAME_UPLOAD_SYNC1          0x5A
+
+#define FRAME_UPLOAD_TYPE_START     0x01
+#define FRAME_UPLOAD_TYPE_DATA      0x02
+#define FRAME_UPLOAD_TYPE_END       0x03
+
+#define FRAME_UPLOAD_HEADER_SIZE    8
+#define FRAME_UPLOAD_CRC_SIZE       2
+
+#define MAX_PAYLOAD_SIZE            4096        // Larger lengths are treated as a false sync.
+#define MAX_FRAME_SIZE              (1024 * 1024)
+#define MAX_PACKET_SIZE             (FRAME_UPLOAD_HEADER_SIZE + MAX_PAYLOAD_SIZE + FRAME_UPLOAD_CRC_SIZE)
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Data Structures
+// *****************************************************************************
+// *****************************************************************************
+
+typedef struct
+{
+    unsigned char   *data;                  // Frame being reassembled.
+    unsigned long   length;                 // Length from the START packet.
+    unsigned long   received;               // Frame bytes received.
+    unsigned long   pts;                    // PTS from the START packet.
+    unsigned int    frameNumber;            // Frame number of the frame.
+    int             active;                 // A START packet has been received.
+    int             broken;                 // A packet of the frame was lost.
+} FRAME;
+
+typedef struct
+{
+    unsigned long   frames;                 // Complete frames.
+    unsigned long   incompleteFrames;       // Frames with lost packets.
+    unsigned long   crcErrors;              // Packets with a bad CRC.
+    unsigned long   lostPackets;            // Gaps in the packet sequence.
+    unsigned long   frameBytes;             // JPEG bytes of the complete frames.
+    unsigned long   wireBytes;              // All bytes read from the port.
+    double          startTime;              // Time of the first complete frame.
+    unsigned long   startFrameBytes;        // frameBytes at startTime.
+    unsigned long   startWireBytes;         // wireBytes at startTime.
+} STATS;
+
+static FRAME    frame;
+static STATS    stats;
+static int      lastSequence = -1;
+static const char *outputDirectory;
+
+static unsigned char    packet[MAX_PACKET_SIZE];
+static unsigned int     count;                  // Bytes of the packet collected so far.
+static unsigned int     payloadLength;
+static unsigned char    rescan[MAX_PACKET_SIZE];
+static unsigned int     rescanLength;           // Bytes in rescan.
+static unsigned int     rescanIndex;            // Next byte of rescan to scan.
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Local Functions
+// *****************************************************************************
+// *****************************************************************************
+
+static double Now( void )
+{
+    struct timeval  tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static unsigned short Crc16( const unsigned char *data, unsigned int length )
+{
+    unsigned short  crc = 0xFFFF;
+    unsigned int    i;
+    int             bit;
+
+    for (i = 0; i < length; i++)
+    {
+        crc ^= (unsigned short)data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (unsigned short)((crc << 1) ^ 0x1021) : (unsigned short)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+static unsigned long GetDWord( const unsigned char *data )
+{
+    return (unsigned long)data[0] | ((unsigned long)data[1] << 8) |
+           ((unsigned long)data[2] << 16) | ((unsigned long)data[3] << 24);
+}
+
+
+static speed_t BaudToSpeed( long baud )
+{
+    switch (baud)
+    {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        case 1000000:   return B1000000;
+    }
+    return 0;
+}
+
+
+static int OpenPort( const char *device, long baud )
+{
+    struct termios  tio;
+    speed_t         speed;
+    int             fd;
+
+    speed = BaudToSpeed( baud );
+    if (speed == 0)
+    {
+        fprintf( stderr, "Unsupported baud rate %ld\n", baud );
+        return -1;
+    }
+
+    fd = open( device, O_RDONLY | O_NOCTTY );
+    if (fd < 0)
+    {
+        fprintf( stderr, "%s: %s\n", device, strerror( errno ) );
+        return -1;
+    }
+
+    memset( &tio, 0, sizeof(tio) );
+    cfmakeraw( &tio );
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed( &tio, speed );
+    cfsetospeed( &tio, speed );
+    if (tcsetattr( fd, TCSANOW, &tio ) < 0)
+    {
+        fprintf( stderr, "%s: %s\n", device, strerror( errno ) );
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+
+static void SaveFrame( void )
+{
+    char    name[1024];
+    FILE    *fp;
+
+    if (outputDirectory == NULL)
+    {
+        return;
+    }
+    snprintf( name, sizeof(name), "%s/frame_%05u.jpg", outputDirectory, frame.frameNumber );
+    fp = fopen( name, "wb" );
+    if (fp == NULL)
+    {
+        fprintf( stderr, "%s: %s\n", name, strerror( errno ) );
+        return;
+    }
+    fwrite( frame.data, 1, frame.length, fp );
+    fclose( fp );
+}
+
+
+static void EndFrame( void )
+{
+    double  now;
+    double  elapsed;
+
+    if (!frame.active)
+    {
+        return;
+    }
+    frame.active = 0;
+
+    if (frame.broken || (frame.received != frame.length))
+    {
+        stats.incompleteFrames++;
+        fprintf( stderr, "[frame %u incomplete: %lu of %lu bytes]\n",
+                    frame.frameNumber, frame.received, frame.length );
+        return;
+    }
+
+    now = Now();
+    stats.frames++;
+    stats.frameBytes += frame.length;
+    if (stats.frames == 1)
+    {
+        // The rates are measured from the end of the first frame.
+        stats.startTime       = now;
+        stats.startFrameBytes = stats.frameBytes;
+        stats.startWireBytes  = stats.wireBytes;
+    }
+    SaveFrame();
+
+    elapsed = now - stats.startTime;
+    fprintf( stderr, "[frame %u: %lu bytes, PTS %08lx", frame.frameNumber, frame.length, frame.pts );
+    if ((stats.frames > 1) && (elapsed > 0))
+    {
+        fprintf( stderr, ", %.2f fps, %.0f B/s frames, %.0f B/s wire",
+                    (stats.frames - 1) / elapsed,
+                    (stats.frameBytes - stats.startFrameBytes) / elapsed,
+                    (stats.wireBytes - stats.startWireBytes) / elapsed );
+    }
+    fprintf( stderr, ", incomplete %lu, CRC errors %lu, lost packets %lu]\n",
+                stats.incompleteFrames, stats.crcErrors, stats.lostPackets );
+}
+
+
+static void HandlePacket( const unsigned char *packet, unsigned int payloadLength )
+{
+    const unsigned char *payload = packet + FRAME_UPLOAD_HEADER_SIZE;
+    int                 sequence = packet[3];
+    unsigned int        frameNumber = packet[4] | (packet[5] << 8);
+    unsigned long       offset;
+
+    if ((lastSequence >= 0) && (sequence != ((lastSequence + 1) & 0xFF)))
+    {
+        stats.lostPackets += (sequence - lastSequence - 1) & 0xFF;
+        frame.broken = 1;
+    }
+    lastSequence = sequence;
+
+    switch (packet[2])
+    {
+        case FRAME_UPLOAD_TYPE_START:
+            if (frame.active)
+            {
+                EndFrame();
+            }
+            if (payloadLength < 8)
+            {
+                break;
+            }
+            frame.length      = GetDWord( payload );
+            frame.pts         = GetDWord( payload + 4 );
+            frame.frameNumber = frameNumber;
+            frame.received    = 0;
+            frame.broken      = (frame.length > MAX_FRAME_SIZE);
+            frame.active      = 1;
+            break;
+
+        case FRAME_UPLOAD_TYPE_DATA:
+            if (!frame.active || (frameNumber != frame.frameNumber) || (payloadLength < 4))
+            {
+                break;
+            }
+            offset = GetDWord( payload );
+            payloadLength -= 4;
+            if (frame.broken || (offset != frame.received) || (offset + payloadLength > frame.length))
+            {
+                frame.broken = 1;
+                break;
+            }
+            memcpy( frame.data + offset, payload + 4, payloadLength );
+            frame.received += payloadLength;
+            break;
+
+        case FRAME_UPLOAD_TYPE_END:
+            if (frame.active && (frameNumber == frame.frameNumber))
+            {
+                EndFrame();
+            }
+            break;
+    }
+}
+
+
+static void Resync( void )
+{
+    unsigned int    rest = rescanLength - rescanIndex;
+
+    // The sync was false, or the packet was broken.  The next packet may
+    // start inside the bytes collected so far, so they are scanned again
+    // from the byte after the sync, ahead of the bytes still to be scanned.
+    memmove( rescan + count - 1, rescan + rescanIndex, rest );
+    memcpy( rescan, packet + 1, count - 1 );
+    rescanLength = count - 1 + rest;
+    rescanIndex  = 0;
+    count        = 0;
+}
+
+
+static void ReceiveByte( unsigned char c, int echo )
+{
+    unsigned short  crc;
+
+    // Look for the sync pattern.  Other bytes are the text log.  Bytes that
+    // are scanned again are not, so they are not echoed.
+    if (count == 0)
+    {
+        if (c == FRAME_UPLOAD_SYNC0)
+        {
+            packet[count++] = c;
+        }
+        else if (echo)
+        {
+            putchar( c );
+        }
+        return;
+    }
+    if (count == 1)
+    {
+        if (c == FRAME_UPLOAD_SYNC1)
+        {
+            packet[count++] = c;
+        }
+        else
+        {
+            if (echo)
+            {
+                putchar( FRAME_UPLOAD_SYNC0 );
+            }
+            count = (c == FRAME_UPLOAD_SYNC0) ? 1 : 0;
+            if ((count == 0) && echo)
+            {
+                putchar( c );
+            }
+        }
+        return;
+    }
+
+    packet[count++] = c;
+    if (count == FRAME_UPLOAD_HEADER_SIZE)
+    {
+        payloadLength = packet[6] | (packet[7] << 8);
+        if (payloadLength > MAX_PAYLOAD_SIZE)
+        {
+            // Not a packet.
+            stats.crcErrors++;
+            Resync();
+        }
+        return;
+    }
+    if (count == FRAME_UPLOAD_HEADER_SIZE + payloadLength + FRAME_UPLOAD_CRC_SIZE)
+    {
+        crc = packet[count - 2] | (packet[count - 1] << 8);
+        if (crc == Crc16( packet + 2, FRAME_UPLOAD_HEADER_SIZE - 2 + payloadLength ))
+        {
+            HandlePacket( packet, payloadLength );
+            count = 0;
+        }
+        else
+        {
+            stats.crcErrors++;
+            frame.broken = 1;
+            Resync();
+        }
+    }
+}
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Main
+// *****************************************************************************
+// *****************************************************************************
+
+int main( int argc, char *argv[] )
+{
+    unsigned char           buffer[4096];
+    long                    baud = 57600;
+    ssize_t                 n;
+    ssize_t                 i;
+    int                     fd;
+
+    if (argc < 2)
+    {
+        fprintf( stderr, "Usage: %s <serial device> [baud rate] [output directory]\n", argv[0] );
+        return 1;
+    }
+    if (argc >= 3)
+    {
+        baud = atol( argv[2] );
+    }
+    if (argc >= 4)
+    {
+        outputDirectory = argv[3];
+    }
+
+    frame.data = malloc( MAX_FRAME_SIZE );
+    if (frame.data == NULL)
+    {
+        return 1;
+    }
+    fd = OpenPort( argv[1], baud );
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    while ((n = read( fd, buffer, sizeof(buffer) )) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf( stderr, "read: %s\n", strerror( errno ) );
+            break;
+        }
+        stats.wireBytes += n;
+
+        for (i = 0; i < n; i++)
+        {
+            ReceiveByte( buffer[i], 1 );
+            while (rescanIndex < rescanLength)
+            {
+                ReceiveByte( rescan[rescanIndex++], 0 );
+            }
+        }
+        fflush( stdout );
+    }
+
+    close( fd );
+    return 0;
+}